@@ -9,6 +9,7 @@ import android.util.Log;
 import android.widget.TextView;
 
 import io.easycipher.test.AESTest;
+import io.easycipher.test.BigIntTest;
 import io.easycipher.test.EccTest;
 import io.easycipher.test.EfficiencyTest;
 import io.easycipher.test.RSATest;
@@ -24,6 +25,18 @@ public class MainActivity extends AppCompatActivity {
         AsyncTask.SERIAL_EXECUTOR.execute(this::test);
 
         AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareTime);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareRSAVerify);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareRSASign);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareRSALatency);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareRSAKeyGen);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareModPow);
+
+        AsyncTask.SERIAL_EXECUTOR.execute(EfficiencyTest::compareECC);
     }
 
     @SuppressLint("SetTextI18n")
@@ -51,6 +64,10 @@ public class MainActivity extends AppCompatActivity {
             boolean rsa = RSATest.testCrypt();
             builder.append("rsa ").append((rsa ? "success" : "failed")).append('\n');
             tv.post(() -> tv.setText(builder.toString()));
+
+            boolean bigInt = BigIntTest.test();
+            builder.append("bigint ").append((bigInt ? "success" : "failed")).append('\n');
+            tv.post(() -> tv.setText(builder.toString()));
         } catch (Exception e) {
             Log.e("MyTag", e.getMessage(), e);
         }
@@ -0,0 +1,155 @@
+package io.easycipher.test;
+
+import android.util.Log;
+
+import java.math.BigInteger;
+import java.util.Random;
+
+import io.easycipher.NativeBigInt;
+
+public class BigIntTest {
+    private static final String TAG = "MyTag";
+    private static final Random random = RandomUtil.random;
+
+    // The 2048-bit MODP group of RFC 3526, generator 2.
+    static final BigInteger MODP_2048 = new BigInteger(
+            "FFFFFFFFFFFFFFFFC90FDAA22168C234C4C6628B80DC1CD129024E088A67CC74" +
+            "020BBEA63B139B22514A08798E3404DDEF9519B3CD3A431B302B0A6DF25F1437" +
+            "4FE1356D6D51C245E485B576625E7EC6F44C42E9A637ED6B0BFF5CB6F406B7ED" +
+            "EE386BFB5A899FA5AE9F24117C4B1FE649286651ECE45B3DC2007CB8A163BF05" +
+            "98DA48361C55D39A69163FA8FD24CF5F83655D23DCA3AD961C62F356208552BB" +
+            "9ED529077096966D670C354E4ABC9804F1746C08CA18217C32905E462E36CE3B" +
+            "E39E772C180E86039B2783A2EC07A28FB5C55DF06F4C52C9DE2BCBF695581718" +
+            "3995497CEA956AE515D2261898FA051015728E5A8AACAA68FFFFFFFFFFFFFFFF", 16);
+
+    public static boolean test() {
+        try {
+            return testDiffieHellman() && testRandom() && testMultiModPow() && testIllegal();
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    private static boolean testDiffieHellman() {
+        try (NativeBigInt p = NativeBigInt.valueOf(MODP_2048);
+             NativeBigInt g = NativeBigInt.valueOf(BigInteger.valueOf(2))) {
+            for (int i = 0; i < 4; i++) {
+                BigInteger a = new BigInteger(256, random);
+                BigInteger b = new BigInteger(256, random);
+                try (NativeBigInt x = NativeBigInt.valueOf(a);
+                     NativeBigInt y = NativeBigInt.valueOf(b);
+                     NativeBigInt publicA = g.modPow(x, p);
+                     NativeBigInt publicB = g.modPow(y, p);
+                     NativeBigInt secretA = publicB.modPow(x, p);
+                     NativeBigInt secretB = publicA.modPow(y, p)) {
+                    BigInteger expected = BigInteger.valueOf(2).modPow(a.multiply(b), MODP_2048);
+                    if (!publicA.toBigInteger().equals(BigInteger.valueOf(2).modPow(a, MODP_2048))
+                            || !secretA.toBigInteger().equals(expected)
+                            || !secretB.toBigInteger().equals(expected)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The odd moduli of any size, with the operands larger than the modulus.
+     */
+    private static boolean testRandom() {
+        int[] sizes = {33, 64, 65, 127, 255, 521, 1024, 1500, 2048, 3071, 3072, 4000, 4096};
+        for (int bits : sizes) {
+            BigInteger m = new BigInteger(bits, random).setBit(bits - 1).setBit(0);
+            BigInteger a = new BigInteger(Math.min(bits + 64, NativeBigInt.MAX_BITS), random);
+            BigInteger b = new BigInteger(bits, random);
+            BigInteger e = new BigInteger(random.nextInt(NativeBigInt.MAX_BITS) + 1, random);
+            try (NativeBigInt nm = NativeBigInt.valueOf(m);
+                 NativeBigInt na = NativeBigInt.valueOf(a);
+                 NativeBigInt nb = NativeBigInt.valueOf(b);
+                 NativeBigInt ne = NativeBigInt.valueOf(e);
+                 NativeBigInt pow = na.modPow(ne, nm);
+                 NativeBigInt product = na.modMultiply(nb, nm)) {
+                if (na.bitLength() != a.bitLength()
+                        || !pow.toBigInteger().equals(a.modPow(e, m))
+                        || !product.toBigInteger().equals(a.multiply(b).mod(m))) {
+                    Log.d(TAG, "modular arithmetic failed, bits: " + bits);
+                    return false;
+                }
+                if (a.gcd(m).equals(BigInteger.ONE)) {
+                    try (NativeBigInt inverse = na.modInverse(nm)) {
+                        if (!inverse.toBigInteger().equals(a.modInverse(m))) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * The products of 2 to 4 powers, with the exponents of the different sizes.
+     */
+    private static boolean testMultiModPow() {
+        int[] sizes = {64, 255, 1024, 2048, 3072};
+        for (int bits : sizes) {
+            BigInteger m = new BigInteger(bits, random).setBit(bits - 1).setBit(0);
+            int count = 2 + random.nextInt(NativeBigInt.MAX_MULTI_POW - 1);
+            NativeBigInt[] bases = new NativeBigInt[count];
+            NativeBigInt[] exponents = new NativeBigInt[count];
+            BigInteger expected = BigInteger.ONE;
+            try (NativeBigInt nm = NativeBigInt.valueOf(m)) {
+                for (int i = 0; i < count; i++) {
+                    BigInteger b = new BigInteger(bits + 8, random);
+                    BigInteger e = new BigInteger(i == 0 ? bits : 160, random);
+                    expected = expected.multiply(b.modPow(e, m)).mod(m);
+                    bases[i] = NativeBigInt.valueOf(b);
+                    exponents[i] = NativeBigInt.valueOf(e);
+                }
+                try (NativeBigInt product = NativeBigInt.multiModPow(bases, exponents, nm)) {
+                    if (!product.toBigInteger().equals(expected)) {
+                        Log.d(TAG, "multiModPow failed, bits: " + bits);
+                        return false;
+                    }
+                }
+            } finally {
+                for (int i = 0; i < count; i++) {
+                    if (bases[i] != null) {
+                        bases[i].close();
+                    }
+                    if (exponents[i] != null) {
+                        exponents[i].close();
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    private static boolean testIllegal() {
+        try (NativeBigInt three = NativeBigInt.valueOf(BigInteger.valueOf(3));
+             NativeBigInt m = NativeBigInt.valueOf(BigInteger.valueOf(3).pow(50))) {
+            three.modInverse(m);
+            return false;
+        } catch (IllegalArgumentException e) {
+            // 3 is not invertible mod 3^50.
+        }
+        try (NativeBigInt three = NativeBigInt.valueOf(BigInteger.valueOf(3));
+             NativeBigInt even = NativeBigInt.valueOf(BigInteger.ONE.shiftLeft(100))) {
+            three.modPow(three, even);
+            return false;
+        } catch (IllegalArgumentException e) {
+            // The even modulus.
+        }
+        try (NativeBigInt three = NativeBigInt.valueOf(BigInteger.valueOf(3));
+             NativeBigInt small = NativeBigInt.valueOf(BigInteger.valueOf(65537))) {
+            three.modPow(three, small);
+            return false;
+        } catch (IllegalArgumentException e) {
+            // The modulus of one word.
+        }
+        return true;
+    }
+}
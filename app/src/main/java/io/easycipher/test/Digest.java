@@ -7,4 +7,8 @@ public class Digest {
     public static byte[] sha256(byte[] msg) throws NoSuchAlgorithmException {
         return MessageDigest.getInstance("SHA-256").digest(msg);
     }
+
+    public static byte[] sha384(byte[] msg) throws NoSuchAlgorithmException {
+        return MessageDigest.getInstance("SHA-384").digest(msg);
+    }
 }
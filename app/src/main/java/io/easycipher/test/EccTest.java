@@ -4,13 +4,23 @@ import android.util.Log;
 
 import java.nio.charset.StandardCharsets;
 import java.util.Arrays;
+import java.util.BitSet;
+import java.util.HashSet;
+import java.util.Random;
+import java.util.Set;
 
 import io.easycipher.ECCKey;
+import io.easycipher.ECCKeyHandle;
+import io.easycipher.ECCSignPool;
 import io.easycipher.EasyECC;
 
 public class EccTest {
     private static final String TAG = "MyTag";
 
+    private static final int[] CURVES = {
+            EasyECC.SECP128R1, EasyECC.SECP192R1, EasyECC.SECP256R1, EasyECC.SECP384R1
+    };
+
     public static boolean test() {
         int n = 20;
         for (int i = 0; i < n; i++) {
@@ -18,7 +28,24 @@ public class EccTest {
                 return false;
             }
         }
-        return true;
+        for (int curve : CURVES) {
+            for (int i = 0; i < n; i++) {
+                if (!testOneTime(curve) || !testKeyHandle(curve, i % 2 == 0)) {
+                    return false;
+                }
+            }
+        }
+        for (int curve : CURVES) {
+            if (!testVerifyBatch(curve, 37, false) || !testVerifyBatch(curve, 100, true) || !testSignPool(curve)) {
+                return false;
+            }
+        }
+        for (int curve : CURVES) {
+            if (!testDeterministic(curve) || !testPointOffCurve(curve)) {
+                return false;
+            }
+        }
+        return testRfc6979() && testIllegalCurve();
     }
 
     private static boolean testOneTime() {
@@ -40,4 +67,212 @@ public class EccTest {
         }
         return false;
     }
+
+    private static boolean testOneTime(int curve) {
+        try {
+            ECCKey serverKey = EasyECC.generateKey(curve);
+            ECCKey clientKey = EasyECC.generateKey(curve);
+            byte[] s1 = EasyECC.getSecret(curve, serverKey.publicKey, clientKey.privateKey);
+            byte[] s2 = EasyECC.getSecret(curve, clientKey.publicKey, serverKey.privateKey);
+            boolean equal = serverKey.curve == curve && Arrays.equals(s1, s2);
+
+            byte[] bytes = "Hello World!".getBytes(StandardCharsets.UTF_8);
+            // The leftmost bytes of the hash for the small curves.
+            byte[] hash = curve == EasyECC.SECP384R1 ? Digest.sha384(bytes)
+                    : Arrays.copyOf(Digest.sha256(bytes), EasyECC.hashLength(curve));
+            byte[] signature = EasyECC.sign(curve, serverKey.privateKey, hash);
+            boolean success = EasyECC.verify(curve, serverKey.publicKey, hash, signature);
+            hash[0] ^= 1;
+            boolean tampered = EasyECC.verify(curve, serverKey.publicKey, hash, signature);
+            return equal && success && !tampered;
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    private static boolean testKeyHandle(int curve, boolean precompute) {
+        try {
+            ECCKey serverKey = EasyECC.generateKey(curve);
+            ECCKey clientKey = EasyECC.generateKey(curve);
+            byte[] hash = new byte[EasyECC.hashLength(curve)];
+            new Random().nextBytes(hash);
+            byte[] signature = EasyECC.sign(curve, serverKey.privateKey, hash);
+            byte[] s2 = EasyECC.getSecret(curve, clientKey.publicKey, serverKey.privateKey);
+            try (ECCKeyHandle key = ECCKeyHandle.create(curve, serverKey.publicKey, precompute)) {
+                byte[] s1 = EasyECC.getSecret(key, clientKey.privateKey);
+                boolean success = EasyECC.verify(key, hash, signature);
+                hash[0] ^= 1;
+                boolean tampered = EasyECC.verify(key, hash, signature);
+                return Arrays.equals(s1, s2) && success && !tampered;
+            }
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    /**
+     * Every third signature is tampered, the batch must match the single verify.
+     */
+    private static boolean testVerifyBatch(int curve, int count, boolean parallel) {
+        try {
+            Random random = new Random();
+            byte[][] publicKeys = new byte[count][];
+            byte[][] hashes = new byte[count][];
+            byte[][] signatures = new byte[count][];
+            for (int i = 0; i < count; i++) {
+                ECCKey key = EasyECC.generateKey(curve);
+                publicKeys[i] = key.publicKey;
+                hashes[i] = new byte[EasyECC.hashLength(curve)];
+                random.nextBytes(hashes[i]);
+                signatures[i] = EasyECC.sign(curve, key.privateKey, hashes[i]);
+                if (i % 3 == 1) {
+                    signatures[i][random.nextInt(signatures[i].length)] ^= 1;
+                }
+            }
+            BitSet valid = EasyECC.verifyBatch(curve, publicKeys, hashes, signatures, parallel);
+            for (int i = 0; i < count; i++) {
+                if (valid.get(i) != EasyECC.verify(curve, publicKeys[i], hashes[i], signatures[i])) {
+                    return false;
+                }
+            }
+            return true;
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    /**
+     * The pool is smaller than the signatures, so some of them make their own nonces.
+     * No nonce is used twice (no r repeated), and the counters add up.
+     */
+    private static boolean testSignPool(int curve) {
+        int count = 40;
+        try (ECCSignPool pool = ECCSignPool.create(curve, 8)) {
+            ECCKey key = EasyECC.generateKey(curve);
+            Set<String> rs = new HashSet<>();
+            byte[] hash = new byte[EasyECC.hashLength(curve)];
+            Random random = new Random();
+            for (int i = 0; i < count; i++) {
+                random.nextBytes(hash);
+                byte[] signature = EasyECC.sign(pool, key.privateKey, hash);
+                if (!EasyECC.verify(curve, key.publicKey, hash, signature)) {
+                    return false;
+                }
+                rs.add(Arrays.toString(Arrays.copyOf(signature, signature.length / 2)));
+            }
+            ECCSignPool.Stats stats = pool.getStats();
+            Log.d(TAG, "sign pool: " + stats);
+            return rs.size() == count && stats.consumed + stats.misses == count
+                    && stats.produced == stats.consumed + stats.available && stats.available <= stats.capacity
+                    && stats.failures == 0;
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    /**
+     * The same key and hash to the same signature, and it verifies.
+     */
+    private static boolean testDeterministic(int curve) {
+        try {
+            ECCKey key = EasyECC.generateKey(curve);
+            byte[] hash = new byte[EasyECC.hashLength(curve)];
+            new Random().nextBytes(hash);
+            byte[] s1 = EasyECC.signDeterministic(curve, key.privateKey, hash);
+            byte[] s2 = EasyECC.signDeterministic(curve, key.privateKey, hash);
+            return Arrays.equals(s1, s2) && EasyECC.verify(curve, key.publicKey, hash, s1);
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    /**
+     * RFC 6979 A.2.5, P-256 with SHA-256, the message "sample".
+     */
+    private static boolean testRfc6979() {
+        try {
+            byte[] privateKey = HexUtil.hex2Bytes("C9AFA9D845BA75166B5C215767B1D6934E50C3DB36E89B127B8A622B120F6721");
+            byte[] hash = Digest.sha256("sample".getBytes(StandardCharsets.UTF_8));
+            byte[] expected = HexUtil.hex2Bytes("EFD48B2AACB6A8FD1140DD9CD45E81D69D2C877B56AAF991C34D0EA84EAF3716"
+                    + "F7CB1C942D657C41D436C7A1B6E29F65F3E900DBB9AFF4064DC4AB2F843ACDA8");
+            return Arrays.equals(expected, EasyECC.signDeterministic(EasyECC.SECP256R1, privateKey, hash));
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    /**
+     * About half of the random x are not on the curve: the plain calls, the key handle and the batch
+     * must all reject the same keys.
+     */
+    private static boolean testPointOffCurve(int curve) {
+        try {
+            Random random = new Random();
+            ECCKey key = EasyECC.generateKey(curve);
+            byte[] hash = new byte[EasyECC.hashLength(curve)];
+            byte[] signature = EasyECC.sign(curve, key.privateKey, hash);
+            int offCurve = 0;
+            for (int i = 0; i < 32; i++) {
+                byte[] publicKey = new byte[EasyECC.publicKeyLength(curve)];
+                random.nextBytes(publicKey);
+                publicKey[0] = 2;
+                boolean valid;
+                try (ECCKeyHandle handle = ECCKeyHandle.create(curve, publicKey)) {
+                    valid = true;
+                } catch (IllegalArgumentException e) {
+                    valid = false;
+                }
+                if (valid == (EasyECC.getSecret(curve, publicKey, key.privateKey) == null)) {
+                    return false;
+                }
+                if (!valid) {
+                    offCurve++;
+                    BitSet result = EasyECC.verifyBatch(curve, new byte[][]{publicKey}, new byte[][]{hash},
+                            new byte[][]{signature}, false);
+                    if (EasyECC.verify(curve, publicKey, hash, signature) || result.get(0)) {
+                        return false;
+                    }
+                }
+            }
+            return offCurve > 0;
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
+
+    private static boolean testIllegalCurve() {
+        try {
+            EasyECC.generateKey(20);
+            return false;
+        } catch (IllegalArgumentException e) {
+            // expected
+        }
+        try {
+            // The compressed key has the prefix 2 or 3.
+            byte[] publicKey = EasyECC.generateKey(EasyECC.SECP256R1).publicKey;
+            publicKey[0] = 4;
+            ECCKeyHandle.create(EasyECC.SECP256R1, publicKey);
+            return false;
+        } catch (IllegalArgumentException e) {
+            // expected
+        }
+        try {
+            // The P-256 key on P-384.
+            ECCKey key = EasyECC.generateKey(EasyECC.SECP256R1);
+            EasyECC.sign(EasyECC.SECP384R1, key.privateKey, new byte[EasyECC.hashLength(EasyECC.SECP384R1)]);
+            return false;
+        } catch (IllegalArgumentException e) {
+            return true;
+        } catch (Exception e) {
+            Log.d(TAG, e.getMessage(), e);
+        }
+        return false;
+    }
 }
@@ -1,11 +1,26 @@
 package io.easycipher.test;
 
+import android.util.Base64;
 import android.util.Log;
 
+import java.math.BigInteger;
+import java.security.KeyPairGenerator;
+import java.security.interfaces.RSAPrivateCrtKey;
 import java.util.ArrayList;
+import java.util.Arrays;
 import java.util.Random;
 
+import javax.crypto.Cipher;
+
+import io.easycipher.ECCKey;
+import io.easycipher.ECCKeyHandle;
+import io.easycipher.ECCSignPool;
 import io.easycipher.EasyAES;
+import io.easycipher.EasyECC;
+import io.easycipher.EasyRSA;
+import io.easycipher.NativeBigInt;
+import io.easycipher.RSAKey;
+import io.easycipher.RSAKeyHandle;
 
 
 public class EfficiencyTest {
@@ -43,7 +58,325 @@ public class EfficiencyTest {
         Log.d("test", "AES Default: " + getTime(t3, t2));
     }
 
+    /**
+     * Throughput of 2048 bits public key decrypt (verify), e = 65537.
+     */
+    public static void compareRSAVerify() {
+        try {
+            RSATest.JdkKeyPair keys = RSATest.newJdkKeyPair();
+            RSAKey pubKey = keys.pubKey;
+
+            byte[] data = new byte[32];
+            new Random().nextBytes(data);
+            byte[] signature = EasyRSA.encrypt(data, keys.priKey);
+
+            Cipher cipher = Cipher.getInstance("RSA/ECB/PKCS1Padding");
+            cipher.init(Cipher.DECRYPT_MODE, keys.pair.getPublic());
+
+            int n = 2000;
+            long t1 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.decrypt(signature, pubKey);
+            }
+            long t2 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                cipher.doFinal(signature);
+            }
+            long t3 = System.nanoTime();
+            byte[][] signatures = new byte[n][];
+            Arrays.fill(signatures, signature);
+            byte[][] outputs = new byte[n][];
+            EasyRSA.decryptBatch(signatures, pubKey, false, outputs);
+            long t4 = System.nanoTime();
+            EasyRSA.decryptBatch(signatures, pubKey, true, outputs);
+            long t5 = System.nanoTime();
+
+            Log.d("test", "RSA 2048 verify EasyCipher: " + getOps(n, t2, t1) + " ops/s");
+            Log.d("test", "RSA 2048 verify Default: " + getOps(n, t3, t2) + " ops/s");
+            Log.d("test", "RSA 2048 verify EasyCipher batch: " + getOps(n, t4, t3) + " ops/s");
+            Log.d("test", "RSA 2048 verify EasyCipher batch (parallel): " + getOps(n, t5, t4) + " ops/s");
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    /**
+     * Throughput of 2048 bits private key sign: the private exponent, the CRT with 2 primes and 3 primes,
+     * and the CRT key parsed in native.
+     */
+    public static void compareRSASign() {
+        try {
+            int n = 200;
+            KeyPairGenerator generator = KeyPairGenerator.getInstance("RSA");
+            generator.initialize(2048);
+            RSAPrivateCrtKey jdkKey = (RSAPrivateCrtKey) generator.genKeyPair().getPrivate();
+            byte[] modulus = jdkKey.getModulus().toByteArray();
+            byte[] exponent = jdkKey.getPrivateExponent().toByteArray();
+            RSAKey expKey = new RSAKey(exponent, modulus, true);
+            RSAKey crtKey = new RSAKey(exponent, modulus, jdkKey.getPublicExponent().toByteArray(),
+                    new byte[][]{jdkKey.getPrimeP().toByteArray(), jdkKey.getPrimeQ().toByteArray()},
+                    new byte[][]{jdkKey.getPrimeExponentP().toByteArray(), jdkKey.getPrimeExponentQ().toByteArray()},
+                    new byte[][]{jdkKey.getCrtCoefficient().toByteArray(), null});
+            RSAKey multiPrimeKey = RSAKey.parseKey(Base64.decode(RSATest.MULTI_PRIME_KEY, Base64.DEFAULT), true);
+            RSAKeyHandle crtHandle = RSAKeyHandle.parse(jdkKey.getEncoded());
+
+            byte[] message = new byte[100];
+            new Random().nextBytes(message);
+            long t1 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.sign(message, expKey, EasyRSA.SIGN_PKCS1);
+            }
+            long t2 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.sign(message, crtKey, EasyRSA.SIGN_PKCS1);
+            }
+            long t3 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.sign(message, multiPrimeKey, EasyRSA.SIGN_PKCS1);
+            }
+            long t4 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.sign(message, crtHandle, EasyRSA.SIGN_PKCS1);
+            }
+            long t5 = System.nanoTime();
+            crtHandle.close();
+
+            Log.d("test", "RSA 2048 sign EasyCipher (exponent): " + getOps(n, t2, t1) + " ops/s");
+            Log.d("test", "RSA 2048 sign EasyCipher (CRT, 2 primes): " + getOps(n, t3, t2) + " ops/s");
+            Log.d("test", "RSA 2048 sign EasyCipher (CRT, 3 primes): " + getOps(n, t4, t3) + " ops/s");
+            Log.d("test", "RSA 2048 sign EasyCipher (CRT, key handle): " + getOps(n, t5, t4) + " ops/s");
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    /**
+     * Latency (p50/p99) of 3072 bits private key sign with the CRT, the primes in turn and concurrently.
+     */
+    public static void compareRSALatency() {
+        try {
+            int n = 200;
+            KeyPairGenerator generator = KeyPairGenerator.getInstance("RSA");
+            generator.initialize(3072);
+            RSAPrivateCrtKey jdkKey = (RSAPrivateCrtKey) generator.genKeyPair().getPrivate();
+            byte[][] primes = {jdkKey.getPrimeP().toByteArray(), jdkKey.getPrimeQ().toByteArray()};
+            byte[][] exponents = {jdkKey.getPrimeExponentP().toByteArray(), jdkKey.getPrimeExponentQ().toByteArray()};
+            byte[][] coefficients = {jdkKey.getCrtCoefficient().toByteArray(), null};
+            byte[] modulus = jdkKey.getModulus().toByteArray();
+            byte[] exponent = jdkKey.getPrivateExponent().toByteArray();
+            byte[] publicExponent = jdkKey.getPublicExponent().toByteArray();
+            RSAKey serialKey = new RSAKey(exponent, modulus, publicExponent, primes, exponents, coefficients);
+            RSAKey parallelKey = new RSAKey(exponent, modulus, publicExponent, primes, exponents, coefficients)
+                    .setParallelCrt(true);
+
+            byte[] message = new byte[100];
+            new Random().nextBytes(message);
+            long[] serial = new long[n];
+            long[] parallel = new long[n];
+            for (int i = 0; i < n; i++) {
+                long t1 = System.nanoTime();
+                EasyRSA.sign(message, serialKey, EasyRSA.SIGN_PKCS1);
+                long t2 = System.nanoTime();
+                EasyRSA.sign(message, parallelKey, EasyRSA.SIGN_PKCS1);
+                long t3 = System.nanoTime();
+                serial[i] = t2 - t1;
+                parallel[i] = t3 - t2;
+            }
+            Arrays.sort(serial);
+            Arrays.sort(parallel);
+
+            Log.d("test", "RSA 3072 sign EasyCipher (CRT): p50 " + getMicros(serial, 50) + " us, p99 "
+                    + getMicros(serial, 99) + " us");
+            Log.d("test", "RSA 3072 sign EasyCipher (CRT, parallel): p50 " + getMicros(parallel, 50) + " us, p99 "
+                    + getMicros(parallel, 99) + " us");
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    /**
+     * Time of 2048 bits key pair generation.
+     */
+    public static void compareRSAKeyGen() {
+        try {
+            int n = 10;
+            KeyPairGenerator generator = KeyPairGenerator.getInstance("RSA");
+            generator.initialize(2048);
+            int threads = Runtime.getRuntime().availableProcessors();
+
+            long t1 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.generateKeyPair(2048, 1);
+            }
+            long t2 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyRSA.generateKeyPair(2048, threads);
+            }
+            long t3 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                generator.genKeyPair();
+            }
+            long t4 = System.nanoTime();
+
+            Log.d("test", "RSA 2048 keygen EasyCipher: " + getTime(t2, t1) / n + " ms");
+            Log.d("test", "RSA 2048 keygen EasyCipher (" + threads + " threads): " + getTime(t3, t2) / n + " ms");
+            Log.d("test", "RSA 2048 keygen Default: " + getTime(t4, t3) / n + " ms");
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    /**
+     * Throughput of P-256 and P-384 key generation, ECDSA sign and verify.
+     */
+    public static void compareECC() {
+        compareECC(EasyECC.SECP256R1, "P-256");
+        compareECC(EasyECC.SECP384R1, "P-384");
+    }
+
+    private static void compareECC(int curve, String name) {
+        try {
+            int n = 200;
+            byte[] hash = new byte[EasyECC.hashLength(curve)];
+            new Random().nextBytes(hash);
+            ECCKey key = EasyECC.generateKey(curve);
+            byte[] signature = EasyECC.sign(curve, key.privateKey, hash);
+
+            long t1 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyECC.generateKey(curve);
+            }
+            long t2 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyECC.sign(curve, key.privateKey, hash);
+            }
+            long t3 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyECC.verify(curve, key.publicKey, hash, signature);
+            }
+            long t4 = System.nanoTime();
+            try (ECCKeyHandle handle = ECCKeyHandle.create(curve, key.publicKey)) {
+                for (int i = 0; i < n; i++) {
+                    EasyECC.verify(handle, hash, signature);
+                }
+            }
+            long t5 = System.nanoTime();
+
+            byte[][] publicKeys = new byte[n][];
+            byte[][] hashes = new byte[n][];
+            byte[][] signatures = new byte[n][];
+            Arrays.fill(publicKeys, key.publicKey);
+            Arrays.fill(hashes, hash);
+            Arrays.fill(signatures, signature);
+            long t6 = System.nanoTime();
+            EasyECC.verifyBatch(curve, publicKeys, hashes, signatures, false);
+            long t7 = System.nanoTime();
+            EasyECC.verifyBatch(curve, publicKeys, hashes, signatures, true);
+            long t8 = System.nanoTime();
+            for (int i = 0; i < n; i++) {
+                EasyECC.signDeterministic(curve, key.privateKey, hash);
+            }
+            long t11 = System.nanoTime();
+
+            // The online signing only, the pool is filled before the timing.
+            long t9;
+            long t10;
+            try (ECCSignPool pool = ECCSignPool.create(curve, n)) {
+                while (pool.getStats().available < n) {
+                    Thread.sleep(10);
+                }
+                t9 = System.nanoTime();
+                for (int i = 0; i < n; i++) {
+                    EasyECC.sign(pool, key.privateKey, hash);
+                }
+                t10 = System.nanoTime();
+            }
+
+            Log.d("test", "ECC " + name + " keygen EasyCipher: " + getOps(n, t2, t1) + " ops");
+            Log.d("test", "ECC " + name + " sign EasyCipher: " + getOps(n, t3, t2) + " ops");
+            Log.d("test", "ECC " + name + " sign deterministic EasyCipher: " + getOps(n, t11, t8) + " ops");
+            Log.d("test", "ECC " + name + " sign pool EasyCipher: " + getOps(n, t10, t9) + " ops");
+            Log.d("test", "ECC " + name + " verify EasyCipher: " + getOps(n, t4, t3) + " ops");
+            Log.d("test", "ECC " + name + " verify key handle EasyCipher: " + getOps(n, t5, t4) + " ops");
+            Log.d("test", "ECC " + name + " verify batch EasyCipher: " + getOps(n, t7, t6) + " ops");
+            Log.d("test", "ECC " + name + " verify batch parallel EasyCipher: " + getOps(n, t8, t7) + " ops");
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    /**
+     * Diffie-Hellman of the 2048-bit MODP group (RFC 3526): g^x mod p with 256 bits x, and the full size x,
+     * then the product of 2 powers with 256 bits exponents.
+     * x = 65537 takes the general modPow, compare it with the verify of compareRSAVerify (modPowSmall).
+     */
+    public static void compareModPow() {
+        try {
+            int n = 50;
+            BigInteger p = BigIntTest.MODP_2048;
+            BigInteger g = BigInteger.valueOf(2);
+            Random random = new Random();
+            BigInteger[] exponents = {new BigInteger(256, random), new BigInteger(2048, random),
+                    BigInteger.valueOf(65537)};
+            try (NativeBigInt np = NativeBigInt.valueOf(p); NativeBigInt ng = NativeBigInt.valueOf(g)) {
+                for (BigInteger x : exponents) {
+                    try (NativeBigInt nx = NativeBigInt.valueOf(x)) {
+                        long t1 = System.nanoTime();
+                        for (int i = 0; i < n; i++) {
+                            ng.modPow(nx, np).close();
+                        }
+                        long t2 = System.nanoTime();
+                        for (int i = 0; i < n; i++) {
+                            g.modPow(x, p);
+                        }
+                        long t3 = System.nanoTime();
+
+                        Log.d("test", "MODP 2048 modPow (" + x.bitLength() + " bits exponent) EasyCipher: "
+                                + getOps(n, t2, t1) + " ops");
+                        Log.d("test", "MODP 2048 modPow (" + x.bitLength() + " bits exponent) BigInteger: "
+                                + getOps(n, t3, t2) + " ops");
+                    }
+                }
+
+                // g^x * y^r, as the DSA-style verification
+                BigInteger y = g.modPow(exponents[1], p);
+                BigInteger r = new BigInteger(256, random);
+                try (NativeBigInt nx = NativeBigInt.valueOf(exponents[0]);
+                     NativeBigInt ny = NativeBigInt.valueOf(y);
+                     NativeBigInt nr = NativeBigInt.valueOf(r)) {
+                    NativeBigInt[] bases = {ng, ny};
+                    NativeBigInt[] powers = {nx, nr};
+                    long t1 = System.nanoTime();
+                    for (int i = 0; i < n; i++) {
+                        NativeBigInt.multiModPow(bases, powers, np).close();
+                    }
+                    long t2 = System.nanoTime();
+                    for (int i = 0; i < n; i++) {
+                        g.modPow(exponents[0], p).multiply(y.modPow(r, p)).mod(p);
+                    }
+                    long t3 = System.nanoTime();
+
+                    Log.d("test", "MODP 2048 g^x * y^r EasyCipher: " + getOps(n, t2, t1) + " ops");
+                    Log.d("test", "MODP 2048 g^x * y^r BigInteger: " + getOps(n, t3, t2) + " ops");
+                }
+            }
+        } catch (Exception e) {
+            Log.e("test", e.getMessage(), e);
+        }
+    }
+
+    private static long getOps(int n, long end, long start) {
+        return n * 1000000000L / (end - start);
+    }
+
     private static long getTime(long end, long start) {
         return (end - start) / 1000000L;
     }
+
+    /**
+     * The percentile of the sorted times in microseconds.
+     */
+    private static long getMicros(long[] sorted, int percentile) {
+        return sorted[sorted.length * percentile / 100] / 1000L;
+    }
 }
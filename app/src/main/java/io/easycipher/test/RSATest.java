@@ -1,5 +1,6 @@
 package io.easycipher.test;
 
+import java.io.ByteArrayOutputStream;
 import java.math.BigInteger;
 import java.nio.charset.StandardCharsets;
 import java.security.KeyFactory;
@@ -7,15 +8,20 @@ import java.security.KeyPair;
 import java.security.KeyPairGenerator;
 import java.security.PrivateKey;
 import java.security.PublicKey;
+import java.security.Signature;
+import java.security.spec.MGF1ParameterSpec;
 import java.security.spec.RSAPrivateKeySpec;
 import java.security.spec.RSAPublicKeySpec;
 import java.util.Arrays;
 import java.util.Random;
 
 import javax.crypto.Cipher;
+import javax.crypto.spec.OAEPParameterSpec;
+import javax.crypto.spec.PSource;
 
 import io.easycipher.EasyRSA;
 import io.easycipher.RSAKey;
+import io.easycipher.RSAKeyHandle;
 import io.rsautil.RSAUtil;
 
 import android.util.Base64;
@@ -24,6 +30,35 @@ public class RSATest {
     private static final String TAG = "MyTag";
     private static final Random random = RandomUtil.random;
 
+    // 2048 bits key with 3 primes, generate with openssl (-pkeyopt rsa_keygen_primes:3 -traditional),
+    // remove head, tail and "\n".
+    static final String MULTI_PRIME_KEY = "MIIE2QIBAQKCAQEA3ZM+Xh/2sFijIdsQa6FXw4cUzk+2glHIk8+QMvf+a1e0IGEd" +
+            "m0BWYLBMlf/GMY+IlgB2CL1weIdGmKtNxLSALZ/Cs5qBxieuo5eshpc+yKAgXa9p" +
+            "D39NNKTT83QnyCk445Uokb6liPDLlD7q3P0V43GDsFiCUz5Ernj9uf1lnvQXJRst" +
+            "Cbfqajy53A9JCPVV0mph/CGZT0L4+NUVIStMOG4iCrYpS/bvCnyernJtQvJupWrD" +
+            "gk2isjckMauEyagsFcY59zhqerksZMDt7v490fHkvZI0vdbXhnjFaA4zTeFNgKZO" +
+            "WJT8qU+Lpk9LOdtfbcKq+BWwfH2DBL090Fc4DwIDAQABAoIBAQDTsHp0iMsx3e01" +
+            "Skrc2Y+04diR53xx81rTRQn6eA5dVbRk/wO/MO+Vfroc0Pn0nbIbxaL/ZKYQsQVU" +
+            "lM0+8khHzovA9guoWn8yEpWlHNjB6qIhf5W653JA9w3doksNry0QZhJUS4h9siw0" +
+            "9EEXi7Jo4SHpLodjzvqwRzFfjJKQ/vB9DxdI741QRPaxioVf7YVqzLygxHQPIGGP" +
+            "KUeorsBNC46sqJDwB3zUmf9lhoGK1ddfAWwdYDc/zZMCi2yPTPzURHNdg0zKhhRa" +
+            "dYBaykp88q2uFt7XS5KELYsjLUk6/aKaPqQCXJ9y1pc1t5CyausRnY4gP/Rz4Ddo" +
+            "DrYJNX0BAlYH0tPQxkAHKFGsjowtCezAOHlIhS/kS84nqC+ALVQI1fiqY66eTtNZ" +
+            "646LyEOj62Z66czjfX6GhY8mwcPAQqaFvaTRxSPULZtVh/PTQjiLIphPmro42QJW" +
+            "ByunN+BCiKprgRK2WO8+Dh7x93XWQs/Y7XYqwcojSoRnxTiAjk3TgPTDZpyW0kvp" +
+            "BahVbNre8YCAIgBAhV1/YOC4DpT8P+DryMWUz7Dyf9rpIUi31rcCVgNdjgChR6nM" +
+            "jlXMfEBjpJSLtqCbqp5qfaRRlR1uYlfqs62Yc+Vlw0VLL2ayH2bEPLFjIeA6e9Mi" +
+            "YRIrCCoMgdXGXsBeLat4cvm4Igse0XQIzbxwsusBAlYECILbRBJIiwtDI8Jbjd5q" +
+            "1O8nUSm+lOig0OnF7Swimw0/esOcx5vjGknaqtOO4FHm88NxIj9quevYtCmWmnuu" +
+            "g1gkI5srVxlo6fIFTLNqRTkClsOJSwJWB6J0FQHl7XAoDktMM5wWlFPSKUhkOoGL" +
+            "Sz4bBeH7X/Hyla5zcd5VkHgLfYs9I2S7F6t10nBjjpu0oawdJo27tmh0xEfth3KY" +
+            "d9YDUwUuCiKyw72IVxEwggELMIIBBwJWA/MhLggoeOlBe3hY3IEaNEuhQUE1m/el" +
+            "tOQn64j5bTTQQc41OIlEGUMCo1O2TRD9N13CQOWp+BbK5wPD7Dz3zDRSLuYpzjyk" +
+            "MgstOZwQfw0TIAJvwxECVTS/52HfkqdAlktp/17w2geUCw522IMr7ur0NjJ4KL1X" +
+            "nAdA+YkXt2WqjpDAcvbO7wOCLdaNbnbp8PFeWEW5+7pDC1VQmwTI4B97JYVByw8I" +
+            "j2PxJrECVgJ+2CYmZh1mEd6rvuCplWHLHcx2pjjeUY75njIGrNpH2cCyiKyinPm+" +
+            "tUmK2yKMvHeC9su3e6RQQyDbuHxKLUt5OHGXIFw5FsLLI6SR2rV26VVWukEf";
+
     public static boolean testCrypt() throws Exception {
         byte[] src = "Hello World!".getBytes(StandardCharsets.UTF_8);
         // Log.i(TAG, "RSA 1024");
@@ -42,7 +77,182 @@ public class RSATest {
             return false;
         }
 
-        return randomTest() && testParseKey();
+        return randomTest() && testParseKey() && testMultiPrime() && testGenerateKey() && testSignature() && testOAEP() && testBlocks() && testBatch() && testKeyHandle();
+    }
+
+    /**
+     * The 2048 bits key pair of the JDK, and the same keys as {@link RSAKey}.
+     */
+    static final class JdkKeyPair {
+        final KeyPair pair;
+        final RSAKey priKey;
+        final RSAKey pubKey;
+
+        JdkKeyPair(KeyPair pair, RSAKey priKey, RSAKey pubKey) {
+            this.pair = pair;
+            this.priKey = priKey;
+            this.pubKey = pubKey;
+        }
+    }
+
+    static JdkKeyPair newJdkKeyPair() throws Exception {
+        KeyPairGenerator generator = KeyPairGenerator.getInstance("RSA");
+        generator.initialize(2048);
+        KeyPair pair = generator.genKeyPair();
+        BigInteger[] publicKey = RSAUtil.getPublicExpAndMod(pair.getPublic());
+        BigInteger[] privateKey = RSAUtil.getPrivateExpAndMod(pair.getPrivate());
+        byte[] m = privateKey[1].toByteArray();
+        RSAKey priKey = new RSAKey(privateKey[0].toByteArray(), m, true);
+        RSAKey pubKey = new RSAKey(publicKey[0].toByteArray(), m, false);
+        return new JdkKeyPair(pair, priKey, pubKey);
+    }
+
+    private static boolean testOAEP() throws Exception {
+        JdkKeyPair keys = newJdkKeyPair();
+
+        OAEPParameterSpec spec = new OAEPParameterSpec("SHA-256", "MGF1",
+                MGF1ParameterSpec.SHA256, PSource.PSpecified.DEFAULT);
+        Cipher cipher = Cipher.getInstance("RSA/ECB/OAEPWithSHA-256AndMGF1Padding");
+        int[] sizes = {0, 1, 100, 256 - 66};
+        for (int size : sizes) {
+            byte[] data = new byte[size];
+            random.nextBytes(data);
+
+            byte[] jniEncrypt = EasyRSA.encryptOAEP(data, keys.pubKey);
+            cipher.init(Cipher.DECRYPT_MODE, keys.pair.getPrivate(), spec);
+            if (!Arrays.equals(cipher.doFinal(jniEncrypt), data)) {
+                return false;
+            }
+
+            cipher.init(Cipher.ENCRYPT_MODE, keys.pair.getPublic(), spec);
+            byte[] jdkEncrypt = cipher.doFinal(data);
+            if (!Arrays.equals(EasyRSA.decryptOAEP(jdkEncrypt, keys.priKey), data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private static boolean testBlocks() throws Exception {
+        JdkKeyPair keys = newJdkKeyPair();
+
+        Cipher cipher = Cipher.getInstance("RSA/ECB/PKCS1Padding");
+        cipher.init(Cipher.DECRYPT_MODE, keys.pair.getPrivate());
+        int[] sizes = {0, 245, 246, 5000};
+        for (int size : sizes) {
+            byte[] data = new byte[size];
+            random.nextBytes(data);
+
+            // Each block is the same as the single block encryption, open them with JDK one by one.
+            byte[] encrypted = EasyRSA.encryptBlocks(data, keys.pubKey, false);
+            ByteArrayOutputStream out = new ByteArrayOutputStream();
+            for (int i = 0; i < encrypted.length; i += 256) {
+                out.write(cipher.doFinal(encrypted, i, 256));
+            }
+            if (!Arrays.equals(out.toByteArray(), data)
+                    || !Arrays.equals(EasyRSA.decryptBlocks(encrypted, keys.priKey, false), data)) {
+                return false;
+            }
+
+            encrypted = EasyRSA.encryptBlocks(data, keys.pubKey, true);
+            if (!Arrays.equals(EasyRSA.decryptBlocks(encrypted, keys.priKey, true), data)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private static boolean testBatch() throws Exception {
+        JdkKeyPair keys = newJdkKeyPair();
+
+        int n = 15;
+        byte[][] messages = new byte[n][];
+        byte[][] signatures = new byte[n][];
+        Signature signer = Signature.getInstance("SHA256withRSA");
+        signer.initSign(keys.pair.getPrivate());
+        for (int i = 0; i < n; i++) {
+            messages[i] = new byte[random.nextInt(100)];
+            random.nextBytes(messages[i]);
+            signer.update(messages[i]);
+            signatures[i] = signer.sign();
+        }
+        // Break one signature, the others must not be affected.
+        signatures[3][10] ^= 1;
+        for (boolean parallel : new boolean[]{false, true}) {
+            int[] status = EasyRSA.verifyBatch(messages, signatures, keys.pubKey, EasyRSA.SIGN_PKCS1, parallel);
+            for (int i = 0; i < n; i++) {
+                if (status[i] != (i == 3 ? EasyRSA.STATUS_INVALID_SIGNATURE : EasyRSA.STATUS_OK)) {
+                    return false;
+                }
+            }
+        }
+
+        // The message too large gets its status, the others are encrypted.
+        messages[5] = new byte[300];
+        byte[][] encrypted = new byte[n][];
+        byte[][] decrypted = new byte[n][];
+        int[] status = EasyRSA.encryptBatch(messages, keys.pubKey, true, encrypted);
+        if (status[5] != EasyRSA.STATUS_INPUT_TOO_LARGE || encrypted[5] != null) {
+            return false;
+        }
+        encrypted[5] = encrypted[4];
+        EasyRSA.decryptBatch(encrypted, keys.priKey, false, decrypted);
+        for (int i = 0; i < n; i++) {
+            if (i != 5 && !Arrays.equals(decrypted[i], messages[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private static boolean testSignature() throws Exception {
+        JdkKeyPair keys = newJdkKeyPair();
+
+        byte[] message = new byte[random.nextInt(1000)];
+        random.nextBytes(message);
+        String[] algorithms = {"SHA256withRSA", "SHA256withRSA/PSS"};
+        int[] paddings = {EasyRSA.SIGN_PKCS1, EasyRSA.SIGN_PSS};
+        for (int i = 0; i < paddings.length; i++) {
+            Signature jdk = Signature.getInstance(algorithms[i]);
+            jdk.initSign(keys.pair.getPrivate());
+            jdk.update(message);
+            byte[] jdkSignature = jdk.sign();
+            byte[] jniSignature = EasyRSA.sign(message, keys.priKey, paddings[i]);
+
+            jdk.initVerify(keys.pair.getPublic());
+            jdk.update(message);
+            if (!jdk.verify(jniSignature) || !EasyRSA.verify(message, jdkSignature, keys.pubKey, paddings[i])) {
+                return false;
+            }
+            // PKCS#1 v1.5 is deterministic
+            if (paddings[i] == EasyRSA.SIGN_PKCS1 && !Arrays.equals(jdkSignature, jniSignature)) {
+                return false;
+            }
+            jniSignature[jniSignature.length - 1] ^= 1;
+            if (EasyRSA.verify(message, jniSignature, keys.pubKey, paddings[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    private static boolean testGenerateKey() throws Exception {
+        int[] sizes = {1024, 2048};
+        for (int bits : sizes) {
+            byte[][] pair = EasyRSA.generateKeyPair(bits, 2);
+            RSAKey priKey = RSAKey.parseKey(pair[0], true);
+            RSAKey pubKey = RSAKey.parseKey(pair[1], false);
+            BigInteger modulus = new BigInteger(1, pubKey.modulus);
+            if (modulus.bitLength() != bits || !Arrays.equals(priKey.modulus, pubKey.modulus)) {
+                return false;
+            }
+            byte[] bytes = new byte[random.nextInt(bits / 8 - 11)];
+            random.nextBytes(bytes);
+            if (!test(bytes, modulus, new BigInteger(1, priKey.exponent), new BigInteger(1, pubKey.exponent))) {
+                return false;
+            }
+        }
+        return true;
     }
 
     private static boolean testParseKey() {
@@ -95,6 +305,111 @@ public class RSATest {
     }
 
 
+    private static boolean testMultiPrime() throws Exception {
+        RSAKey priKey = RSAKey.parseKey(Base64.decode(MULTI_PRIME_KEY, Base64.DEFAULT), true);
+        if (priKey.primes == null || priKey.primes.length != 3) {
+            return false;
+        }
+        // The same key without the CRT params, crypts with the private exponent.
+        RSAKey expKey = new RSAKey(priKey.exponent, priKey.modulus, true);
+        // The primes run concurrently on the native worker threads.
+        RSAKey parallelKey = RSAKey.parseKey(Base64.decode(MULTI_PRIME_KEY, Base64.DEFAULT), true)
+                .setParallelCrt(true);
+        BigInteger modulus = new BigInteger(1, priKey.modulus);
+        BigInteger publicExponent = BigInteger.valueOf(65537);
+        RSAKey pubKey = new RSAKey(publicExponent.toByteArray(), priKey.modulus, false);
+
+        KeyFactory factory = KeyFactory.getInstance("RSA");
+        PublicKey jdkPublic = factory.generatePublic(new RSAPublicKeySpec(modulus, publicExponent));
+        for (int i = 0; i < 8; i++) {
+            byte[] message = new byte[random.nextInt(1000)];
+            random.nextBytes(message);
+            byte[] signature = EasyRSA.sign(message, priKey, EasyRSA.SIGN_PKCS1);
+            if (!Arrays.equals(signature, EasyRSA.sign(message, expKey, EasyRSA.SIGN_PKCS1))
+                    || !Arrays.equals(signature, EasyRSA.sign(message, parallelKey, EasyRSA.SIGN_PKCS1))) {
+                return false;
+            }
+            Signature jdk = Signature.getInstance("SHA256withRSA");
+            jdk.initVerify(jdkPublic);
+            jdk.update(message);
+            if (!jdk.verify(signature)) {
+                return false;
+            }
+
+            byte[] bytes = new byte[random.nextInt(256 - 11)];
+            random.nextBytes(bytes);
+            byte[] encrypted = EasyRSA.encrypt(bytes, pubKey);
+            if (!Arrays.equals(bytes, EasyRSA.decrypt(encrypted, priKey))
+                    || !Arrays.equals(bytes, EasyRSA.decrypt(encrypted, parallelKey))) {
+                return false;
+            }
+        }
+
+        // A wrong result of one prime (as a fault would give) is caught by the check with e, not returned.
+        byte[][] badExponents = priKey.crtExponents.clone();
+        badExponents[2] = new BigInteger(1, badExponents[2]).add(BigInteger.valueOf(2)).toByteArray();
+        RSAKey badKey = new RSAKey(priKey.exponent, priKey.modulus, priKey.publicExponent, priKey.primes,
+                badExponents, priKey.crtCoefficients);
+        try {
+            EasyRSA.sign(new byte[16], badKey, EasyRSA.SIGN_PKCS1);
+            return false;
+        } catch (IllegalArgumentException e) {
+            return true;
+        }
+    }
+
+    private static boolean testKeyHandle() throws Exception {
+        KeyPairGenerator generator = KeyPairGenerator.getInstance("RSA");
+        generator.initialize(2048);
+        KeyPair pair = generator.genKeyPair();
+        // PKCS#8 in DER, and SubjectPublicKeyInfo in PEM.
+        String pem = "-----BEGIN PUBLIC KEY-----\n"
+                + Base64.encodeToString(pair.getPublic().getEncoded(), Base64.DEFAULT)
+                + "-----END PUBLIC KEY-----\n";
+        OAEPParameterSpec spec = new OAEPParameterSpec("SHA-256", "MGF1",
+                MGF1ParameterSpec.SHA256, PSource.PSpecified.DEFAULT);
+        try (RSAKeyHandle priKey = RSAKeyHandle.parse(pair.getPrivate().getEncoded());
+             RSAKeyHandle pubKey = RSAKeyHandle.parse(pem);
+             RSAKeyHandle multiPrimeKey = RSAKeyHandle.parse(Base64.decode(MULTI_PRIME_KEY, Base64.DEFAULT), true)) {
+            if (!priKey.isPrivate || pubKey.isPrivate || priKey.bits != 2048 || multiPrimeKey.bits != 2048) {
+                return false;
+            }
+            RSAKey multiPrime = RSAKey.parseKey(Base64.decode(MULTI_PRIME_KEY, Base64.DEFAULT), true);
+            for (int i = 0; i < 4; i++) {
+                byte[] message = new byte[random.nextInt(1000)];
+                random.nextBytes(message);
+                Signature jdk = Signature.getInstance("SHA256withRSA");
+                jdk.initSign(pair.getPrivate());
+                jdk.update(message);
+                byte[] signature = EasyRSA.sign(message, priKey, EasyRSA.SIGN_PKCS1);
+                if (!Arrays.equals(signature, jdk.sign())
+                        || !EasyRSA.verify(message, signature, pubKey, EasyRSA.SIGN_PKCS1)
+                        || !EasyRSA.verify(message, EasyRSA.sign(message, priKey, EasyRSA.SIGN_PSS), pubKey,
+                        EasyRSA.SIGN_PSS)) {
+                    return false;
+                }
+                if (!Arrays.equals(EasyRSA.sign(message, multiPrimeKey, EasyRSA.SIGN_PKCS1),
+                        EasyRSA.sign(message, multiPrime, EasyRSA.SIGN_PKCS1))) {
+                    return false;
+                }
+
+                byte[] data = new byte[random.nextInt(256 - 66)];
+                random.nextBytes(data);
+                Cipher cipher = Cipher.getInstance("RSA/ECB/PKCS1Padding");
+                cipher.init(Cipher.DECRYPT_MODE, pair.getPrivate());
+                if (!Arrays.equals(cipher.doFinal(EasyRSA.encrypt(data, pubKey, false)), data)) {
+                    return false;
+                }
+                cipher = Cipher.getInstance("RSA/ECB/OAEPWithSHA-256AndMGF1Padding");
+                cipher.init(Cipher.ENCRYPT_MODE, pair.getPublic(), spec);
+                if (!Arrays.equals(EasyRSA.decrypt(cipher.doFinal(data), priKey, true), data)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
     private static boolean testStatic(byte[] src, String mod, String pri, String pub) throws Exception {
         BigInteger modulus = new BigInteger(HexUtil.hex2Bytes(mod));
         BigInteger privateExponent = new BigInteger(HexUtil.hex2Bytes(pri));
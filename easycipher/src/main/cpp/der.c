@@ -0,0 +1,173 @@
+#include "der.h"
+
+#include <string.h>
+
+static const char PEM_BEGIN[] = "-----BEGIN ";
+static const char PEM_END[] = "-----END ";
+static const char PEM_DASHES[] = "-----";
+
+int der_read(ByteArray *in, uint8_t tag, ByteArray *content) {
+    const uint8_t *p = in->value;
+    int len = in->len;
+    if (len < 2 || p[0] != tag) {
+        return 0;
+    }
+    int n = p[1];
+    int offset = 2;
+    if (n & 0x80) {
+        // 0x80 is the indefinite length (BER only), 3 bytes of length cover any key we take.
+        int lenOfLen = n & 0x7f;
+        if (lenOfLen == 0 || lenOfLen > 3 || len < offset + lenOfLen) {
+            return 0;
+        }
+        n = 0;
+        for (int i = 0; i < lenOfLen; i++) {
+            n = (n << 8) | p[offset++];
+        }
+    }
+    if (n > len - offset) {
+        return 0;
+    }
+    content->value = in->value + offset;
+    content->len = n;
+    in->value += offset + n;
+    in->len -= offset + n;
+    return 1;
+}
+
+int der_peek(const ByteArray *in) {
+    return in->len > 0 ? in->value[0] : -1;
+}
+
+static int isSpace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static int skipSpaces(const ByteArray *input, int i) {
+    while (i < input->len && isSpace(input->value[i])) {
+        i++;
+    }
+    return i;
+}
+
+static int startsWith(const ByteArray *input, int i, const char *prefix) {
+    int n = (int) strlen(prefix);
+    return input->len - i >= n && memcmp(input->value + i, prefix, n) == 0;
+}
+
+/**
+ * The 6 bits of the base64 char, -1 for the others.
+ */
+static int base64Value(uint8_t c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    } else if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    } else if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    } else if (c == '+') {
+        return 62;
+    } else if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+int pem_is(const ByteArray *input) {
+    return input != NULL && startsWith(input, skipSpaces(input, 0), PEM_BEGIN);
+}
+
+/**
+ * Read the label of the line "-----BEGIN label-----" or "-----END label-----" from i (after the prefix),
+ * returns the index after the line, or -1.
+ */
+static int readLabel(const ByteArray *input, int i, ByteArray *label) {
+    int from = i;
+    while (i < input->len && input->value[i] != '-' && input->value[i] != '\n') {
+        i++;
+    }
+    if (!startsWith(input, i, PEM_DASHES)) {
+        return -1;
+    }
+    label->value = input->value + from;
+    label->len = i - from;
+    i += (int) strlen(PEM_DASHES);
+    while (i < input->len && input->value[i] != '\n') {
+        if (!isSpace(input->value[i])) {
+            return -1;
+        }
+        i++;
+    }
+    return i;
+}
+
+int pem_decode(const ByteArray *input, ByteArray *label, ByteArray *der) {
+    if (!pem_is(input)) {
+        return 0;
+    }
+    int i = skipSpaces(input, 0) + (int) strlen(PEM_BEGIN);
+    i = readLabel(input, i, label);
+    if (i < 0) {
+        return 0;
+    }
+
+    uint8_t *out = der->value;
+    int outLen = 0;
+    uint32_t bits = 0;
+    int count = 0;
+    int padding = 0;
+    for (;;) {
+        if (i >= input->len) {
+            return 0;
+        }
+        uint8_t c = input->value[i];
+        if (c == '-') {
+            break;
+        }
+        i++;
+        if (isSpace(c)) {
+            continue;
+        }
+        if (c == '=') {
+            // Only the last quantum has the padding, 1 or 2 chars.
+            if (count < 2 || ++padding > 2) {
+                return 0;
+            }
+            continue;
+        }
+        int v = base64Value(c);
+        // The char after the padding, or a header line (Proc-Type: ...).
+        if (v < 0 || padding > 0) {
+            return 0;
+        }
+        bits = (bits << 6) | v;
+        if (++count == 4) {
+            out[outLen++] = bits >> 16;
+            out[outLen++] = bits >> 8;
+            out[outLen++] = bits;
+            bits = 0;
+            count = 0;
+        }
+    }
+    if (padding > 0) {
+        if (count + padding != 4) {
+            return 0;
+        }
+        if (count == 2) {
+            out[outLen++] = bits >> 4;
+        } else {
+            out[outLen++] = bits >> 10;
+            out[outLen++] = bits >> 2;
+        }
+    } else if (count != 0) {
+        return 0;
+    }
+
+    ByteArray endLabel;
+    if (!startsWith(input, i, PEM_END) || readLabel(input, i + (int) strlen(PEM_END), &endLabel) < 0 ||
+        endLabel.len != label->len || memcmp(endLabel.value, label->value, label->len) != 0) {
+        return 0;
+    }
+    der->len = outLen;
+    return 1;
+}
@@ -0,0 +1,49 @@
+
+#ifndef EASY_CIPHER_DER_H
+#define EASY_CIPHER_DER_H
+
+#include <stdint.h>
+#include "array.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DER_INTEGER 0x02
+#define DER_BIT_STRING 0x03
+#define DER_OCTET_STRING 0x04
+#define DER_NULL 0x05
+#define DER_OID 0x06
+#define DER_SEQUENCE 0x30
+
+/**
+ * Read the element with the tag at the head of in: content gets its content (pointing into in),
+ * in moves past the element. Returns 0 if the head is not a definite-length element with the tag,
+ * in is not moved then.
+ */
+int der_read(ByteArray *in, uint8_t tag, ByteArray *content);
+
+/**
+ * @return The tag at the head of in, -1 for the empty in.
+ */
+int der_peek(const ByteArray *in);
+
+/**
+ * @return Non-zero if the input is PEM, begins with "-----BEGIN " (after the leading whitespaces).
+ */
+int pem_is(const ByteArray *input);
+
+/**
+ * Decode the first PEM block of the input: label gets the text between "-----BEGIN " and "-----"
+ * (pointing into the input), der gets the base64 decoded body, der->value takes input->len * 3 / 4 bytes at most.
+ * The block with the headers (Proc-Type ... of the encrypted PEM) is rejected.
+ *
+ * @return 0 for the malformed PEM.
+ */
+int pem_decode(const ByteArray *input, ByteArray *label, ByteArray *der);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EASY_CIPHER_DER_H
@@ -1,5 +1,6 @@
 #include <jni.h>
 #include <cstdlib>
+#include <cstring>
 
 #include "aes_cbc.h"
 #include "sha256.h"
@@ -167,15 +168,91 @@ Java_io_easycipher_EasySHA_hmacSHA256(JNIEnv *env, jclass clazz, jbyteArray inpu
 }
 
 
-extern "C"
-JNIEXPORT jbyteArray JNICALL
-Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
-                                 jclass clazz,
-                                 jbyteArray input,
-                                 jbyteArray exponent,
-                                 jbyteArray modulus,
-                                 jboolean isPrivate,
-                                 jboolean isEncrypt) {
+/**
+ * Copy the byte arrays into one buffer, the items point into it.
+ * Returns the buffer (free by the caller), or nullptr with the exception thrown.
+ */
+static uint8_t *copyByteArrays(JNIEnv *env, jobjectArray arrays, int count, ByteArray *items) {
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        auto item = (jbyteArray) env->GetObjectArrayElement(arrays, i);
+        if (item == nullptr) {
+            throwIllegalArgumentException(env, "items can't be null");
+            return nullptr;
+        }
+        items[i].len = env->GetArrayLength(item);
+        total += items[i].len;
+        env->DeleteLocalRef(item);
+    }
+    auto buffer = (uint8_t *) malloc(total > 0 ? total : 1);
+    if (buffer == nullptr) {
+        throwIllegalStateException(env, "out of memory");
+        return nullptr;
+    }
+    uint8_t *p = buffer;
+    for (int i = 0; i < count; i++) {
+        auto item = (jbyteArray) env->GetObjectArrayElement(arrays, i);
+        env->GetByteArrayRegion(item, 0, items[i].len, (jbyte *) p);
+        env->DeleteLocalRef(item);
+        items[i].value = p;
+        p += items[i].len;
+    }
+    return buffer;
+}
+
+/**
+ * The CRT params of the private key, copied from the Java arrays.
+ */
+struct CrtParams {
+    RSACrtParams params;
+    ByteArray items[RSA_MAX_PRIMES * 3 + 1];
+    uint8_t *buffer;
+};
+
+/**
+ * Copy the CRT params (the primes, the exponents, the coefficients, then the public exponent,
+ * see RSAKey.crtParams) for key.crt and key.publicExponent, nothing for the null crt,
+ * parallel is the flag of RSAKey.setParallelCrt.
+ * Returns false with the exception thrown, free crt->buffer after the crypt.
+ */
+static bool loadCrtParams(JNIEnv *env, jobjectArray array, jboolean parallel, CrtParams *crt, RSAKey *key) {
+    crt->buffer = nullptr;
+    key->crt = nullptr;
+    key->publicExponent = nullptr;
+    if (array == nullptr) {
+        return true;
+    }
+    int total = env->GetArrayLength(array);
+    int count = (total - 1) / 3;
+    if (total % 3 != 1 || count < 2 || count > RSA_MAX_PRIMES) {
+        throwIllegalArgumentException(env, "invalid key");
+        return false;
+    }
+    crt->buffer = copyByteArrays(env, array, total, crt->items);
+    if (crt->buffer == nullptr) {
+        return false;
+    }
+    crt->params.count = count;
+    crt->params.parallel = parallel ? 1 : 0;
+    for (int i = 0; i < count; i++) {
+        crt->params.primes[i] = &crt->items[i];
+        crt->params.exponents[i] = &crt->items[count + i];
+        crt->params.coefficients[i] = &crt->items[count * 2 + i];
+    }
+    key->crt = &crt->params;
+    key->publicExponent = &crt->items[count * 3];
+    return true;
+}
+
+static jbyteArray rsaCrypt(JNIEnv *env,
+                           jbyteArray input,
+                           jbyteArray exponent,
+                           jbyteArray modulus,
+                           jobjectArray crt,
+                           jboolean parallelCrt,
+                           jboolean isPrivate,
+                           CipherMode mode,
+                           bool blocks) {
     if (input == nullptr || exponent == nullptr || modulus == nullptr) {
         throwIllegalArgumentException(env, "params can't be null");
         return nullptr;
@@ -190,7 +267,8 @@ Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
         return nullptr;
     }
 
-    if (inputLen == 0) {
+    // OAEP (and the blocks) encrypts the empty input to a block.
+    if (inputLen == 0 && mode != OAEP_ENCRYPT && !(blocks && mode == ENCRYPT)) {
         return input;
     }
 
@@ -210,17 +288,30 @@ Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
     mod.value = (uint8_t *) p_mod;
     mod.len = modLen;
 
-    uint8_t buffer[256];
-    out.value = buffer;
-    out.len = 0;
-
     RSAKey key;
     key.exponent = &exp;
     key.modulus = &mod;
     key.key_type = isPrivate ? PRIVATE_KEY : PUBLIC_KEY;
-    CipherMode mode = isEncrypt ? ENCRYPT : DECRYPT;
+    CrtParams crtParams;
+    if (!loadCrtParams(env, crt, parallelCrt, &crtParams, &key)) {
+        env->ReleaseByteArrayElements(input, p_input, JNI_ABORT);
+        env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+        env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+        return nullptr;
+    }
 
-    int ret = rsa_crypt(&in, &key, mode, &out);
+    uint8_t buffer[RSA_MAX_BLOCK_SIZE];
+    out.value = buffer;
+    out.len = 0;
+    int ret;
+    if (blocks) {
+        int outputSize = rsa_crypt_blocks_size(inputLen, &key, mode);
+        out.value = (uint8_t *) malloc(outputSize > 0 ? outputSize : 1);
+        ret = out.value == nullptr ? FAILED_OUT_OF_MEMORY : rsa_crypt_blocks(&in, &key, mode, &out);
+    } else {
+        ret = rsa_crypt(&in, &key, mode, &out);
+    }
+    free(crtParams.buffer);
 
     env->ReleaseByteArrayElements(input, p_input, 0);
     env->ReleaseByteArrayElements(exponent, p_exp, 0);
@@ -230,8 +321,14 @@ Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
         jsize len = out.len;
         jbyteArray result = env->NewByteArray(len);
         env->SetByteArrayRegion(result, 0, len, (jbyte *) out.value);
+        if (blocks) {
+            free(out.value);
+        }
         return result;
     } else {
+        if (blocks) {
+            free(out.value);
+        }
         if (ret == FAILED_INVALID_KEY) {
             throwIllegalArgumentException(env, "invalid key");
         } else if (ret == FAILED_INPUT_TOO_LARGE) {
@@ -247,15 +344,718 @@ Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
     }
 }
 
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_crypt(JNIEnv *env,
+                                 jclass clazz,
+                                 jbyteArray input,
+                                 jbyteArray exponent,
+                                 jbyteArray modulus,
+                                 jobjectArray crt,
+                                 jboolean parallelCrt,
+                                 jboolean isPrivate,
+                                 jboolean isEncrypt) {
+    return rsaCrypt(env, input, exponent, modulus, crt, parallelCrt, isPrivate, isEncrypt ? ENCRYPT : DECRYPT, false);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_cryptOAEP(JNIEnv *env,
+                                     jclass clazz,
+                                     jbyteArray input,
+                                     jbyteArray exponent,
+                                     jbyteArray modulus,
+                                     jobjectArray crt,
+                                     jboolean parallelCrt,
+                                     jboolean isPrivate,
+                                     jboolean isEncrypt) {
+    return rsaCrypt(env, input, exponent, modulus, crt, parallelCrt, isPrivate,
+                    isEncrypt ? OAEP_ENCRYPT : OAEP_DECRYPT, false);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_cryptBlocks(JNIEnv *env,
+                                       jclass clazz,
+                                       jbyteArray input,
+                                       jbyteArray exponent,
+                                       jbyteArray modulus,
+                                       jobjectArray crt,
+                                       jboolean parallelCrt,
+                                       jboolean isPrivate,
+                                       jboolean isEncrypt,
+                                       jboolean isOAEP) {
+    CipherMode mode = isOAEP ? (isEncrypt ? OAEP_ENCRYPT : OAEP_DECRYPT) : (isEncrypt ? ENCRYPT : DECRYPT);
+    return rsaCrypt(env, input, exponent, modulus, crt, parallelCrt, isPrivate, mode, true);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_signMessage(JNIEnv *env,
+                                       jclass clazz,
+                                       jbyteArray message,
+                                       jbyteArray exponent,
+                                       jbyteArray modulus,
+                                       jobjectArray crt,
+                                       jboolean parallelCrt,
+                                       jint padding) {
+    if (message == nullptr || exponent == nullptr || modulus == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+
+    jbyte *p_message = env->GetByteArrayElements(message, JNI_FALSE);
+    jbyte *p_exp = env->GetByteArrayElements(exponent, JNI_FALSE);
+    jbyte *p_mod = env->GetByteArrayElements(modulus, JNI_FALSE);
+    if (p_message == nullptr || p_exp == nullptr || p_mod == nullptr) {
+        throwIllegalArgumentException(env, "Get params failed");
+        return nullptr;
+    }
+
+    ByteArray in, exp, mod, out;
+    in.value = (uint8_t *) p_message;
+    in.len = env->GetArrayLength(message);
+    exp.value = (uint8_t *) p_exp;
+    exp.len = env->GetArrayLength(exponent);
+    mod.value = (uint8_t *) p_mod;
+    mod.len = env->GetArrayLength(modulus);
+
+    uint8_t buffer[RSA_MAX_BLOCK_SIZE];
+    out.value = buffer;
+    out.len = 0;
+
+    RSAKey key;
+    key.exponent = &exp;
+    key.modulus = &mod;
+    key.key_type = PRIVATE_KEY;
+    CrtParams crtParams;
+    int ret = FAILED_UNKNOWN;
+    bool loaded = loadCrtParams(env, crt, parallelCrt, &crtParams, &key);
+    if (loaded) {
+        ret = rsa_sign(&in, &key, (SignPadding) padding, &out);
+        free(crtParams.buffer);
+    }
+
+    env->ReleaseByteArrayElements(message, p_message, JNI_ABORT);
+    env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+    env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+
+    if (!loaded) {
+        return nullptr;
+    }
+    if (ret != CRYPT_SUCCESS) {
+        if (ret == FAILED_INVALID_KEY) {
+            throwIllegalArgumentException(env, "invalid key");
+        } else if (ret == FAILED_INVALID_INPUT) {
+            throwIllegalArgumentException(env, "invalid input");
+        } else if (ret == FAILED_OUT_OF_MEMORY) {
+            throwIllegalStateException(env, "out of memory");
+        } else {
+            throwIllegalStateException(env, "sign failed");
+        }
+        return nullptr;
+    }
+    jbyteArray result = env->NewByteArray(out.len);
+    env->SetByteArrayRegion(result, 0, out.len, (jbyte *) out.value);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_easycipher_EasyRSA_verifyMessage(JNIEnv *env,
+                                         jclass clazz,
+                                         jbyteArray message,
+                                         jbyteArray signature,
+                                         jbyteArray exponent,
+                                         jbyteArray modulus,
+                                         jint padding) {
+    if (message == nullptr || signature == nullptr || exponent == nullptr || modulus == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return JNI_FALSE;
+    }
+
+    jbyte *p_message = env->GetByteArrayElements(message, JNI_FALSE);
+    jbyte *p_signature = env->GetByteArrayElements(signature, JNI_FALSE);
+    jbyte *p_exp = env->GetByteArrayElements(exponent, JNI_FALSE);
+    jbyte *p_mod = env->GetByteArrayElements(modulus, JNI_FALSE);
+    if (p_message == nullptr || p_signature == nullptr || p_exp == nullptr || p_mod == nullptr) {
+        throwIllegalArgumentException(env, "Get params failed");
+        return JNI_FALSE;
+    }
+
+    ByteArray in, sig, exp, mod;
+    in.value = (uint8_t *) p_message;
+    in.len = env->GetArrayLength(message);
+    sig.value = (uint8_t *) p_signature;
+    sig.len = env->GetArrayLength(signature);
+    exp.value = (uint8_t *) p_exp;
+    exp.len = env->GetArrayLength(exponent);
+    mod.value = (uint8_t *) p_mod;
+    mod.len = env->GetArrayLength(modulus);
+
+    RSAKey key;
+    key.exponent = &exp;
+    key.modulus = &mod;
+    key.key_type = PUBLIC_KEY;
+    key.crt = nullptr;
+    key.publicExponent = nullptr;
+
+    int ret = rsa_verify(&in, &sig, &key, (SignPadding) padding);
+
+    env->ReleaseByteArrayElements(message, p_message, JNI_ABORT);
+    env->ReleaseByteArrayElements(signature, p_signature, JNI_ABORT);
+    env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+    env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+
+    if (ret == CRYPT_SUCCESS) {
+        return JNI_TRUE;
+    } else if (ret == FAILED_INVALID_SIGNATURE) {
+        return JNI_FALSE;
+    } else if (ret == FAILED_INVALID_KEY) {
+        throwIllegalArgumentException(env, "invalid key");
+    } else if (ret == FAILED_INVALID_INPUT) {
+        throwIllegalArgumentException(env, "invalid input");
+    } else if (ret == FAILED_OUT_OF_MEMORY) {
+        throwIllegalStateException(env, "out of memory");
+    } else {
+        throwIllegalStateException(env, "verify failed");
+    }
+    return JNI_FALSE;
+}
+
+/**
+ * The statuses of the batch, or nullptr with the exception thrown if the batch failed.
+ */
+static jintArray batchStatus(JNIEnv *env, int ret, const CryptResult *results, int count) {
+    if (ret == CRYPT_SUCCESS) {
+        jintArray status = env->NewIntArray(count);
+        if (status != nullptr && count > 0) {
+            env->SetIntArrayRegion(status, 0, count, (const jint *) results);
+        }
+        return status;
+    }
+    if (ret == FAILED_INVALID_KEY) {
+        throwIllegalArgumentException(env, "invalid key");
+    } else if (ret == FAILED_INVALID_INPUT) {
+        throwIllegalArgumentException(env, "invalid input");
+    } else if (ret == FAILED_OUT_OF_MEMORY) {
+        throwIllegalStateException(env, "out of memory");
+    } else {
+        throwIllegalStateException(env, "batch failed");
+    }
+    return nullptr;
+}
+
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_io_easycipher_EasyRSA_cryptBatch(JNIEnv *env,
+                                      jclass clazz,
+                                      jobjectArray inputs,
+                                      jbyteArray exponent,
+                                      jbyteArray modulus,
+                                      jobjectArray crt,
+                                      jboolean parallelCrt,
+                                      jboolean isPrivate,
+                                      jboolean isEncrypt,
+                                      jboolean parallel,
+                                      jobjectArray outputs) {
+    if (inputs == nullptr || exponent == nullptr || modulus == nullptr || outputs == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+    int count = env->GetArrayLength(inputs);
+    int modLen = env->GetArrayLength(modulus);
+    if (env->GetArrayLength(outputs) < count) {
+        throwIllegalArgumentException(env, "outputs is too small");
+        return nullptr;
+    }
+
+    // One allocation for the items, their outputs (modLen bytes covers the block) and results.
+    size_t itemsSize = count * (2 * sizeof(ByteArray) + sizeof(CryptResult));
+    auto memory = (uint8_t *) malloc(itemsSize + (size_t) count * modLen + 1);
+    if (memory == nullptr) {
+        throwIllegalStateException(env, "out of memory");
+        return nullptr;
+    }
+    auto in = (ByteArray *) memory;
+    ByteArray *out = in + count;
+    auto results = (CryptResult *) (out + count);
+    uint8_t *outBuffer = memory + itemsSize;
+    for (int i = 0; i < count; i++) {
+        out[i].value = outBuffer + (size_t) i * modLen;
+        out[i].len = 0;
+    }
+    uint8_t *inBuffer = copyByteArrays(env, inputs, count, in);
+    if (inBuffer == nullptr) {
+        free(memory);
+        return nullptr;
+    }
+
+    jbyte *p_exp = env->GetByteArrayElements(exponent, JNI_FALSE);
+    jbyte *p_mod = env->GetByteArrayElements(modulus, JNI_FALSE);
+    if (p_exp == nullptr || p_mod == nullptr) {
+        free(inBuffer);
+        free(memory);
+        throwIllegalArgumentException(env, "Get params failed");
+        return nullptr;
+    }
+    ByteArray exp, mod;
+    exp.value = (uint8_t *) p_exp;
+    exp.len = env->GetArrayLength(exponent);
+    mod.value = (uint8_t *) p_mod;
+    mod.len = modLen;
+
+    RSAKey key;
+    key.exponent = &exp;
+    key.modulus = &mod;
+    key.key_type = isPrivate ? PRIVATE_KEY : PUBLIC_KEY;
+    CrtParams crtParams;
+    if (!loadCrtParams(env, crt, parallelCrt, &crtParams, &key)) {
+        env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+        env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+        free(inBuffer);
+        free(memory);
+        return nullptr;
+    }
+
+    int ret = rsa_crypt_batch(in, count, &key, isEncrypt ? ENCRYPT : DECRYPT, parallel, out, results);
+    free(crtParams.buffer);
+
+    env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+    env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+
+    if (ret == CRYPT_SUCCESS) {
+        for (int i = 0; i < count; i++) {
+            jbyteArray result = nullptr;
+            if (results[i] == CRYPT_SUCCESS) {
+                result = env->NewByteArray(out[i].len);
+                env->SetByteArrayRegion(result, 0, out[i].len, (jbyte *) out[i].value);
+            }
+            env->SetObjectArrayElement(outputs, i, result);
+            env->DeleteLocalRef(result);
+        }
+    }
+    jintArray status = batchStatus(env, ret, results, count);
+    free(inBuffer);
+    free(memory);
+    return status;
+}
+
+extern "C"
+JNIEXPORT jintArray JNICALL
+Java_io_easycipher_EasyRSA_verifyMessages(JNIEnv *env,
+                                          jclass clazz,
+                                          jobjectArray messages,
+                                          jobjectArray signatures,
+                                          jbyteArray exponent,
+                                          jbyteArray modulus,
+                                          jint padding,
+                                          jboolean parallel) {
+    if (messages == nullptr || signatures == nullptr || exponent == nullptr || modulus == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+    int count = env->GetArrayLength(messages);
+    if (env->GetArrayLength(signatures) != count) {
+        throwIllegalArgumentException(env, "messages and signatures must have the same length");
+        return nullptr;
+    }
+
+    auto memory = (uint8_t *) malloc(count * (2 * sizeof(ByteArray) + sizeof(CryptResult)) + 1);
+    if (memory == nullptr) {
+        throwIllegalStateException(env, "out of memory");
+        return nullptr;
+    }
+    auto msg = (ByteArray *) memory;
+    ByteArray *sig = msg + count;
+    auto results = (CryptResult *) (sig + count);
+    uint8_t *msgBuffer = copyByteArrays(env, messages, count, msg);
+    uint8_t *sigBuffer = msgBuffer == nullptr ? nullptr : copyByteArrays(env, signatures, count, sig);
+    if (sigBuffer == nullptr) {
+        free(msgBuffer);
+        free(memory);
+        return nullptr;
+    }
+
+    jbyte *p_exp = env->GetByteArrayElements(exponent, JNI_FALSE);
+    jbyte *p_mod = env->GetByteArrayElements(modulus, JNI_FALSE);
+    if (p_exp == nullptr || p_mod == nullptr) {
+        free(msgBuffer);
+        free(sigBuffer);
+        free(memory);
+        throwIllegalArgumentException(env, "Get params failed");
+        return nullptr;
+    }
+    ByteArray exp, mod;
+    exp.value = (uint8_t *) p_exp;
+    exp.len = env->GetArrayLength(exponent);
+    mod.value = (uint8_t *) p_mod;
+    mod.len = env->GetArrayLength(modulus);
+
+    RSAKey key;
+    key.exponent = &exp;
+    key.modulus = &mod;
+    key.key_type = PUBLIC_KEY;
+    key.crt = nullptr;
+    key.publicExponent = nullptr;
+
+    int ret = rsa_verify_batch(msg, sig, count, &key, (SignPadding) padding, parallel, results);
+
+    env->ReleaseByteArrayElements(exponent, p_exp, JNI_ABORT);
+    env->ReleaseByteArrayElements(modulus, p_mod, JNI_ABORT);
+
+    jintArray status = batchStatus(env, ret, results, count);
+    free(msgBuffer);
+    free(sigBuffer);
+    free(memory);
+    return status;
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_easycipher_EasyRSA_getScratchPeak(JNIEnv *env, jclass clazz, jint key_bits) {
+    return rsa_scratch_peak(key_bits);
+}
+
+extern "C"
+JNIEXPORT jobjectArray JNICALL
+Java_io_easycipher_EasyRSA_generateKey(JNIEnv *env, jclass clazz, jint bits, jint threads) {
+    uint8_t privateBuffer[RSA_MAX_PRIVATE_KEY_DER_SIZE];
+    uint8_t publicBuffer[RSA_MAX_PUBLIC_KEY_DER_SIZE];
+    ByteArray privateKey, publicKey;
+    privateKey.value = privateBuffer;
+    privateKey.len = 0;
+    publicKey.value = publicBuffer;
+    publicKey.len = 0;
+
+    int ret = rsa_generate_key(bits, 65537, threads, &privateKey, &publicKey);
+    if (ret != CRYPT_SUCCESS) {
+        if (ret == FAILED_INVALID_INPUT) {
+            throwIllegalArgumentException(env, "invalid param");
+        } else {
+            throwIllegalStateException(env, "generate key failed");
+        }
+        return nullptr;
+    }
+
+    jobjectArray result = env->NewObjectArray(2, env->FindClass("[B"), nullptr);
+    jbyteArray privateBytes = env->NewByteArray(privateKey.len);
+    env->SetByteArrayRegion(privateBytes, 0, privateKey.len, (jbyte *) privateKey.value);
+    jbyteArray publicBytes = env->NewByteArray(publicKey.len);
+    env->SetByteArrayRegion(publicBytes, 0, publicKey.len, (jbyte *) publicKey.value);
+    env->SetObjectArrayElement(result, 0, privateBytes);
+    env->SetObjectArrayElement(result, 1, publicBytes);
+    memset(privateBuffer, 0, sizeof(privateBuffer));
+    return result;
+}
+
+/**
+ * Throw the exception of the failed result, failed is the message of the unknown failure.
+ */
+static void throwCryptResult(JNIEnv *env, int ret, const char *failed) {
+    if (ret == FAILED_INVALID_KEY) {
+        throwIllegalArgumentException(env, "invalid key");
+    } else if (ret == FAILED_INPUT_TOO_LARGE) {
+        throwIllegalArgumentException(env, "input too large");
+    } else if (ret == FAILED_INVALID_INPUT) {
+        throwIllegalArgumentException(env, "invalid input");
+    } else if (ret == FAILED_OUT_OF_MEMORY) {
+        throwIllegalStateException(env, "out of memory");
+    } else {
+        throwIllegalStateException(env, failed);
+    }
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_RSAKeyHandle_parseKey(JNIEnv *env, jclass clazz, jbyteArray key, jboolean parallelCrt) {
+    if (key == nullptr) {
+        throwIllegalArgumentException(env, "key can't be null");
+        return 0;
+    }
+    jbyte *p_key = env->GetByteArrayElements(key, JNI_FALSE);
+    if (p_key == nullptr) {
+        throwIllegalStateException(env, "Get params failed");
+        return 0;
+    }
+    ByteArray in;
+    in.value = (uint8_t *) p_key;
+    in.len = env->GetArrayLength(key);
+
+    RSAKeyHandle *handle = nullptr;
+    int ret = rsa_parse_key(&in, parallelCrt, &handle);
+    env->ReleaseByteArrayElements(key, p_key, JNI_ABORT);
+    if (ret != CRYPT_SUCCESS) {
+        throwCryptResult(env, ret, "parse key failed");
+        return 0;
+    }
+    return (jlong) (intptr_t) handle;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_easycipher_RSAKeyHandle_freeKey(JNIEnv *env, jclass clazz, jlong handle) {
+    rsa_free_key((RSAKeyHandle *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_easycipher_RSAKeyHandle_getKeyBits(JNIEnv *env, jclass clazz, jlong handle) {
+    return rsa_key_bits((RSAKeyHandle *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_easycipher_RSAKeyHandle_isPrivateKey(JNIEnv *env, jclass clazz, jlong handle) {
+    return rsa_key_type((RSAKeyHandle *) (intptr_t) handle) == PRIVATE_KEY;
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_cryptHandle(JNIEnv *env,
+                                       jclass clazz,
+                                       jbyteArray input,
+                                       jlong handle,
+                                       jboolean isEncrypt,
+                                       jboolean isOAEP) {
+    if (input == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+    CipherMode mode = isOAEP ? (isEncrypt ? OAEP_ENCRYPT : OAEP_DECRYPT) : (isEncrypt ? ENCRYPT : DECRYPT);
+    int inputLen = env->GetArrayLength(input);
+    // OAEP encrypts the empty input to a block.
+    if (inputLen == 0 && mode != OAEP_ENCRYPT) {
+        return input;
+    }
+    jbyte *p_input = env->GetByteArrayElements(input, JNI_FALSE);
+    if (p_input == nullptr) {
+        throwIllegalStateException(env, "Get params failed");
+        return nullptr;
+    }
+
+    ByteArray in, out;
+    in.value = (uint8_t *) p_input;
+    in.len = inputLen;
+    uint8_t buffer[RSA_MAX_BLOCK_SIZE];
+    out.value = buffer;
+    out.len = 0;
+    int ret = rsa_crypt_handle(&in, (RSAKeyHandle *) (intptr_t) handle, mode, &out);
+    env->ReleaseByteArrayElements(input, p_input, JNI_ABORT);
+
+    if (ret != CRYPT_SUCCESS) {
+        throwCryptResult(env, ret, "crypt failed");
+        return nullptr;
+    }
+    jbyteArray result = env->NewByteArray(out.len);
+    env->SetByteArrayRegion(result, 0, out.len, (jbyte *) out.value);
+    memset(buffer, 0, sizeof(buffer));
+    return result;
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyRSA_signHandle(JNIEnv *env, jclass clazz, jbyteArray message, jlong handle, jint padding) {
+    if (message == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+    jbyte *p_message = env->GetByteArrayElements(message, JNI_FALSE);
+    if (p_message == nullptr) {
+        throwIllegalStateException(env, "Get params failed");
+        return nullptr;
+    }
+
+    ByteArray in, out;
+    in.value = (uint8_t *) p_message;
+    in.len = env->GetArrayLength(message);
+    uint8_t buffer[RSA_MAX_BLOCK_SIZE];
+    out.value = buffer;
+    out.len = 0;
+    int ret = rsa_sign_handle(&in, (RSAKeyHandle *) (intptr_t) handle, (SignPadding) padding, &out);
+    env->ReleaseByteArrayElements(message, p_message, JNI_ABORT);
+
+    if (ret != CRYPT_SUCCESS) {
+        throwCryptResult(env, ret, "sign failed");
+        return nullptr;
+    }
+    jbyteArray result = env->NewByteArray(out.len);
+    env->SetByteArrayRegion(result, 0, out.len, (jbyte *) out.value);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_easycipher_EasyRSA_verifyHandle(JNIEnv *env,
+                                        jclass clazz,
+                                        jbyteArray message,
+                                        jbyteArray signature,
+                                        jlong handle,
+                                        jint padding) {
+    if (message == nullptr || signature == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return JNI_FALSE;
+    }
+    jbyte *p_message = env->GetByteArrayElements(message, JNI_FALSE);
+    jbyte *p_signature = env->GetByteArrayElements(signature, JNI_FALSE);
+    if (p_message == nullptr || p_signature == nullptr) {
+        throwIllegalStateException(env, "Get params failed");
+        return JNI_FALSE;
+    }
+
+    ByteArray in, sig;
+    in.value = (uint8_t *) p_message;
+    in.len = env->GetArrayLength(message);
+    sig.value = (uint8_t *) p_signature;
+    sig.len = env->GetArrayLength(signature);
+    int ret = rsa_verify_handle(&in, &sig, (RSAKeyHandle *) (intptr_t) handle, (SignPadding) padding);
+    env->ReleaseByteArrayElements(message, p_message, JNI_ABORT);
+    env->ReleaseByteArrayElements(signature, p_signature, JNI_ABORT);
+
+    if (ret == CRYPT_SUCCESS) {
+        return JNI_TRUE;
+    } else if (ret != FAILED_INVALID_SIGNATURE) {
+        throwCryptResult(env, ret, "verify failed");
+    }
+    return JNI_FALSE;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_NativeBigInt_create(JNIEnv *env, jclass clazz, jbyteArray magnitude) {
+    if (magnitude == nullptr) {
+        throwIllegalArgumentException(env, "value can't be null");
+        return 0;
+    }
+    jbyte *p_magnitude = env->GetByteArrayElements(magnitude, JNI_FALSE);
+    if (p_magnitude == nullptr) {
+        throwIllegalStateException(env, "Get params failed");
+        return 0;
+    }
+    ByteArray in;
+    in.value = (uint8_t *) p_magnitude;
+    in.len = env->GetArrayLength(magnitude);
+
+    RSABigNum *n = nullptr;
+    int ret = rsa_bignum_new(&in, &n);
+    env->ReleaseByteArrayElements(magnitude, p_magnitude, JNI_ABORT);
+    if (ret != CRYPT_SUCCESS) {
+        throwCryptResult(env, ret, "create failed");
+        return 0;
+    }
+    return (jlong) (intptr_t) n;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_easycipher_NativeBigInt_free(JNIEnv *env, jclass clazz, jlong handle) {
+    rsa_bignum_free((RSABigNum *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jint JNICALL
+Java_io_easycipher_NativeBigInt_bitLength(JNIEnv *env, jclass clazz, jlong handle) {
+    return rsa_bignum_bits((RSABigNum *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_NativeBigInt_toBytes(JNIEnv *env, jclass clazz, jlong handle) {
+    uint8_t buffer[RSA_BIGNUM_MAX_BYTES];
+    int len = rsa_bignum_to_bytes((RSABigNum *) (intptr_t) handle, buffer);
+    jbyteArray result = env->NewByteArray(len);
+    env->SetByteArrayRegion(result, 0, len, (jbyte *) buffer);
+    memset(buffer, 0, len);
+    return result;
+}
+
+/**
+ * Return the handle of the result, or throw the exception of the failure.
+ */
+static jlong bigNumResult(JNIEnv *env, int ret, RSABigNum *result) {
+    if (ret != CRYPT_SUCCESS) {
+        if (ret == FAILED_INVALID_INPUT) {
+            throwIllegalArgumentException(env, "invalid modulus or not invertible");
+        } else {
+            throwCryptResult(env, ret, "modular arithmetic failed");
+        }
+        return 0;
+    }
+    return (jlong) (intptr_t) result;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_NativeBigInt_modPow(JNIEnv *env, jclass clazz, jlong base, jlong exponent, jlong modulus) {
+    RSABigNum *result = nullptr;
+    int ret = rsa_bignum_mod_pow((RSABigNum *) (intptr_t) base, (RSABigNum *) (intptr_t) exponent,
+                                 (RSABigNum *) (intptr_t) modulus, &result);
+    return bigNumResult(env, ret, result);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_NativeBigInt_multiModPow(JNIEnv *env,
+                                           jclass clazz,
+                                           jlongArray bases,
+                                           jlongArray exponents,
+                                           jlong modulus) {
+    int count = env->GetArrayLength(bases);
+    if (count < 1 || count > RSA_BIGNUM_MAX_MULTI_POW || env->GetArrayLength(exponents) != count) {
+        throwIllegalArgumentException(env, "invalid count of bases");
+        return 0;
+    }
+    jlong baseHandles[RSA_BIGNUM_MAX_MULTI_POW], exponentHandles[RSA_BIGNUM_MAX_MULTI_POW];
+    env->GetLongArrayRegion(bases, 0, count, baseHandles);
+    env->GetLongArrayRegion(exponents, 0, count, exponentHandles);
+    const RSABigNum *baseNums[RSA_BIGNUM_MAX_MULTI_POW], *exponentNums[RSA_BIGNUM_MAX_MULTI_POW];
+    for (int i = 0; i < count; i++) {
+        baseNums[i] = (RSABigNum *) (intptr_t) baseHandles[i];
+        exponentNums[i] = (RSABigNum *) (intptr_t) exponentHandles[i];
+    }
+
+    RSABigNum *result = nullptr;
+    int ret = rsa_bignum_mod_multi_pow(baseNums, exponentNums, count, (RSABigNum *) (intptr_t) modulus, &result);
+    return bigNumResult(env, ret, result);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_NativeBigInt_modMultiply(JNIEnv *env, jclass clazz, jlong a, jlong b, jlong modulus) {
+    RSABigNum *result = nullptr;
+    int ret = rsa_bignum_mod_mul((RSABigNum *) (intptr_t) a, (RSABigNum *) (intptr_t) b,
+                                 (RSABigNum *) (intptr_t) modulus, &result);
+    return bigNumResult(env, ret, result);
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_NativeBigInt_modInverse(JNIEnv *env, jclass clazz, jlong a, jlong modulus) {
+    RSABigNum *result = nullptr;
+    int ret = rsa_bignum_mod_inverse((RSABigNum *) (intptr_t) a, (RSABigNum *) (intptr_t) modulus, &result);
+    return bigNumResult(env, ret, result);
+}
+
+
+static bool checkCurve(JNIEnv *env, jint curve) {
+    if (!ecc_curve_valid(curve)) {
+        throwIllegalArgumentException(env, "Invalid curve");
+        return false;
+    }
+    return true;
+}
 
 extern "C"
 JNIEXPORT jbyteArray JNICALL
-Java_io_easycipher_EasyECC_makeKey(JNIEnv *env, jclass type) {
-    int totalLen = ECC_PUBLIC_KEY_LEN + ECC_PRIVATE_KEY_LEN;
-    uint8_t p_key[totalLen];
+Java_io_easycipher_EasyECC_makeKey(JNIEnv *env, jclass type, jint curve) {
+    if (!checkCurve(env, curve)) {
+        return nullptr;
+    }
+    int totalLen = ECC_PUBLIC_KEY_LEN(curve) + ECC_PRIVATE_KEY_LEN(curve);
+    uint8_t p_key[ECC_PUBLIC_KEY_LEN(ECC_MAX_BYTES) + ECC_PRIVATE_KEY_LEN(ECC_MAX_BYTES)];
     uint8_t *p_pub = p_key;
-    uint8_t *p_pri = p_key + ECC_PUBLIC_KEY_LEN;
-    int success = ecc_make_key(p_pub, p_pri);
+    uint8_t *p_pri = p_key + ECC_PUBLIC_KEY_LEN(curve);
+    int success = ecc_make_key(curve, p_pub, p_pri);
     if (success == 0) {
         return nullptr;
     }
@@ -266,11 +1066,14 @@ Java_io_easycipher_EasyECC_makeKey(JNIEnv *env, jclass type) {
 
 extern "C"
 JNIEXPORT jbyteArray JNICALL
-Java_io_easycipher_EasyECC_ecdhSecret(JNIEnv *env, jclass type,
+Java_io_easycipher_EasyECC_ecdhSecret(JNIEnv *env, jclass type, jint curve,
                                       jbyteArray public_key,
                                       jbyteArray private_key) {
-    if (public_key == nullptr || env->GetArrayLength(public_key) != ECC_PUBLIC_KEY_LEN ||
-        private_key == nullptr || env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN) {
+    if (!checkCurve(env, curve)) {
+        return nullptr;
+    }
+    if (public_key == nullptr || env->GetArrayLength(public_key) != ECC_PUBLIC_KEY_LEN(curve) ||
+        private_key == nullptr || env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN(curve)) {
         throwIllegalArgumentException(env, "Invalid Key");
         return nullptr;
     }
@@ -278,8 +1081,8 @@ Java_io_easycipher_EasyECC_ecdhSecret(JNIEnv *env, jclass type,
     jbyte *pub_key = env->GetByteArrayElements(public_key, nullptr);
     jbyte *pri_key = env->GetByteArrayElements(private_key, nullptr);
 
-    uint8_t secret[ECC_BYTES];
-    int success = ecdh_shared_secret((uint8_t *) pub_key, (uint8_t *) pri_key, secret);
+    uint8_t secret[ECC_MAX_BYTES];
+    int success = ecdh_shared_secret(curve, (uint8_t *) pub_key, (uint8_t *) pri_key, secret);
 
     env->ReleaseByteArrayElements(private_key, pri_key, 0);
     env->ReleaseByteArrayElements(public_key, pub_key, 0);
@@ -288,20 +1091,23 @@ Java_io_easycipher_EasyECC_ecdhSecret(JNIEnv *env, jclass type,
         return nullptr;
     }
 
-    jbyteArray result = env->NewByteArray(ECC_BYTES);
-    env->SetByteArrayRegion(result, 0, ECC_BYTES, (jbyte *) secret);
+    jbyteArray result = env->NewByteArray(curve);
+    env->SetByteArrayRegion(result, 0, curve, (jbyte *) secret);
     return result;
 }
 
 extern "C"
 JNIEXPORT jbyteArray JNICALL
-Java_io_easycipher_EasyECC_ecdsaSign(JNIEnv *env, jclass clazz, jbyteArray private_key,
+Java_io_easycipher_EasyECC_ecdsaSign(JNIEnv *env, jclass clazz, jint curve, jbyteArray private_key,
                                      jbyteArray hash) {
-    if (env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN) {
+    if (!checkCurve(env, curve)) {
+        return nullptr;
+    }
+    if (env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN(curve)) {
         throwIllegalArgumentException(env,  "Invalid key");
         return nullptr;
     }
-    if (env->GetArrayLength(hash) != ECC_HASH_LEN) {
+    if (env->GetArrayLength(hash) != ECC_HASH_LEN(curve)) {
         throwIllegalArgumentException(env,  "Invalid hash");
         return nullptr;
     }
@@ -309,8 +1115,8 @@ Java_io_easycipher_EasyECC_ecdsaSign(JNIEnv *env, jclass clazz, jbyteArray priva
     jbyte *pri_key = env->GetByteArrayElements(private_key, nullptr);
     jbyte *p_hash = env->GetByteArrayElements(hash, nullptr);
 
-    uint8_t signature[ECC_SIGNATURE_LEN];
-    int success = ecdsa_sign((uint8_t *) pri_key, (uint8_t *) p_hash, signature);
+    uint8_t signature[ECC_SIGNATURE_LEN(ECC_MAX_BYTES)];
+    int success = ecdsa_sign(curve, (uint8_t *) pri_key, (uint8_t *) p_hash, signature);
 
     env->ReleaseByteArrayElements(private_key, pri_key, 0);
     env->ReleaseByteArrayElements(hash, p_hash, 0);
@@ -319,24 +1125,61 @@ Java_io_easycipher_EasyECC_ecdsaSign(JNIEnv *env, jclass clazz, jbyteArray priva
         return nullptr;
     }
 
-    jbyteArray result = env->NewByteArray(ECC_SIGNATURE_LEN);
-    env->SetByteArrayRegion(result, 0, ECC_SIGNATURE_LEN, (jbyte *) signature);
+    jbyteArray result = env->NewByteArray(ECC_SIGNATURE_LEN(curve));
+    env->SetByteArrayRegion(result, 0, ECC_SIGNATURE_LEN(curve), (jbyte *) signature);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyECC_ecdsaSignDeterministic(JNIEnv *env, jclass clazz, jint curve, jbyteArray private_key,
+                                                  jbyteArray hash) {
+    if (!checkCurve(env, curve)) {
+        return nullptr;
+    }
+    if (env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN(curve)) {
+        throwIllegalArgumentException(env,  "Invalid key");
+        return nullptr;
+    }
+    if (env->GetArrayLength(hash) != ECC_HASH_LEN(curve)) {
+        throwIllegalArgumentException(env,  "Invalid hash");
+        return nullptr;
+    }
+
+    jbyte *pri_key = env->GetByteArrayElements(private_key, nullptr);
+    jbyte *p_hash = env->GetByteArrayElements(hash, nullptr);
+
+    uint8_t signature[ECC_SIGNATURE_LEN(ECC_MAX_BYTES)];
+    int success = ecdsa_sign_deterministic(curve, (uint8_t *) pri_key, (uint8_t *) p_hash, signature);
+
+    env->ReleaseByteArrayElements(private_key, pri_key, 0);
+    env->ReleaseByteArrayElements(hash, p_hash, 0);
+
+    if (success == 0) {
+        return nullptr;
+    }
+
+    jbyteArray result = env->NewByteArray(ECC_SIGNATURE_LEN(curve));
+    env->SetByteArrayRegion(result, 0, ECC_SIGNATURE_LEN(curve), (jbyte *) signature);
     return result;
 }
 
 extern "C"
 JNIEXPORT jboolean JNICALL
-Java_io_easycipher_EasyECC_ecdsaVerify(JNIEnv *env, jclass clazz, jbyteArray public_key,
+Java_io_easycipher_EasyECC_ecdsaVerify(JNIEnv *env, jclass clazz, jint curve, jbyteArray public_key,
                                        jbyteArray hash, jbyteArray signature) {
-    if (env->GetArrayLength(public_key) != ECC_PUBLIC_KEY_LEN) {
+    if (!checkCurve(env, curve)) {
+        return false;
+    }
+    if (env->GetArrayLength(public_key) != ECC_PUBLIC_KEY_LEN(curve)) {
         throwIllegalArgumentException(env, "Invalid key");
         return false;
     }
-    if (env->GetArrayLength(hash) != ECC_HASH_LEN) {
+    if (env->GetArrayLength(hash) != ECC_HASH_LEN(curve)) {
         throwIllegalArgumentException(env,  "Invalid hash");
         return false;
     }
-    if (env->GetArrayLength(signature) != ECC_SIGNATURE_LEN) {
+    if (env->GetArrayLength(signature) != ECC_SIGNATURE_LEN(curve)) {
         throwIllegalArgumentException(env, "Invalid signature");
         return false;
     }
@@ -345,11 +1188,228 @@ Java_io_easycipher_EasyECC_ecdsaVerify(JNIEnv *env, jclass clazz, jbyteArray pub
     jbyte *p_hash = env->GetByteArrayElements(hash, nullptr);
     jbyte *p_sign = env->GetByteArrayElements(signature, nullptr);
 
-    int success = ecdsa_verify((uint8_t *) pub_key, (uint8_t *) p_hash, (uint8_t *) p_sign);
+    int success = ecdsa_verify(curve, (uint8_t *) pub_key, (uint8_t *) p_hash, (uint8_t *) p_sign);
 
     env->ReleaseByteArrayElements(public_key, pub_key, 0);
     env->ReleaseByteArrayElements(hash, p_hash, 0);
     env->ReleaseByteArrayElements(signature, p_sign, 0);
 
     return success != 0;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_ECCKeyHandle_createKey(JNIEnv *env, jclass clazz, jint curve, jbyteArray public_key,
+                                          jboolean precompute) {
+    if (!checkCurve(env, curve)) {
+        return 0;
+    }
+    if (public_key == nullptr || env->GetArrayLength(public_key) != ECC_PUBLIC_KEY_LEN(curve)) {
+        throwIllegalArgumentException(env, "Invalid key");
+        return 0;
+    }
+
+    jbyte *pub_key = env->GetByteArrayElements(public_key, nullptr);
+    EccPublicKey *key = ecc_public_key_new(curve, (uint8_t *) pub_key, precompute);
+    env->ReleaseByteArrayElements(public_key, pub_key, JNI_ABORT);
+
+    if (key == nullptr) {
+        throwIllegalArgumentException(env, "Invalid key");
+        return 0;
+    }
+    return (jlong) (intptr_t) key;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_easycipher_ECCKeyHandle_freeKey(JNIEnv *env, jclass clazz, jlong handle) {
+    ecc_public_key_free((EccPublicKey *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyECC_ecdhSecretHandle(JNIEnv *env, jclass type, jlong public_key,
+                                            jbyteArray private_key) {
+    EccPublicKey *key = (EccPublicKey *) (intptr_t) public_key;
+    int curve = ecc_public_key_curve(key);
+    if (private_key == nullptr || env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN(curve)) {
+        throwIllegalArgumentException(env, "Invalid Key");
+        return nullptr;
+    }
+
+    jbyte *pri_key = env->GetByteArrayElements(private_key, nullptr);
+
+    uint8_t secret[ECC_MAX_BYTES];
+    int success = ecdh_shared_secret_key(key, (uint8_t *) pri_key, secret);
+
+    env->ReleaseByteArrayElements(private_key, pri_key, 0);
+
+    if (success == 0) {
+        return nullptr;
+    }
+
+    jbyteArray result = env->NewByteArray(curve);
+    env->SetByteArrayRegion(result, 0, curve, (jbyte *) secret);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jboolean JNICALL
+Java_io_easycipher_EasyECC_ecdsaVerifyHandle(JNIEnv *env, jclass clazz, jlong public_key,
+                                             jbyteArray hash, jbyteArray signature) {
+    EccPublicKey *key = (EccPublicKey *) (intptr_t) public_key;
+    int curve = ecc_public_key_curve(key);
+    if (env->GetArrayLength(hash) != ECC_HASH_LEN(curve)) {
+        throwIllegalArgumentException(env,  "Invalid hash");
+        return false;
+    }
+    if (env->GetArrayLength(signature) != ECC_SIGNATURE_LEN(curve)) {
+        throwIllegalArgumentException(env, "Invalid signature");
+        return false;
+    }
+
+    jbyte *p_hash = env->GetByteArrayElements(hash, nullptr);
+    jbyte *p_sign = env->GetByteArrayElements(signature, nullptr);
+
+    int success = ecdsa_verify_key(key, (uint8_t *) p_hash, (uint8_t *) p_sign);
+
+    env->ReleaseByteArrayElements(hash, p_hash, 0);
+    env->ReleaseByteArrayElements(signature, p_sign, 0);
+
+    return success != 0;
+}
+
+extern "C"
+JNIEXPORT jlong JNICALL
+Java_io_easycipher_ECCSignPool_createPool(JNIEnv *env, jclass clazz, jint curve, jint capacity) {
+    if (!checkCurve(env, curve)) {
+        return 0;
+    }
+    if (capacity < 1 || capacity > ECC_POOL_MAX_CAPACITY) {
+        throwIllegalArgumentException(env, "Invalid capacity");
+        return 0;
+    }
+    EccSignPool *pool = ecdsa_pool_new(curve, capacity);
+    if (pool == nullptr) {
+        throwIllegalStateException(env, "Failed to start the pool");
+        return 0;
+    }
+    return (jlong) (intptr_t) pool;
+}
+
+extern "C"
+JNIEXPORT void JNICALL
+Java_io_easycipher_ECCSignPool_freePool(JNIEnv *env, jclass clazz, jlong handle) {
+    ecdsa_pool_free((EccSignPool *) (intptr_t) handle);
+}
+
+extern "C"
+JNIEXPORT jlongArray JNICALL
+Java_io_easycipher_ECCSignPool_getStats(JNIEnv *env, jclass clazz, jlong handle) {
+    EccSignPoolStats stats;
+    ecdsa_pool_stats((EccSignPool *) (intptr_t) handle, &stats);
+    jlong values[] = {stats.capacity, stats.available, (jlong) stats.produced, (jlong) stats.consumed,
+                      (jlong) stats.misses, (jlong) stats.failures};
+    jlongArray result = env->NewLongArray(6);
+    env->SetLongArrayRegion(result, 0, 6, values);
+    return result;
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyECC_ecdsaSignPool(JNIEnv *env, jclass clazz, jlong pool_handle, jbyteArray private_key,
+                                         jbyteArray hash) {
+    EccSignPool *pool = (EccSignPool *) (intptr_t) pool_handle;
+    int curve = ecdsa_pool_curve(pool);
+    if (env->GetArrayLength(private_key) != ECC_PRIVATE_KEY_LEN(curve)) {
+        throwIllegalArgumentException(env,  "Invalid key");
+        return nullptr;
+    }
+    if (env->GetArrayLength(hash) != ECC_HASH_LEN(curve)) {
+        throwIllegalArgumentException(env,  "Invalid hash");
+        return nullptr;
+    }
+
+    jbyte *pri_key = env->GetByteArrayElements(private_key, nullptr);
+    jbyte *p_hash = env->GetByteArrayElements(hash, nullptr);
+
+    uint8_t signature[ECC_SIGNATURE_LEN(ECC_MAX_BYTES)];
+    int success = ecdsa_sign_pool(pool, (uint8_t *) pri_key, (uint8_t *) p_hash, signature);
+
+    env->ReleaseByteArrayElements(private_key, pri_key, 0);
+    env->ReleaseByteArrayElements(hash, p_hash, 0);
+
+    if (success == 0) {
+        return nullptr;
+    }
+
+    jbyteArray result = env->NewByteArray(ECC_SIGNATURE_LEN(curve));
+    env->SetByteArrayRegion(result, 0, ECC_SIGNATURE_LEN(curve), (jbyte *) signature);
+    return result;
+}
+
+/**
+ * Copy the byte arrays back to back as copyByteArrays, each one must be len bytes.
+ * Returns the buffer (free by the caller), or nullptr with the exception thrown.
+ */
+static uint8_t *copyFixedArrays(JNIEnv *env, jobjectArray arrays, int count, int len, ByteArray *items,
+                                const char *invalid) {
+    uint8_t *buffer = copyByteArrays(env, arrays, count, items);
+    if (buffer == nullptr) {
+        return nullptr;
+    }
+    for (int i = 0; i < count; i++) {
+        if (items[i].len != len) {
+            free(buffer);
+            throwIllegalArgumentException(env, invalid);
+            return nullptr;
+        }
+    }
+    return buffer;
+}
+
+extern "C"
+JNIEXPORT jbyteArray JNICALL
+Java_io_easycipher_EasyECC_verifyBatch(JNIEnv *env, jclass clazz, jint curve, jobjectArray public_keys,
+                                       jobjectArray hashes, jobjectArray signatures, jboolean parallel) {
+    if (!checkCurve(env, curve)) {
+        return nullptr;
+    }
+    if (public_keys == nullptr || hashes == nullptr || signatures == nullptr) {
+        throwIllegalArgumentException(env, "params can't be null");
+        return nullptr;
+    }
+    int count = env->GetArrayLength(signatures);
+    if (env->GetArrayLength(public_keys) != count || env->GetArrayLength(hashes) != count) {
+        throwIllegalArgumentException(env, "keys, hashes and signatures must have the same length");
+        return nullptr;
+    }
+
+    auto items = (ByteArray *) malloc(count * sizeof(ByteArray) + 1);
+    if (items == nullptr) {
+        throwIllegalStateException(env, "out of memory");
+        return nullptr;
+    }
+    uint8_t *keyBuffer = copyFixedArrays(env, public_keys, count, ECC_PUBLIC_KEY_LEN(curve), items, "Invalid key");
+    uint8_t *hashBuffer = keyBuffer == nullptr ? nullptr :
+                          copyFixedArrays(env, hashes, count, ECC_HASH_LEN(curve), items, "Invalid hash");
+    uint8_t *sigBuffer = hashBuffer == nullptr ? nullptr :
+                         copyFixedArrays(env, signatures, count, ECC_SIGNATURE_LEN(curve), items, "Invalid signature");
+    auto bitmap = sigBuffer == nullptr ? nullptr : (uint8_t *) malloc((count + 7) / 8 + 1);
+    jbyteArray result = nullptr;
+    if (bitmap != nullptr) {
+        ecdsa_verify_batch(curve, keyBuffer, hashBuffer, sigBuffer, count, parallel, bitmap);
+        result = env->NewByteArray((count + 7) / 8);
+        if (result != nullptr) {
+            env->SetByteArrayRegion(result, 0, (count + 7) / 8, (jbyte *) bitmap);
+        }
+    } else if (sigBuffer != nullptr) {
+        throwIllegalStateException(env, "out of memory");
+    }
+    free(bitmap);
+    free(sigBuffer);
+    free(hashBuffer);
+    free(keyBuffer);
+    free(items);
+    return result;
 }
\ No newline at end of file
@@ -3,56 +3,60 @@
 
 #include <stdint.h>
 
-/* Curve selection options. */
+/* The curve IDs, the value is the size of the private key in bytes.
+   All the curves are compiled in, each one with its own arithmetic (see ecc_curve.inc). */
 #define secp128r1 16
 #define secp192r1 24
 #define secp256r1 32
 #define secp384r1 48
-#ifndef ECC_CURVE
-    #define ECC_CURVE secp256r1
-#endif
-
-#if (ECC_CURVE != secp128r1 && ECC_CURVE != secp192r1 && ECC_CURVE != secp256r1 && ECC_CURVE != secp384r1)
-    #error "Must define ECC_CURVE to one of the available curves"
-#endif
 
-#define ECC_BYTES ECC_CURVE
+#define ECC_MAX_BYTES secp384r1
 
-#define ECC_PUBLIC_KEY_LEN  (ECC_BYTES + 1)
-#define ECC_PRIVATE_KEY_LEN  ECC_BYTES
-#define ECC_SIGNATURE_LEN  (ECC_BYTES << 1)
-#define ECC_HASH_LEN  ECC_BYTES
+#define ECC_PUBLIC_KEY_LEN(curve)  ((curve) + 1)
+#define ECC_PRIVATE_KEY_LEN(curve)  (curve)
+#define ECC_SIGNATURE_LEN(curve)  ((curve) << 1)
+#define ECC_HASH_LEN(curve)  (curve)
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+/* ecc_curve_valid() function.
+Returns 1 if the curve ID is one of the curves above, 0 otherwise.
+*/
+int ecc_curve_valid(int p_curve);
+
 /* ecc_make_key() function.
 Create a public/private key pair.
-    
+
+Inputs:
+    p_curve      - The curve ID, the keys are ECC_PUBLIC_KEY_LEN(p_curve) and ECC_PRIVATE_KEY_LEN(p_curve) bytes.
+
 Outputs:
     p_publicKey  - Will be filled in with the public key.
     p_privateKey - Will be filled in with the private key.
 
 Returns 1 if the key pair was generated successfully, 0 if an error occurred.
 */
-int ecc_make_key(uint8_t p_publicKey[ECC_BYTES+1], uint8_t p_privateKey[ECC_BYTES]);
+int ecc_make_key(int p_curve, uint8_t *p_publicKey, uint8_t *p_privateKey);
 
 /* ecdh_shared_secret() function.
 Compute a shared secret given your secret key and someone else's public key.
 Note: It is recommended that you hash the result of ecdh_shared_secret before using it for symmetric encryption or HMAC.
 
 Inputs:
+    p_curve      - The curve ID of the keys.
     p_publicKey  - The public key of the remote party.
     p_privateKey - Your private key.
 
 Outputs:
     p_secret - Will be filled in with the shared secret value.
 
-Returns 1 if the shared secret was generated successfully, 0 if an error occurred.
+Returns 1 if the shared secret was generated successfully, 0 if an error occurred
+(or the public key is not a point on the curve).
 */
-int ecdh_shared_secret(const uint8_t p_publicKey[ECC_BYTES+1], const uint8_t p_privateKey[ECC_BYTES], uint8_t p_secret[ECC_BYTES]);
+int ecdh_shared_secret(int p_curve, const uint8_t *p_publicKey, const uint8_t *p_privateKey, uint8_t *p_secret);
 
 /* ecdsa_sign() function.
 Generate an ECDSA signature for a given hash value.
@@ -61,15 +65,26 @@ Usage: Compute a hash of the data you wish to sign (SHA-2 is recommended) and pa
 this function along with your private key.
 
 Inputs:
+    p_curve      - The curve ID of the key.
     p_privateKey - Your private key.
-    p_hash       - The message hash to sign.
+    p_hash       - The message hash to sign, ECC_HASH_LEN(p_curve) bytes.
 
 Outputs:
     p_signature  - Will be filled in with the signature value.
 
 Returns 1 if the signature generated successfully, 0 if an error occurred.
 */
-int ecdsa_sign(const uint8_t p_privateKey[ECC_BYTES], const uint8_t p_hash[ECC_BYTES], uint8_t p_signature[ECC_BYTES*2]);
+int ecdsa_sign(int p_curve, const uint8_t *p_privateKey, const uint8_t *p_hash, uint8_t *p_signature);
+
+/* ecdsa_sign_deterministic() function.
+ecdsa_sign() with the nonce derived from the private key and the hash (RFC 6979, HMAC_DRBG with HMAC-SHA-256),
+instead of the random. It reads no /dev/urandom, and signs the same hash with the same key to the same signature.
+The nonces match RFC 6979 for the hashes of SHA-256; for the other hash of the curve (such as SHA-384
+on secp384r1) the DRBG is still HMAC-SHA-256, so they differ from the vectors of that hash.
+
+Returns 1 if the signature generated successfully, 0 if the curve is not supported.
+*/
+int ecdsa_sign_deterministic(int p_curve, const uint8_t *p_privateKey, const uint8_t *p_hash, uint8_t *p_signature);
 
 /* ecdsa_verify() function.
 Verify an ECDSA signature.
@@ -78,13 +93,115 @@ Usage: Compute the hash of the signed data using the same hash as the signer and
 pass it to this function along with the signer's public key and the signature values (r and s).
 
 Inputs:
+    p_curve     - The curve ID of the key.
     p_publicKey - The signer's public key
     p_hash      - The hash of the signed data.
     p_signature - The signature value.
 
-Returns 1 if the signature is valid, 0 if it is invalid.
+Returns 1 if the signature is valid, 0 if it is invalid, the public key is not a point on the curve,
+or the curve is not supported.
+*/
+int ecdsa_verify(int p_curve, const uint8_t *p_publicKey, const uint8_t *p_hash, const uint8_t *p_signature);
+
+/* The public key set up once for the repeated uses: decompressed and checked on the curve,
+and optionally with the precomputed multiples for ecdsa_verify_key.
+It is not changed after ecc_public_key_new, so the threads could use it at the same time. */
+typedef struct EccPublicKey EccPublicKey;
+
+/* ecc_public_key_new() function.
+Inputs:
+    p_curve      - The curve ID of the key.
+    p_publicKey  - The compressed public key, ECC_PUBLIC_KEY_LEN(p_curve) bytes.
+    p_precompute - 1 to precompute the multiples of the point for ecdsa_verify_key, 0 for ECDH only.
+
+Returns the key, free it by ecc_public_key_free. NULL if the curve is not supported, the key is not
+on the curve, or out of memory.
+*/
+EccPublicKey *ecc_public_key_new(int p_curve, const uint8_t *p_publicKey, int p_precompute);
+
+void ecc_public_key_free(EccPublicKey *p_key);
+
+int ecc_public_key_curve(const EccPublicKey *p_key);
+
+/* ecdh_shared_secret_key() function.
+ecdh_shared_secret() with the public key set up by ecc_public_key_new.
+*/
+int ecdh_shared_secret_key(const EccPublicKey *p_key, const uint8_t *p_privateKey, uint8_t *p_secret);
+
+/* ecdsa_verify_key() function.
+ecdsa_verify() with the public key set up by ecc_public_key_new.
+*/
+int ecdsa_verify_key(const EccPublicKey *p_key, const uint8_t *p_hash, const uint8_t *p_signature);
+
+/* The signatures verified together by one task of ecdsa_verify_batch. */
+#define ECC_BATCH_CHUNK 16
+
+/* ecdsa_verify_batch() function.
+Verify p_count signatures, each one with its own public key, as ecdsa_verify. The signatures are verified
+in the chunks of ECC_BATCH_CHUNK, the inversions are shared by the chunk (Montgomery's trick).
+The public keys not on the curve are rejected.
+
+Inputs:
+    p_curve      - The curve ID of the keys.
+    p_publicKeys - p_count public keys back to back, ECC_PUBLIC_KEY_LEN(p_curve) bytes each.
+    p_hashes     - p_count hashes back to back, ECC_HASH_LEN(p_curve) bytes each.
+    p_signatures - p_count signatures back to back, ECC_SIGNATURE_LEN(p_curve) bytes each.
+    p_parallel   - Nonzero to spread the chunks on the threads of the pool, 0 to verify on the calling thread.
+
+Outputs:
+    p_results - The bitmap of (p_count + 7) / 8 bytes, the bit (i & 7) of the byte (i >> 3) is set
+                if the signature i is valid.
+
+Returns 1 if the signatures are verified, 0 if the curve is not supported.
+*/
+int ecdsa_verify_batch(int p_curve, const uint8_t *p_publicKeys, const uint8_t *p_hashes, const uint8_t *p_signatures,
+                       int p_count, int p_parallel, uint8_t *p_results);
+
+/* The signing with the nonces made ahead: a background thread (at a low priority) keeps the pool
+filled with (r, 1 / k), the message independent part of the signature, so ecdsa_sign_pool only takes
+two multiplications mod n. Each nonce is taken by one signature, wiped from the pool and never reused.
+When the pool is empty, the signature makes its own nonce as ecdsa_sign (counted as a miss).
+The threads could sign with the same pool at the same time.
+The pool must not be used across fork(): the child has no background thread, and signing with the nonces
+copied into both processes would use each one twice, which gives away the private key. */
+typedef struct EccSignPool EccSignPool;
+
+/* The nonces kept by a pool at most. */
+#define ECC_POOL_MAX_CAPACITY 1024
+
+typedef struct {
+    int capacity;      /* nonces kept at most */
+    int available;     /* nonces in the pool now */
+    uint64_t produced; /* nonces made by the background thread */
+    uint64_t consumed; /* signatures with a nonce from the pool */
+    uint64_t misses;   /* signatures finding the pool empty */
+    uint64_t failures; /* nonces the background thread failed to make (no random), retried with a backoff */
+} EccSignPoolStats;
+
+/* ecdsa_pool_new() function.
+Inputs:
+    p_curve    - The curve ID of the keys to sign with.
+    p_capacity - The nonces kept at most, 1 to ECC_POOL_MAX_CAPACITY.
+
+Returns the pool with its thread started, free it by ecdsa_pool_free. NULL if the curve is not supported,
+the capacity is out of range, or the thread could not be created.
+*/
+EccSignPool *ecdsa_pool_new(int p_curve, int p_capacity);
+
+/* Stop the thread, wipe the nonces left and free the pool. */
+void ecdsa_pool_free(EccSignPool *p_pool);
+
+int ecdsa_pool_curve(const EccSignPool *p_pool);
+
+/* ecdsa_pool_stats() function.
+The counters of the pool at the same moment.
+*/
+void ecdsa_pool_stats(EccSignPool *p_pool, EccSignPoolStats *p_stats);
+
+/* ecdsa_sign_pool() function.
+ecdsa_sign() with the next nonce of the pool, the private key and the hash are of the curve of the pool.
 */
-int ecdsa_verify(const uint8_t p_publicKey[ECC_BYTES+1], const uint8_t p_hash[ECC_BYTES], const uint8_t p_signature[ECC_BYTES*2]);
+int ecdsa_sign_pool(EccSignPool *p_pool, const uint8_t *p_privateKey, const uint8_t *p_hash, uint8_t *p_signature);
 
 #ifdef __cplusplus
 } /* end of extern "C" */
@@ -0,0 +1,2 @@
+#define ECC_CURVE secp128r1
+#include "ecc_curve.inc"
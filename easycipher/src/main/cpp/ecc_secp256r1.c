@@ -0,0 +1,2 @@
+#define ECC_CURVE secp256r1
+#include "ecc_curve.inc"
@@ -24,7 +24,7 @@ void xor_key(uint8_t *ikey, uint8_t *okey, const uint8_t *key, int len) {
     }
 }
 
-void hmac_sha256(ByteArray *input, ByteArray *key, uint8_t mac[SHA256_DIGEST_LEN]) {
+void hmac_sha256_key(HMAC_SHA256_KEY *key, const uint8_t *value, int len) {
     uint8_t ikey[SHA256_BLOCK_SIZE];
     uint8_t okey[SHA256_BLOCK_SIZE];
     uint8_t buffer[SHA256_DIGEST_LEN];
@@ -38,22 +38,43 @@ void hmac_sha256(ByteArray *input, ByteArray *key, uint8_t mac[SHA256_DIGEST_LEN
         p_okey[i] = 0x5c5c5c5c5c5c5c5cL; // 0x5c 01011100
     }
 
-    if (key->len <= SHA256_BLOCK_SIZE) {
-        xor_key(ikey, okey, key->value, key->len);
+    if (len <= SHA256_BLOCK_SIZE) {
+        xor_key(ikey, okey, value, len);
     } else {
         sha256_init(&ctx);
-        sha256_update(&ctx, key->value, key->len);
+        sha256_update(&ctx, value, len);
         sha256_final(&ctx, buffer);
         xor_key(ikey, okey, buffer, SHA256_DIGEST_LEN);
+        memset(buffer, 0, sizeof(buffer));
     }
 
-    sha256_init(&ctx);
-    sha256_update(&ctx, ikey, SHA256_BLOCK_SIZE);
-    sha256_update(&ctx, input->value, input->len);
-    sha256_final(&ctx, buffer);
+    sha256_init(&key->inner);
+    sha256_update(&key->inner, ikey, SHA256_BLOCK_SIZE);
+    sha256_init(&key->outer);
+    sha256_update(&key->outer, okey, SHA256_BLOCK_SIZE);
+    memset(ikey, 0, sizeof(ikey));
+    memset(okey, 0, sizeof(okey));
+}
+
+void hmac_sha256_begin(const HMAC_SHA256_KEY *key, SHA256_CTX *ctx) {
+    *ctx = key->inner;
+}
+
+void hmac_sha256_end(const HMAC_SHA256_KEY *key, SHA256_CTX *ctx, uint8_t mac[SHA256_DIGEST_LEN]) {
+    uint8_t buffer[SHA256_DIGEST_LEN];
 
-    sha256_init(&ctx);
-    sha256_update(&ctx, okey, SHA256_BLOCK_SIZE);
-    sha256_update(&ctx, buffer, SHA256_DIGEST_LEN);
-    sha256_final(&ctx, mac);
+    sha256_final(ctx, buffer);
+    *ctx = key->outer;
+    sha256_update(ctx, buffer, SHA256_DIGEST_LEN);
+    sha256_final(ctx, mac);
+}
+
+void hmac_sha256(ByteArray *input, ByteArray *key, uint8_t mac[SHA256_DIGEST_LEN]) {
+    HMAC_SHA256_KEY hmacKey;
+    SHA256_CTX ctx;
+
+    hmac_sha256_key(&hmacKey, key->value, key->len);
+    hmac_sha256_begin(&hmacKey, &ctx);
+    sha256_update(&ctx, input->value, input->len);
+    hmac_sha256_end(&hmacKey, &ctx, mac);
 }
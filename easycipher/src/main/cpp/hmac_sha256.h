@@ -3,14 +3,39 @@
 #ifndef HMAC_SHA256_H
 #define HMAC_SHA256_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "sha256.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-#include "array.h"
-
 void hmac_sha256(ByteArray *input, ByteArray *key, uint8_t mac[SHA256_DIGEST_LEN]);
 
+/**
+ * The key of HMAC as the midstates: SHA-256 of the inner and the outer padded key blocks,
+ * so each MAC with the same key takes no hash of the key blocks.
+ */
+typedef struct {
+    SHA256_CTX inner;
+    SHA256_CTX outer;
+} HMAC_SHA256_KEY;
+
+void hmac_sha256_key(HMAC_SHA256_KEY *key, const uint8_t *value, int len);
+
+/**
+ * Start the MAC with the key, then sha256_update(ctx, ...) the message.
+ */
+void hmac_sha256_begin(const HMAC_SHA256_KEY *key, SHA256_CTX *ctx);
+
+/**
+ * Finish the MAC started by hmac_sha256_begin.
+ */
+void hmac_sha256_end(const HMAC_SHA256_KEY *key, SHA256_CTX *ctx, uint8_t mac[SHA256_DIGEST_LEN]);
+
 #ifdef __cplusplus
 }
 #endif
@@ -8,18 +8,39 @@
  */
 
 #include "rsa.h"
+#include "rsa_avx.h"
 #include "random.h"
+#include "sha256.h"
+#include "thread_pool.h"
+#include "der.h"
+#include "wipe.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
+#include <unistd.h>
 
-// The library support 1024/2048 bits key now, the key takes 64 words(32bits for one word) at most.
-// We reserve bytes for BigInt, for some middle calculation may use more than 64 words.
-#define RSA_KEY_CAPACITY 68
+// The library support 1024/2048/3072/4096 bits key now, the key takes 128 words(32bits for one word) at most.
+// We reserve bytes for BigInt, for some middle calculation may use more than 128 words.
+#define RSA_KEY_CAPACITY 132
 
 #define KNUTH_POW2_THRESH_LEN  6
 #define KNUTH_POW2_THRESH_ZEROS  3
 
+// Operands with at least this many words are multiplied/squared with Karatsuba,
+// smaller ones with the schoolbook loops (multiplyToLen/squareToLen).
+// The schoolbook square already skips half of the products, so it keeps winning up to a larger size.
+// Override with -DKARATSUBA_THRESHOLD_LEN=n / -DKARATSUBA_SQUARE_THRESHOLD_LEN=n when tuning for a target.
+#ifndef KARATSUBA_THRESHOLD_LEN
+#define KARATSUBA_THRESHOLD_LEN 40
+#endif
+#ifndef KARATSUBA_SQUARE_THRESHOLD_LEN
+#define KARATSUBA_SQUARE_THRESHOLD_LEN 48
+#endif
+
+// Scratch words needed by karatsuba for operands of len words (with recursion).
+#define KARATSUBA_SCRATCH_LEN(len) ((len) * 6 + 64)
+
 typedef uint32_t u32;
 typedef uint64_t u64;
 typedef int64_t i64;
@@ -56,7 +77,7 @@ void compact(MutableBigInt *a) {
     }
 }
 
-// For 1024/2048 bits crypt, size reserve for MutableBigInt is enough, the check is just for robust.
+// For 1024/2048/3072/4096 bits crypt, size reserve for MutableBigInt is enough, the check is just for robust.
 void checkSize(MutableBigInt *a, int needSize) {
     if (a->capacity >= needSize) {
         return;
@@ -232,7 +253,7 @@ int compareArray(const u32 *a, const u32 *b, int len) {
         u32 y = b[i];
         if (x < y)
             return -1;
-        if (y > x)
+        if (x > y)
             return 1;
     }
     return 0;
@@ -349,7 +370,7 @@ void bigIntRightShift(MutableBigInt *a, u32 n) {
         return;
     int bitsInHighWord = bitLengthForInt(a->value[a->offset]);
     if (nBits >= bitsInHighWord) {
-        primitiveRightShift(a->value + a->offset, a->intLen, 32 - nBits);
+        primitiveLeftShift(a->value + a->offset, a->intLen, 32 - nBits);
         a->intLen--;
     } else {
         primitiveRightShift(a->value + a->offset, a->intLen, nBits);
@@ -760,7 +781,177 @@ int intArrayCmpToLen(const u32 *arg1, const u32 *arg2, int len) {
     return 0;
 }
 
-void montReduce(u32 *n, int zlen, const u32 *mod, int mlen, u32 inv) {
+/**
+ * Adds b (bLen words) into the words of a ending at aEnd, the carry is propagated toward a[0].
+ */
+static void addInto(u32 *a, int aEnd, const u32 *b, int bLen) {
+    u64 carry = 0;
+    int i = aEnd - 1;
+    for (int j = bLen - 1; j >= 0; j--, i--) {
+        u64 sum = ((u64) a[i]) + ((u64) b[j]) + carry;
+        a[i] = (u32) sum;
+        carry = sum >> 32;
+    }
+    for (; carry != 0 && i >= 0; i--) {
+        a[i]++;
+        carry = (a[i] == 0);
+    }
+}
+
+/**
+ * Subtracts b (bLen words) from the words of a ending at aEnd, the borrow is propagated toward a[0].
+ * Assumes the result is not negative.
+ */
+static void subFrom(u32 *a, int aEnd, const u32 *b, int bLen) {
+    i64 sum = 0;
+    int i = aEnd - 1;
+    for (int j = bLen - 1; j >= 0; j--, i--) {
+        sum = (i64) ((u64) a[i]) - (i64) ((u64) b[j]) + (sum >> 32);
+        a[i] = (u32) sum;
+    }
+    for (; sum < 0 && i >= 0; i--) {
+        sum = (i64) ((u64) a[i]) + (sum >> 32);
+        a[i] = (u32) sum;
+    }
+}
+
+/**
+ * Splits x (len words) into the high part xh (hLen words) and the low part xl (len - hLen words),
+ * writes |xh - xl| to out (hLen words) and returns 1 if xh < xl.
+ */
+static int splitDiff(const u32 *x, int len, int hLen, u32 *out) {
+    const u32 *xl = x + hLen;
+    int lLen = len - hLen;
+    int ext = hLen - lLen;
+    int cmp = 0;
+    for (int i = 0; i < ext && cmp == 0; i++) {
+        cmp = x[i] != 0;
+    }
+    if (cmp == 0) {
+        cmp = intArrayCmpToLen(x + ext, xl, lLen);
+    }
+
+    memset(out, 0, ext << 2);
+    if (cmp >= 0) {
+        memcpy(out, x, hLen << 2);
+        subFrom(out, hLen, xl, lLen);
+        return 0;
+    } else {
+        memcpy(out + ext, xl, lLen << 2);
+        subFrom(out, hLen, x, hLen);
+        return 1;
+    }
+}
+
+void multiply(const u32 *x, const u32 *y, int len, u32 *z, u32 *scratch);
+
+void square(u32 *x, int len, u32 *z, u32 *scratch);
+
+/*
+ * Karatsuba with the subtractive middle term:
+ * x = xh * B^h + xl, y = yh * B^h + yl,
+ * x * y = z2 * B^2h + (z2 + z0 - (xh - xl) * (yh - yl)) * B^h + z0,
+ * where z2 = xh * yh, z0 = xl * yl.
+ * The differences take no carry, so all three sub products have the same size.
+ */
+static void karatsubaMultiply(const u32 *x, const u32 *y, int len, u32 *z, u32 *scratch) {
+    int h = len >> 1;
+    int hLen = len - h;
+    int pLen = hLen << 1;
+
+    u32 *dx = scratch;
+    u32 *dy = dx + hLen;
+    u32 *t = dy + hLen;
+    u32 *mid = t + pLen;
+    u32 *next = mid + pLen + 1;
+
+    // z0 takes the low 2h words of z and z2 takes the high 2*hLen words.
+    multiply(x, y, hLen, z, next);
+    if (h == hLen) {
+        multiply(x + hLen, y + hLen, h, z + pLen, next);
+    } else {
+        multiplyToLen(x + hLen, h, y + hLen, h, z + pLen);
+    }
+
+    int negative = splitDiff(x, len, hLen, dx) ^ splitDiff(y, len, hLen, dy);
+    multiply(dx, dy, hLen, t, next);
+
+    mid[0] = 0;
+    memcpy(mid + 1, z, pLen << 2);
+    addInto(mid, pLen + 1, z + pLen, h << 1);
+    if (negative) {
+        addInto(mid, pLen + 1, t, pLen);
+    } else {
+        subFrom(mid, pLen + 1, t, pLen);
+    }
+    addInto(z, (len << 1) - h, mid, pLen + 1);
+}
+
+/*
+ * Karatsuba square: x^2 = z2 * B^2h + (z2 + z0 - (xh - xl)^2) * B^h + z0.
+ */
+static void karatsubaSquare(u32 *x, int len, u32 *z, u32 *scratch) {
+    int h = len >> 1;
+    int hLen = len - h;
+    int pLen = hLen << 1;
+
+    u32 *dx = scratch;
+    u32 *t = dx + hLen;
+    u32 *mid = t + pLen;
+    u32 *next = mid + pLen + 1;
+
+    square(x, hLen, z, next);
+    if (h == hLen) {
+        square(x + hLen, h, z + pLen, next);
+    } else {
+        squareToLen(x + hLen, h, z + pLen, h << 1);
+    }
+
+    splitDiff(x, len, hLen, dx);
+    square(dx, hLen, t, next);
+
+    mid[0] = 0;
+    memcpy(mid + 1, z, pLen << 2);
+    addInto(mid, pLen + 1, z + pLen, h << 1);
+    subFrom(mid, pLen + 1, t, pLen);
+    addInto(z, (len << 1) - h, mid, pLen + 1);
+}
+
+/**
+ * z = x * y, x and y both have len words, z must have (len * 2) words.
+ * The scratch must have KARATSUBA_SCRATCH_LEN(len) words.
+ */
+void multiply(const u32 *x, const u32 *y, int len, u32 *z, u32 *scratch) {
+    if (len < KARATSUBA_THRESHOLD_LEN) {
+        multiplyToLen(x, len, y, len, z);
+    } else {
+        karatsubaMultiply(x, y, len, z, scratch);
+    }
+}
+
+/**
+ * z = x^2, x has len words, z must have (len * 2) words.
+ * The scratch must have KARATSUBA_SCRATCH_LEN(len) words.
+ */
+void square(u32 *x, int len, u32 *z, u32 *scratch) {
+    if (len < KARATSUBA_SQUARE_THRESHOLD_LEN) {
+        squareToLen(x, len, z, len << 1);
+    } else {
+        karatsubaSquare(x, len, z, scratch);
+    }
+}
+
+// Subtract the modulus until n < mod, c is the carry out of the reduction.
+static void montReduceFinal(u32 *n, const u32 *mod, int mlen, int c) {
+    while (c > 0)
+        c += subN(n, mod, mlen);
+
+    while (intArrayCmpToLen(n, mod, mlen) >= 0)
+        subN(n, mod, mlen);
+}
+
+// The word loop of montReduce, returns the carry out of the reduction.
+static int montReduceWords(u32 *n, int zlen, const u32 *mod, int mlen, u32 inv) {
     int c = 0;
     int len = mlen;
     int offset = 0;
@@ -772,103 +963,444 @@ void montReduce(u32 *n, int zlen, const u32 *mod, int mlen, u32 inv) {
         offset++;
     } while (--len > 0);
 
-    while (c > 0)
-        c += subN(n, mod, mlen);
+    return c;
+}
 
-    while (intArrayCmpToLen(n, mod, mlen) >= 0)
-        subN(n, mod, mlen);
+void montReduce(u32 *n, int zlen, const u32 *mod, int mlen, u32 inv) {
+    montReduceFinal(n, mod, mlen, montReduceWords(n, zlen, mod, mlen, inv));
+}
+
+/**
+ * mulAdd of the same input into two outputs with k1 and k2, the carries are returned by carry1 and carry2.
+ * The two carry chains are independent, so they run in parallel on the CPU, and the input is loaded once.
+ */
+static void mulAdd2(u32 *out1, u32 *out2, int outLen, const u32 *in, int offset, int len, u32 k1, u32 k2,
+                    u32 *carry1, u32 *carry2) {
+    u64 kLong1 = k1;
+    u64 kLong2 = k2;
+    u64 c1 = 0;
+    u64 c2 = 0;
+
+    offset = outLen - offset - 1;
+    for (int j = len - 1; j >= 0; j--) {
+        u64 x = in[j];
+        u64 product1 = x * kLong1 + ((u64) out1[offset]) + c1;
+        u64 product2 = x * kLong2 + ((u64) out2[offset]) + c2;
+        out1[offset] = product1;
+        out2[offset--] = product2;
+        c1 = product1 >> 32;
+        c2 = product2 >> 32;
+    }
+    *carry1 = (u32) c1;
+    *carry2 = (u32) c2;
+}
+
+/**
+ * montReduce of two products with the same modulus, interleaved word by word (see mulAdd2).
+ */
+static void montReduce2(u32 *n1, u32 *n2, int zlen, const u32 *mod, int mlen, u32 inv) {
+    int c1 = 0;
+    int c2 = 0;
+    for (int offset = 0; offset < mlen; offset++) {
+        u32 carry1, carry2;
+        mulAdd2(n1, n2, zlen, mod, offset, mlen, inv * n1[zlen - 1 - offset], inv * n2[zlen - 1 - offset],
+                &carry1, &carry2);
+        c1 += addOne(n1, zlen, offset, mlen, carry1);
+        c2 += addOne(n2, zlen, offset, mlen, carry2);
+    }
+
+    montReduceFinal(n1, mod, mlen, c1);
+    montReduceFinal(n2, mod, mlen, c2);
 }
 
-void montgomerySquare(u32 *x, const u32 *mod, int modLen, i64 inv, u32 *product) {
+void montgomerySquare(u32 *x, const u32 *mod, int modLen, i64 inv, u32 *product, u32 *scratch) {
     int zlen = modLen << 1;
-    squareToLen(x, modLen, product, zlen);
+    square(x, modLen, product, scratch);
     montReduce(product, zlen, mod, modLen, (int) inv);
 }
 
-void montgomeryMultiply(u32 *x, u32 *y, const u32 *mod, int modLen, i64 inv, u32 *product) {
+void montgomeryMultiply(u32 *x, u32 *y, const u32 *mod, int modLen, i64 inv, u32 *product, u32 *scratch) {
     int zlen = modLen << 1;
-    multiplyToLen(x, modLen, y, modLen, product);
+    multiply(x, y, modLen, product, scratch);
     montReduce(product, zlen, mod, modLen, (int) inv);
 }
 
-CryptResult modPow(const BigInt *base, const BigInt *exponent, const BigInt *modulus, BigInt *out) {
-    if (exponent->size == 1 && exponent->value[0] == 1) {
-        bigIntCopy(out, base);
-        return CRYPT_SUCCESS;
+/**
+ * montgomeryMultiply (the square if y is NULL) of modPowSecret: the modulus is subtracted once, selected by
+ * the mask of the carry and the borrow, rather than by the compare loops of montReduceFinal.
+ * x * y must be less than R * mod (one of them less than mod), so one subtraction is enough.
+ */
+static void montgomeryMultiplyMasked(u32 *x, u32 *y, const u32 *mod, int modLen, i64 inv, u32 *product,
+                                     u32 *scratch) {
+    int zlen = modLen << 1;
+    if (y == NULL) {
+        square(x, modLen, product, scratch);
+    } else {
+        multiply(x, y, modLen, product, scratch);
     }
+    u32 c = (u32) montReduceWords(product, zlen, mod, modLen, (u32) inv);
 
-    int modLen = modulus->size;
-    int expLen = exponent->size;
-    const u32 *p_mod = modulus->value;
-    const u32 *p_exp = exponent->value;
-    int modBytes = modLen << 2;
+    // The low half is free after the reduction, it takes product - mod.
+    u32 *diff = product + modLen;
+    i64 sum = 0;
+    for (int i = modLen - 1; i >= 0; i--) {
+        sum = (i64) ((u64) product[i]) - (i64) ((u64) mod[i]) + (sum >> 32);
+        diff[i] = (u32) sum;
+    }
+    u32 borrow = (u32) (sum >> 32) & 1;
+    u32 mask = (u32) 0 - (c | (borrow ^ 1));
+    for (int i = 0; i < modLen; i++) {
+        product[i] = (diff[i] & mask) | (product[i] & ~mask);
+    }
+}
+
+/**
+ * Two independent Montgomery multiplications x[i] * y[i], the reductions are interleaved by montReduce2.
+ * y is NULL for the squares.
+ */
+static void montgomeryMultiplyPair(u32 *x[2], u32 *y[2], const u32 *mod, int modLen, i64 inv, u32 *product[2],
+                                   u32 *scratch) {
+    for (int i = 0; i < 2; i++) {
+        if (y == NULL) {
+            square(x[i], modLen, product[i], scratch);
+        } else {
+            multiply(x[i], y[i], modLen, product[i], scratch);
+        }
+    }
+    montReduce2(product[0], product[1], modLen << 1, mod, modLen, (int) inv);
+}
+
+u32 *scratchAlloc(RSAScratch *scratch, int words) {
+    if (scratch->used + words > scratch->capacity) {
+        return NULL;
+    }
+    u32 *p = scratch->buffer + scratch->used;
+    scratch->used += words;
+    if (scratch->used > scratch->peak) {
+        scratch->peak = scratch->used;
+    }
+    return p;
+}
+
+int windowBits(int ebits) {
+    int wbits = 0;
+    while (ebits > bnExpModThreshTable[wbits]) {
+        wbits++;
+    }
+    return wbits;
+}
+
+/**
+ * The Montgomery setup of one modulus, computed once and shared by the exponentiations with it
+ * (the blocks crypted with one key, the Miller-Rabin rounds of one candidate).
+ */
+typedef struct {
+    u32 value[RSA_KEY_CAPACITY];
+    int size;
+    // -n^-1 mod 2^64
+    i64 inv;
+    // R^2 mod n, R = 2^(32 * size), takes size words
+    u32 rr[RSA_KEY_CAPACITY];
+#if RSA_AVX
+    AvxEngine engine;
+    // R'^2 mod n of the engine, takes size words
+    u32 avxRR[RSA_KEY_CAPACITY];
+#endif
+} Modulus;
+
+/**
+ * Words of scratch taken by reduceWords with the dividend of aLen words.
+ */
+static int reduceWordsScratchLen(int aLen) {
+    return aLen + 4;
+}
+
+/**
+ * out = a mod n, a takes aLen words and is changed, the out takes modLen words,
+ * with leading zeros if the value is shorter.
+ */
+static CryptResult reduceWords(u32 *a, int aLen, const u32 *mod, int modLen, u32 *out, RSAScratch *scratch) {
+    int mark = scratch->used;
+    u32 *rBuffer = scratchAlloc(scratch, reduceWordsScratchLen(aLen));
+    if (rBuffer == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+
+    MutableBigInt x, b, r;
+    initBigInt(&x, a, aLen, aLen);
+    initBigInt(&b, (u32 *) mod, modLen, modLen);
+    initBigInt(&r, rBuffer, 0, reduceWordsScratchLen(aLen));
+    normalize(&x);
+    normalize(&b);
+
+    int ret = divide(&x, &b, &r);
+    if (ret == CRYPT_SUCCESS) {
+        int rLen = r.intLen;
+        memset(out, 0, (modLen - rLen) << 2);
+        memcpy(out + (modLen - rLen), r.value + r.offset, rLen << 2);
+    }
+
+    scratch->used = mark;
+    return ret;
+}
+
+static int powerOfTwoModScratchLen(int bits) {
+    int aLen = (bits >> 5) + 1;
+    return aLen + reduceWordsScratchLen(aLen);
+}
+
+/**
+ * out = 2^bits mod n, the out takes modLen words, with leading zeros if the value is shorter.
+ */
+static CryptResult powerOfTwoMod(int bits, const u32 *mod, int modLen, u32 *out, RSAScratch *scratch) {
+    int aLen = (bits >> 5) + 1;
+    int mark = scratch->used;
+    u32 *aBuffer = scratchAlloc(scratch, aLen);
+    if (aBuffer == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    memset(aBuffer, 0, aLen << 2);
+    aBuffer[0] = 1 << (bits & 31);
+
+    int ret = reduceWords(aBuffer, aLen, mod, modLen, out, scratch);
+    scratch->used = mark;
+    return ret;
+}
+
+/**
+ * Words of scratch taken by initModulus, the dividends and remainders of the divisions.
+ */
+static int initModulusScratchLen(int modLen) {
+    int len = powerOfTwoModScratchLen(modLen << 6);
+#if RSA_AVX
+    AvxEngine engine = avx_engine();
+    if (engine != AVX_NONE) {
+        int vectorLen = powerOfTwoModScratchLen(avx_montgomery_bits(engine, modLen) << 1);
+        if (vectorLen > len) {
+            len = vectorLen;
+        }
+    }
+#endif
+    return len;
+}
+
+/**
+ * Set up the Montgomery constants of the modulus (odd, 2 words at least).
+ * It takes one division for R^2 mod n (and one more for R'^2 mod n of the AVX engine),
+ * the exponentiations with the modulus need no division then.
+ */
+static CryptResult initModulus(Modulus *m, const BigInt *mod, RSAScratch *scratch) {
+    int modLen = mod->size;
+    memcpy(m->value, mod->value, modLen << 2);
+    m->size = modLen;
 
     // Compute the modular inverse of the least significant 64-bit
     // digit of the modulus
-    i64 n0 = ((u64) p_mod[modLen - 1]) + (((u64) p_mod[modLen - 2]) << 32);
-    i64 inv = -inverseMod64(n0);
+    i64 n0 = ((u64) mod->value[modLen - 1]) + (((u64) mod->value[modLen - 2]) << 32);
+    m->inv = -inverseMod64(n0);
+
+    int ret = powerOfTwoMod(modLen << 6, m->value, modLen, m->rr, scratch);
+#if RSA_AVX
+    m->engine = avx_engine();
+    if (ret == CRYPT_SUCCESS && m->engine != AVX_NONE) {
+        ret = powerOfTwoMod(avx_montgomery_bits(m->engine, modLen) << 1, m->value, modLen, m->avxRR, scratch);
+    }
+#endif
+    return ret;
+}
 
-    // assert(modLen <= RSA_KEY_CAPACITY);
-    int doubleCapacity = RSA_KEY_CAPACITY << 1;
-    u32 aBuffer[doubleCapacity];
-    u32 bBuffer[doubleCapacity];
-    u32 rBuffer[doubleCapacity];
+#if RSA_AVX
 
-    memset(aBuffer, 0, doubleCapacity << 2);
-    memset(bBuffer, 0, doubleCapacity << 2);
+/**
+ * Words of scratch taken by modPowVector: the base, and the scratch of avx_mod_pow.
+ */
+static int modPowVectorScratchLen(AvxEngine engine, int modLen) {
+    return modLen + avx_scratch_len(engine, modLen);
+}
 
-    u32 *a = aBuffer;
-    int aLen = leftShift(base, modLen << 5, a);
+#endif
 
-    MutableBigInt a2, b2, r;
-    initBigInt(&a2, a, aLen, doubleCapacity);
-    initBigInt(&b2, modulus->value, modulus->size, modulus->size);
-    initBigInt(&r, rBuffer, 0, doubleCapacity);
-    normalize(&b2);
+/**
+ * Words of scratch taken by modPow, with the modulus of modLen words
+ * and the exponent with wbits window (see windowBits).
+ *
+ * table: modLen for each odd power, a, b: 2 * modLen, and the scratch for karatsuba.
+ */
+int modPowScratchLen(int modLen, int wbits) {
+    int len = ((1 << wbits) * modLen) + (modLen << 2) + KARATSUBA_SCRATCH_LEN(modLen);
+#if RSA_AVX
+    AvxEngine engine = avx_engine();
+    if (engine != AVX_NONE) {
+        int vectorLen = modPowVectorScratchLen(engine, modLen);
+        if (vectorLen > len) {
+            len = vectorLen;
+        }
+    }
+#endif
+    return len;
+}
 
-    int ret = divide(&a2, &b2, &r);
-    if (ret != CRYPT_SUCCESS) {
-        return ret;
+/**
+ * Words of scratch taken by modPowSmall:
+ * the base and its Montgomery form: modLen each, a, b: 2 * modLen, and the scratch for karatsuba.
+ */
+int modPowSmallScratchLen(int modLen) {
+    return (modLen << 1) + (modLen << 2) + KARATSUBA_SCRATCH_LEN(modLen);
+}
+
+// The window of modPowSecret (without the vector engine), the table takes 2^SECRET_WINDOW_BITS powers.
+#define SECRET_WINDOW_BITS 5
+
+/**
+ * Words of scratch taken by modPowSecret without the vector engine:
+ * the table, the entry selected, the base with leading zeros, a, b: 2 * modLen, and the scratch for karatsuba.
+ */
+static int modPowSecretScratchLen(int modLen) {
+    return (((1 << SECRET_WINDOW_BITS) + 2) * modLen) + (modLen << 2) + KARATSUBA_SCRATCH_LEN(modLen);
+}
+
+/**
+ * Words of scratch taken by modPowSmallPair: two of modPowSmall, with the scratch for karatsuba shared.
+ */
+static int modPowSmallPairScratchLen(int modLen) {
+    return (modPowSmallScratchLen(modLen) << 1) - KARATSUBA_SCRATCH_LEN(modLen);
+}
+
+/**
+ * Words of scratch taken by the blinding, the products of montgomeryMultiply (with the seed of the pair).
+ */
+static int blindingScratchLen(int modLen) {
+    return ((modLen << 1) + KARATSUBA_SCRATCH_LEN(modLen)) << 1;
+}
+
+/**
+ * Words of scratch taken by one crypt in the worst case: initModulus, then modPow with the largest window
+ * or modPowSecret (or modPowSmallPair for the batch).
+ */
+static int cryptScratchLen(int modLen) {
+    int initLen = initModulusScratchLen(modLen);
+    int powLen = modPowScratchLen(modLen, windowBits(modLen << 5));
+    int secretLen = modPowSecretScratchLen(modLen);
+    powLen = (powLen > secretLen ? powLen : secretLen) + blindingScratchLen(modLen);
+    int pairLen = modPowSmallPairScratchLen(modLen);
+    int len = initLen > powLen ? initLen : powLen;
+    return len > pairLen ? len : pairLen;
+}
+
+/**
+ * Convert base to Montgomery form: out = base * R mod n, by one Montgomery multiplication with R^2 mod n.
+ * The out takes modLen words. x (modLen words) takes the base with leading zeros,
+ * product takes 2 * modLen words, scratch takes KARATSUBA_SCRATCH_LEN(modLen) words.
+ */
+static void toMontgomery(const BigInt *base, const Modulus *modulus, u32 *out, u32 *x, u32 *product,
+                         u32 *scratch) {
+    int modLen = modulus->size;
+    int baseLen = base->size;
+    memset(x, 0, (modLen - baseLen) << 2);
+    memcpy(x + (modLen - baseLen), base->value, baseLen << 2);
+    montgomeryMultiply(x, (u32 *) modulus->rr, modulus->value, modLen, modulus->inv, product, scratch);
+    memcpy(out, product, modLen << 2);
+}
+
+#if RSA_AVX
+
+/**
+ * modPow with the vectorized Montgomery multiplication of rsa_avx.c.
+ * The engine takes its own Montgomery radix R', R'^2 mod n is computed by initModulus,
+ * base * R' is computed by the engine with one multiplication.
+ * The secret exponent takes the constant-time windows of avx_mod_pow, the public one the windows of its bits.
+ */
+static CryptResult modPowVector(const BigInt *base, const BigInt *exponent, const Modulus *modulus, BigInt *out,
+                                int secret, RSAScratch *scratch) {
+    AvxEngine engine = modulus->engine;
+    int modLen = modulus->size;
+    int mark = scratch->used;
+    if (scratch->used + modPowVectorScratchLen(engine, modLen) > scratch->capacity) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+
+    u32 *x = scratchAlloc(scratch, modLen);
+    memset(x, 0, (modLen - base->size) << 2);
+    memcpy(x + (modLen - base->size), base->value, base->size << 2);
+
+    u32 *powScratch = scratchAlloc(scratch, avx_scratch_len(engine, modLen));
+    avx_mod_pow(engine, x, modulus->avxRR, exponent->value, exponent->size, modulus->value, modLen, out->value,
+                secret, powScratch);
+    out->size = modLen;
+
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+#endif
+
+/**
+ * out = base ^ exponent mod modulus, for the public exponent: the time depends on the exponent
+ * (the sliding window, or the vectorized windows of its bits). The secret one takes modPowSecret.
+ */
+CryptResult modPow(const BigInt *base, const BigInt *exponent, const Modulus *modulus, BigInt *out,
+                   RSAScratch *scratch) {
+    if (exponent->size == 1 && exponent->value[0] == 1) {
+        bigIntCopy(out, base);
+        return CRYPT_SUCCESS;
+    }
+
+#if RSA_AVX
+    // The exponent of one word (65537) is cheaper by the scalar window than by the table of the engine.
+    if (modulus->engine != AVX_NONE && exponent->size > 1) {
+        return modPowVector(base, exponent, modulus, out, 0, scratch);
     }
+#endif
+
+    int modLen = modulus->size;
+    int expLen = exponent->size;
+    const u32 *p_mod = modulus->value;
+    const u32 *p_exp = exponent->value;
+    int modBytes = modLen << 2;
 
     // Select an appropriate window size
     int wbits = 0;
     int ebits = bitLength(exponent);
     // if exponent is 65537 (0x10001), use minimum window size
     if ((ebits != 17) || (p_exp[0] != 65537)) {
-        while (ebits > bnExpModThreshTable[wbits]) {
-            wbits++;
-        }
+        wbits = windowBits(ebits);
     }
 
-    // Allocate table for precomputed odd powers of base in Montgomery form
-    int table_size = 1 << wbits;
-    int tableCapacity = modLen << 1;
-    u32 *table_buffer = malloc((tableCapacity << 2) * table_size);
-    if (table_buffer == NULL) {
+    // Take all buffers from scratch, so the function does not touch the heap.
+    int mark = scratch->used;
+    if (scratch->used + modPowScratchLen(modLen, wbits) > scratch->capacity) {
         return FAILED_OUT_OF_MEMORY;
     }
 
+    // Table for precomputed odd powers of base in Montgomery form
+    int table_size = 1 << wbits;
+    u32 *table_buffer = scratchAlloc(scratch, table_size * modLen);
+
     // Max wbits is 6, so max table size will be 64
     u32 *table[64];
     u32 *p_table = table_buffer;
     for (int i = 0; i < table_size; i++) {
         table[i] = p_table;
-        p_table += tableCapacity;
+        p_table += modLen;
     }
 
-    int rLen = r.intLen;
-    memcpy(table[0], r.value + r.offset, rLen << 2);
-    if (rLen < modLen) {
-        memset(table[0] + rLen, 0, (modLen - rLen) << 2);
-    }
+    int productCapacity = modLen << 1;
+    u32 *aBuffer = scratchAlloc(scratch, productCapacity);
+    u32 *bBuffer = scratchAlloc(scratch, productCapacity);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    u32 *a = aBuffer;
+    i64 inv = modulus->inv;
+
+    toMontgomery(base, modulus, table[0], bBuffer, aBuffer, k_scratch);
 
     u32 *b = bBuffer;
-    montgomerySquare(table[0], p_mod, modLen, inv, b);
+    montgomerySquare(table[0], p_mod, modLen, inv, b, k_scratch);
 
+    // The product takes 2 * modLen words, so compute it in a and keep the first modLen words.
     u32 *t = b;
     for (int i = 1; i < table_size; i++) {
-        montgomeryMultiply(t, table[i - 1], p_mod, modLen, inv, table[i]);
+        montgomeryMultiply(t, table[i - 1], p_mod, modLen, inv, a, k_scratch);
+        memcpy(table[i], a, modBytes);
     }
 
     // Pre load the window that slides over the exponent
@@ -931,7 +1463,7 @@ CryptResult modPow(const BigInt *base, const BigInt *exponent, const BigInt *mod
                 isone = 0;
             } else {
                 t = b;
-                montgomeryMultiply(t, mult, p_mod, modLen, inv, a);
+                montgomeryMultiply(t, mult, p_mod, modLen, inv, a, k_scratch);
                 t = a;
                 a = b;
                 b = t;
@@ -945,7 +1477,7 @@ CryptResult modPow(const BigInt *base, const BigInt *exponent, const BigInt *mod
         // Square the input
         if (!isone) {
             t = b;
-            montgomerySquare(t, p_mod, modLen, inv, a);
+            montgomerySquare(t, p_mod, modLen, inv, a, k_scratch);
             t = a;
             a = b;
             b = t;
@@ -960,24 +1492,394 @@ CryptResult modPow(const BigInt *base, const BigInt *exponent, const BigInt *mod
     memcpy(out->value, t2, modBytes);
     out->size = modLen;
 
-    free(table_buffer);
+    scratch->used = mark;
 
     return CRYPT_SUCCESS;
 }
 
-void bytesToBigInt(const ByteArray *in, BigInt *out) {
-    uint8_t *bytes = in->value;
-    int byteLength = in->len;
+/**
+ * The window of bits [bit, bit + bits) of the exponent, the bits above the exponent are zero.
+ */
+static u32 exponentWindow(const BigInt *exponent, int bit, int bits) {
+    int expLen = exponent->size;
+    u32 w = 0;
+    for (int i = bit + bits - 1; i >= bit; i--) {
+        int word = i >> 5;
+        u32 b = word < expLen ? (exponent->value[expLen - 1 - word] >> (i & 31)) & 1 : 0;
+        w = (w << 1) | b;
+    }
+    return w;
+}
 
-    // Find first nonzero byte
-    int keep;
-    for (keep = 0; keep < byteLength && bytes[keep] == 0; keep++);
+/**
+ * out = table[index], reading all the entries of the table (modLen words each), so the cache lines touched
+ * do not depend on the (secret) index.
+ */
+static void selectPower(const u32 *table, int modLen, u32 index, u32 *out) {
+    memset(out, 0, modLen << 2);
+    for (u32 i = 0; i < (1 << SECRET_WINDOW_BITS); i++) {
+        u32 d = i ^ index;
+        // All ones if d == 0, else zero.
+        u32 mask = (u32) 0 - (((d | (0 - d)) >> 31) ^ 1);
+        const u32 *entry = table + i * modLen;
+        for (int j = 0; j < modLen; j++) {
+            out[j] |= entry[j] & mask;
+        }
+    }
+}
 
-    int intLength = ((byteLength - keep) + 3) >> 2;
-    out->size = intLength;
-    u32 *value = out->value;
-    if (value == NULL) {
-        return;
+/**
+ * out = base ^ exponent mod modulus, for the secret exponent (private key, CRT exponents, the inverse of
+ * the prime by the keygen), base must be less than R.
+ * The windows are the same for all the exponents up to the modulus size, each takes the multiplication,
+ * the table is read whole and the modulus is subtracted by the mask (montgomeryMultiplyMasked),
+ * so neither the sequence of the multiplications nor the cache lines touched depend on the exponent.
+ * The vector engine does the same with its own multiplication (avx_mod_pow).
+ */
+static CryptResult modPowSecret(const BigInt *base, const BigInt *exponent, const Modulus *modulus, BigInt *out,
+                                RSAScratch *scratch) {
+#if RSA_AVX
+    if (modulus->engine != AVX_NONE) {
+        return modPowVector(base, exponent, modulus, out, 1, scratch);
+    }
+#endif
+
+    int modLen = modulus->size;
+    const u32 *p_mod = modulus->value;
+    int modBytes = modLen << 2;
+    i64 inv = modulus->inv;
+
+    int mark = scratch->used;
+    if (scratch->used + modPowSecretScratchLen(modLen) > scratch->capacity) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    int tableSize = 1 << SECRET_WINDOW_BITS;
+    u32 *table = scratchAlloc(scratch, tableSize * modLen);
+    u32 *entry = scratchAlloc(scratch, modLen);
+    u32 *x = scratchAlloc(scratch, modLen);
+    int productCapacity = modLen << 1;
+    u32 *a = scratchAlloc(scratch, productCapacity);
+    u32 *b = scratchAlloc(scratch, productCapacity);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    u32 *t;
+
+    // table[0] = R mod n, table[1] = base * R mod n, table[i] = table[i - 1] * table[1]
+    memset(x, 0, modBytes);
+    x[modLen - 1] = 1;
+    montgomeryMultiplyMasked(x, (u32 *) modulus->rr, p_mod, modLen, inv, a, k_scratch);
+    memcpy(table, a, modBytes);
+    memset(x, 0, (modLen - base->size) << 2);
+    memcpy(x + (modLen - base->size), base->value, base->size << 2);
+    montgomeryMultiplyMasked(x, (u32 *) modulus->rr, p_mod, modLen, inv, a, k_scratch);
+    memcpy(table + modLen, a, modBytes);
+    for (int i = 2; i < tableSize; i++) {
+        montgomeryMultiplyMasked(table + (i - 1) * modLen, table + modLen, p_mod, modLen, inv, a, k_scratch);
+        memcpy(table + i * modLen, a, modBytes);
+    }
+
+    int expLen = exponent->size;
+    int ebits = (expLen > modLen ? expLen : modLen) << 5;
+
+    // Fixed window from the top, the top window takes the remainder bits.
+    int bit = ebits - (ebits % SECRET_WINDOW_BITS == 0 ? SECRET_WINDOW_BITS : ebits % SECRET_WINDOW_BITS);
+    selectPower(table, modLen, exponentWindow(exponent, bit, ebits - bit), b);
+    while (bit > 0) {
+        bit -= SECRET_WINDOW_BITS;
+        for (int i = 0; i < SECRET_WINDOW_BITS; i++) {
+            montgomeryMultiplyMasked(b, NULL, p_mod, modLen, inv, a, k_scratch);
+            t = a;
+            a = b;
+            b = t;
+        }
+        selectPower(table, modLen, exponentWindow(exponent, bit, SECRET_WINDOW_BITS), entry);
+        montgomeryMultiplyMasked(b, entry, p_mod, modLen, inv, a, k_scratch);
+        t = a;
+        a = b;
+        b = t;
+    }
+
+    // Out of Montgomery form, b * 1 / R
+    memset(entry, 0, modBytes);
+    entry[modLen - 1] = 1;
+    montgomeryMultiplyMasked(b, entry, p_mod, modLen, inv, a, k_scratch);
+    memcpy(out->value, a, modBytes);
+    out->size = modLen;
+
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+// The widest window of multiPow, 2^(MULTI_POW_MAX_WINDOW - 1) odd powers for each base.
+#define MULTI_POW_MAX_WINDOW 6
+
+/**
+ * The window width of multiPow for the exponent of ebits, the same as modPow (the window of wbits + 1 bits),
+ * but narrower for the long exponents, the tables of all bases are kept at once.
+ */
+static int multiPowWindow(int ebits) {
+    int w = windowBits(ebits) + 1;
+    return w < MULTI_POW_MAX_WINDOW ? w : MULTI_POW_MAX_WINDOW;
+}
+
+/**
+ * Words of scratch taken by multiPow with count bases and the exponents of maxBits at most:
+ * the tables, the window digits of each exponent (1 byte per bit), the base with leading zeros,
+ * a, b: 2 * modLen, and the scratch for karatsuba.
+ */
+static int multiPowScratchLen(int modLen, int count, int maxBits) {
+    int tableLen = (1 << (multiPowWindow(maxBits) - 1)) * modLen;
+    int digitsLen = (maxBits + 3) >> 2;
+    return count * (tableLen + digitsLen) + modLen + (modLen << 2) + KARATSUBA_SCRATCH_LEN(modLen);
+}
+
+/**
+ * Split the exponent into the sliding windows of w bits: digits[j] is the odd value of the window ending
+ * at the bit j (counted from the least significant bit), 0 if no window ends there.
+ */
+static void slidingWindows(const BigInt *exponent, int ebits, int w, uint8_t *digits) {
+    memset(digits, 0, ebits);
+    const u32 *p_exp = exponent->value;
+    int len = exponent->size;
+#define EXP_BIT(j) ((p_exp[len - 1 - ((j) >> 5)] >> ((j) & 31)) & 1)
+    int j = ebits - 1;
+    while (j >= 0) {
+        if (!EXP_BIT(j)) {
+            j--;
+            continue;
+        }
+        int low = j - w + 1 > 0 ? j - w + 1 : 0;
+        while (!EXP_BIT(low)) {
+            low++;
+        }
+        int value = 0;
+        for (int k = j; k >= low; k--) {
+            value = (value << 1) | EXP_BIT(k);
+        }
+        digits[low] = value;
+        j = low - 1;
+    }
+#undef EXP_BIT
+}
+
+/**
+ * out = base[0]^exponent[0] * base[1]^exponent[1] * ... mod n, with the interleaved sliding windows
+ * (Straus, Moller): each base has its table of odd powers and its windows, the squares are shared,
+ * so it takes the squares of the longest exponent once, rather than once per base as modPow.
+ * The bases are less than the modulus, count is RSA_BIGNUM_MAX_MULTI_POW at most,
+ * the exponents are RSA_BIGNUM_MAX_BYTES bytes at most. It is the scalar Montgomery code only.
+ */
+static CryptResult multiPow(const BigInt *bases, const BigInt *exponents, int count, const Modulus *modulus,
+                            BigInt *out, RSAScratch *scratch) {
+    int modLen = modulus->size;
+    const u32 *p_mod = modulus->value;
+    int modBytes = modLen << 2;
+    i64 inv = modulus->inv;
+
+    int maxBits = 0;
+    for (int i = 0; i < count; i++) {
+        int ebits = bitLength(&exponents[i]);
+        if (ebits > maxBits) {
+            maxBits = ebits;
+        }
+    }
+
+    int mark = scratch->used;
+    if (scratch->used + multiPowScratchLen(modLen, count, maxBits) > scratch->capacity) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    u32 *x = scratchAlloc(scratch, modLen);
+    u32 *aBuffer = scratchAlloc(scratch, modLen << 1);
+    u32 *bBuffer = scratchAlloc(scratch, modLen << 1);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+
+    // The odd powers of each base in Montgomery form: table[i] + k * modLen is base[i]^(2k + 1)
+    u32 *table[RSA_BIGNUM_MAX_MULTI_POW];
+    uint8_t *digits[RSA_BIGNUM_MAX_MULTI_POW];
+    int ebits[RSA_BIGNUM_MAX_MULTI_POW];
+    for (int i = 0; i < count; i++) {
+        ebits[i] = bitLength(&exponents[i]);
+        int w = multiPowWindow(ebits[i]);
+        int tableSize = 1 << (w - 1);
+        table[i] = scratchAlloc(scratch, tableSize * modLen);
+        digits[i] = (uint8_t *) scratchAlloc(scratch, (maxBits + 3) >> 2);
+        slidingWindows(&exponents[i], ebits[i], w, digits[i]);
+
+        toMontgomery(&bases[i], modulus, table[i], x, aBuffer, k_scratch);
+        if (tableSize > 1) {
+            // base^2, then base^3, base^5 ...
+            montgomerySquare(table[i], p_mod, modLen, inv, bBuffer, k_scratch);
+            memcpy(x, bBuffer, modBytes);
+            for (int k = 1; k < tableSize; k++) {
+                montgomeryMultiply(x, table[i] + (k - 1) * modLen, p_mod, modLen, inv, aBuffer, k_scratch);
+                memcpy(table[i] + k * modLen, aBuffer, modBytes);
+            }
+        }
+    }
+
+    u32 *a = aBuffer;
+    u32 *b = bBuffer;
+    u32 *t;
+    int isone = 1;
+    for (int j = maxBits - 1; j >= 0; j--) {
+        if (!isone) {
+            montgomerySquare(b, p_mod, modLen, inv, a, k_scratch);
+            t = a;
+            a = b;
+            b = t;
+        }
+        for (int i = 0; i < count; i++) {
+            if (j >= ebits[i] || digits[i][j] == 0) {
+                continue;
+            }
+            u32 *mult = table[i] + (digits[i][j] >> 1) * modLen;
+            if (isone) {
+                memcpy(b, mult, modBytes);
+                isone = 0;
+            } else {
+                montgomeryMultiply(b, mult, p_mod, modLen, inv, a, k_scratch);
+                t = a;
+                a = b;
+                b = t;
+            }
+        }
+    }
+
+    if (isone) {
+        // All the exponents are 0.
+        memset(out->value, 0, modBytes);
+        out->value[modLen - 1] = 1;
+    } else {
+        // Convert result out of Montgomery form
+        memset(a, 0, modBytes);
+        memcpy(a + modLen, b, modBytes);
+        montReduce(a, modLen << 1, p_mod, modLen, (int) inv);
+        memcpy(out->value, a, modBytes);
+    }
+    out->size = modLen;
+
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Modular exponentiation for a small odd exponent (e > 1, one word), such as the public exponent 65537.
+ *
+ * It takes no window table: square and multiply by the base in Montgomery form from the top bit,
+ * the last multiply takes the base in normal form, which also converts the result out of Montgomery form
+ * (a^(e-1) * R * a / R = a^e). So e = 65537 costs 16 squares and 1 multiply.
+ */
+CryptResult modPowSmall(const BigInt *base, u32 e, const Modulus *modulus, BigInt *out, RSAScratch *scratch) {
+    int modLen = modulus->size;
+    const u32 *p_mod = modulus->value;
+    int modBytes = modLen << 2;
+
+    int mark = scratch->used;
+    if (scratch->used + modPowSmallScratchLen(modLen) > scratch->capacity) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    u32 *x = scratchAlloc(scratch, modLen);
+    u32 *xMont = scratchAlloc(scratch, modLen);
+    int productCapacity = modLen << 1;
+    u32 *a = scratchAlloc(scratch, productCapacity);
+    u32 *b = scratchAlloc(scratch, productCapacity);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    u32 *t;
+    i64 inv = modulus->inv;
+
+    // x takes the base with leading zeros
+    toMontgomery(base, modulus, xMont, x, a, k_scratch);
+
+    memcpy(b, xMont, modBytes);
+    for (int i = bitLengthForInt(e) - 2; i >= 0; i--) {
+        montgomerySquare(b, p_mod, modLen, inv, a, k_scratch);
+        t = a;
+        a = b;
+        b = t;
+        if (i == 0 || ((e >> i) & 1) != 0) {
+            montgomeryMultiply(b, i == 0 ? x : xMont, p_mod, modLen, inv, a, k_scratch);
+            t = a;
+            a = b;
+            b = t;
+        }
+    }
+
+    memcpy(out->value, b, modBytes);
+    out->size = modLen;
+
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * modPowSmall of two bases in lockstep, the squares and multiplies of the two run one after the other,
+ * and their Montgomery reductions are interleaved (montgomeryMultiplyPair), which keeps more of the CPU busy
+ * than two modPowSmall calls.
+ */
+CryptResult modPowSmallPair(const BigInt *base[2], u32 e, const Modulus *modulus, BigInt *out[2],
+                            RSAScratch *scratch) {
+    int modLen = modulus->size;
+    const u32 *p_mod = modulus->value;
+    int modBytes = modLen << 2;
+
+    int mark = scratch->used;
+    if (scratch->used + modPowSmallPairScratchLen(modLen) > scratch->capacity) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    u32 *x[2], *xMont[2], *a[2], *b[2];
+    int productCapacity = modLen << 1;
+    for (int i = 0; i < 2; i++) {
+        x[i] = scratchAlloc(scratch, modLen);
+        xMont[i] = scratchAlloc(scratch, modLen);
+        a[i] = scratchAlloc(scratch, productCapacity);
+        b[i] = scratchAlloc(scratch, productCapacity);
+    }
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    u32 *t;
+    i64 inv = modulus->inv;
+
+    for (int i = 0; i < 2; i++) {
+        toMontgomery(base[i], modulus, xMont[i], x[i], a[i], k_scratch);
+        memcpy(b[i], xMont[i], modBytes);
+    }
+    for (int i = bitLengthForInt(e) - 2; i >= 0; i--) {
+        montgomeryMultiplyPair(b, NULL, p_mod, modLen, inv, a, k_scratch);
+        for (int j = 0; j < 2; j++) {
+            t = a[j];
+            a[j] = b[j];
+            b[j] = t;
+        }
+        if (i == 0 || ((e >> i) & 1) != 0) {
+            montgomeryMultiplyPair(b, i == 0 ? x : xMont, p_mod, modLen, inv, a, k_scratch);
+            for (int j = 0; j < 2; j++) {
+                t = a[j];
+                a[j] = b[j];
+                b[j] = t;
+            }
+        }
+    }
+
+    for (int i = 0; i < 2; i++) {
+        memcpy(out[i]->value, b[i], modBytes);
+        out[i]->size = modLen;
+    }
+
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+void bytesToBigInt(const ByteArray *in, BigInt *out) {
+    uint8_t *bytes = in->value;
+    int byteLength = in->len;
+
+    // Find first nonzero byte
+    int keep;
+    for (keep = 0; keep < byteLength && bytes[keep] == 0; keep++);
+
+    int intLength = ((byteLength - keep) + 3) >> 2;
+    out->size = intLength;
+    u32 *value = out->value;
+    if (value == NULL) {
+        return;
     }
     int b = byteLength - 1;
     for (int i = intLength - 1; i >= 0; i--) {
@@ -1031,14 +1933,85 @@ void paddingInput(uint8_t *block, int blockSize, int dataLen, KeyType type) {
     block[2 + paddingLen] = 0;
 }
 
+static pthread_key_t scratch_key;
+static pthread_once_t scratch_once = PTHREAD_ONCE_INIT;
+
+// Peak scratch words of one crypt, for the keys with 1024/2048/3072/4096 bits.
+static int scratch_peaks[4];
+
+static void createScratchKey() {
+    // The scratch and its buffer are allocated in one block, free it when the thread exits.
+    pthread_key_create(&scratch_key, free);
+}
+
+/**
+ * Returns the scratch of the current thread, with capacity at least words.
+ * The scratch is allocated by the first call on the thread (or when a larger key comes),
+ * then reused by the later calls, so the crypt itself does not touch the heap.
+ */
+static RSAScratch *threadScratch(int words) {
+    pthread_once(&scratch_once, createScratchKey);
+    RSAScratch *scratch = pthread_getspecific(scratch_key);
+    if (scratch == NULL || scratch->capacity < words) {
+        RSAScratch *newScratch = malloc(sizeof(RSAScratch) + (words << 2));
+        if (newScratch == NULL) {
+            return NULL;
+        }
+        rsa_scratch_init(newScratch, newScratch + 1, words << 2);
+        if (scratch != NULL) {
+            newScratch->peak = scratch->peak;
+            free(scratch);
+        }
+        pthread_setspecific(scratch_key, newScratch);
+        scratch = newScratch;
+    }
+    return scratch;
+}
+
+static void recordPeak(int modLen, int words) {
+    int *peak = &scratch_peaks[(modLen >> 5) - 1];
+    int old = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (old < words &&
+           !__atomic_compare_exchange_n(peak, &old, words, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void rsa_scratch_init(RSAScratch *scratch, void *buffer, int size) {
+    scratch->buffer = (u32 *) buffer;
+    scratch->capacity = size >> 2;
+    scratch->used = 0;
+    scratch->peak = 0;
+}
+
+int rsa_scratch_size(int modulusBits) {
+    int modLen = (modulusBits + 31) >> 5;
+    if (modLen < 2 || modLen > (RSA_KEY_CAPACITY - 4)) {
+        return 0;
+    }
+    return cryptScratchLen(modLen) << 2;
+}
+
+int rsa_scratch_peak(int modulusBits) {
+    if (modulusBits != 1024 && modulusBits != 2048 && modulusBits != 3072 && modulusBits != 4096) {
+        return 0;
+    }
+    return __atomic_load_n(&scratch_peaks[(modulusBits >> 10) - 1], __ATOMIC_RELAXED) << 2;
+}
+
 CryptResult rsa_crypt(const ByteArray *input,
                       const RSAKey *key,
                       const CipherMode mode,
                       ByteArray *output) {
+    return rsa_crypt_with_scratch(input, key, mode, output, NULL);
+}
+
+/**
+ * Read the exponent and modulus of the key.
+ * Only accept keys with 1024/2048/3072/4096 bits, modulus must be odd,
+ * exponent must not be zero, and must less then modulus.
+ */
+static CryptResult loadKey(const RSAKey *key, BigInt *exp, BigInt *mod) {
     const int sizeLimit = RSA_KEY_CAPACITY << 2;
-    if (input == NULL || input->len > sizeLimit || output == NULL) {
-        return FAILED_INVALID_INPUT;
-    }
     if (key == NULL) {
         return FAILED_INVALID_KEY;
     }
@@ -1051,64 +2024,229 @@ CryptResult rsa_crypt(const ByteArray *input,
         return FAILED_INVALID_KEY;
     }
 
-    u32 buffer[4][RSA_KEY_CAPACITY];
-    BigInt base, exp, mod, result;
-    base.value = buffer[0];
-    exp.value = buffer[1];
-    mod.value = buffer[2];
-    result.value = buffer[3];
-
-    bytesToBigInt(exponent, &exp);
-    bytesToBigInt(modulus, &mod);
-
-    // Only accept keys with 1024 bits or 2048 bits.
-    // Modulus must be odd.
-    // Exponent must not be zero.
-    // Exponent must less then modulus.
-    int modLen = mod.size;
-    if ((modLen != 32 && modLen != 64) ||
-        (mod.value[modLen - 1] & 1) == 0
-        || exp.size == 0
-        || compareBigInt(&exp, &mod) >= 0) {
+    bytesToBigInt(exponent, exp);
+    bytesToBigInt(modulus, mod);
+
+    int modLen = mod->size;
+    if ((modLen != 32 && modLen != 64 && modLen != 96 && modLen != 128) ||
+        (mod->value[modLen - 1] & 1) == 0
+        || exp->size == 0
+        || compareBigInt(exp, mod) >= 0) {
         return FAILED_INVALID_KEY;
     }
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * One prime of the CRT key with its Montgomery setup.
+ */
+typedef struct {
+    Modulus prime;
+    // d mod (prime - 1)
+    u32 exponent[RSA_KEY_CAPACITY];
+    int expLen;
+    // The coefficient in Montgomery form (coefficient * R mod prime), takes the prime size words.
+    u32 coefficient[RSA_KEY_CAPACITY];
+    // The product of the primes before this one in the recombination, without leading zeros.
+    u32 product[RSA_KEY_CAPACITY];
+    int productLen;
+} CrtPrime;
+
+/**
+ * A key ready for the crypt: the exponent, and the modulus with its Montgomery setup.
+ * It is loaded once, then shared (read only) by all the blocks crypted with the key, on any thread.
+ */
+typedef struct {
+    u32 exponent[RSA_KEY_CAPACITY];
+    int expLen;
+    Modulus modulus;
+    KeyType keyType;
+    // The public exponent of the private key, publicLen is 0 if unknown.
+    u32 publicExponent[RSA_KEY_CAPACITY];
+    int publicLen;
+    // The primes of the private key with the CRT params, in the order of the recombination: q, p, r_3 ...
+    // 0 to crypt with the exponent.
+    int primeCount;
+    CrtPrime primes[RSA_MAX_PRIMES];
+    // Run the exponentiations of the primes concurrently, see crtPow.
+    int parallel;
+} RSAContext;
+
+/**
+ * Returns the scratch for the crypt with the modulus of modLen words,
+ * the scratch of the calling thread if the given one is NULL.
+ */
+static RSAScratch *cryptScratch(RSAScratch *scratch, int modLen) {
+    return scratch != NULL ? scratch : threadScratch(cryptScratchLen(modLen));
+}
+
+/**
+ * The BigInt view of a (len words) without the leading zeros.
+ */
+static BigInt trimmed(u32 *a, int len) {
+    int i = 0;
+    while (i < len && a[i] == 0) {
+        i++;
+    }
+    BigInt b;
+    b.value = a + i;
+    b.size = len - i;
+    return b;
+}
 
-    if (compareBigInt(&exp, &mod) >= 0) {
+/**
+ * Read the CRT params (see RSACrtParams) and set up the primes.
+ * Each prime must be odd with 2 words at least, its exponent and coefficient must be less than it,
+ * and the product of the primes must be the modulus.
+ */
+static CryptResult loadCrt(const RSACrtParams *crt, const BigInt *mod, RSAContext *ctx, RSAScratch *scratch) {
+    const int sizeLimit = RSA_KEY_CAPACITY << 2;
+    int count = crt->count;
+    if (count < 2 || count > RSA_MAX_PRIMES) {
         return FAILED_INVALID_KEY;
     }
+    u32 product[RSA_KEY_CAPACITY], next[RSA_KEY_CAPACITY];
+    int productLen = 0;
+    for (int k = 0; k < count; k++) {
+        // q starts the recombination, then p (with qInv), then the other primes.
+        int index = k == 0 ? 1 : (k == 1 ? 0 : k);
+        ByteArray *prime = crt->primes[index];
+        ByteArray *exponent = crt->exponents[index];
+        ByteArray *coefficient = crt->coefficients[index];
+        if (prime == NULL || exponent == NULL || prime->len > sizeLimit || exponent->len > sizeLimit ||
+            (k > 0 && (coefficient == NULL || coefficient->len > sizeLimit))) {
+            return FAILED_INVALID_KEY;
+        }
 
-    int blockSize = modLen << 2;
-    int inputLen = input->len;
-    if (mode == ENCRYPT) {
-        if (inputLen > (blockSize - 11)) {
-            return FAILED_INPUT_TOO_LARGE;
+        CrtPrime *cp = &ctx->primes[k];
+        u32 buffer[2][RSA_KEY_CAPACITY];
+        BigInt p, e, c;
+        p.value = buffer[0];
+        e.value = cp->exponent;
+        c.value = buffer[1];
+        bytesToBigInt(prime, &p);
+        bytesToBigInt(exponent, &e);
+        int len = p.size;
+        if (len < 2 || (p.value[len - 1] & 1) == 0 || e.size == 0 || compareBigInt(&e, &p) >= 0 ||
+            productLen + len > RSA_KEY_CAPACITY) {
+            return FAILED_INVALID_KEY;
         }
-    } else {
-        if (inputLen != blockSize) {
-            return FAILED_INVALID_INPUT;
+        cp->expLen = e.size;
+        int ret = initModulus(&cp->prime, &p, scratch);
+        if (ret != CRYPT_SUCCESS) {
+            return ret;
+        }
+
+        if (k > 0) {
+            bytesToBigInt(coefficient, &c);
+            if (c.size == 0 || compareBigInt(&c, &p) >= 0) {
+                return FAILED_INVALID_KEY;
+            }
+            // coefficient * R = coefficient * R^2 / R
+            int mark = scratch->used;
+            u32 *x = scratchAlloc(scratch, len);
+            u32 *t = scratchAlloc(scratch, len << 1);
+            u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(len));
+            if (k_scratch == NULL) {
+                scratch->used = mark;
+                return FAILED_OUT_OF_MEMORY;
+            }
+            toMontgomery(&c, &cp->prime, cp->coefficient, x, t, k_scratch);
+            scratch->used = mark;
+
+            memcpy(cp->product, product, productLen << 2);
+            cp->productLen = productLen;
+            multiplyToLen(product, productLen, p.value, len, next);
+            BigInt t2 = trimmed(next, productLen + len);
+            memcpy(product, t2.value, t2.size << 2);
+            productLen = t2.size;
+        } else {
+            memcpy(product, p.value, len << 2);
+            productLen = len;
         }
     }
 
-    if (mode == ENCRYPT) {
-        uint8_t block[256];
-        paddingInput(block, blockSize, inputLen, key->key_type);
-        memcpy(block + (blockSize - inputLen), input->value, inputLen);
-        ByteArray tmp;
-        tmp.value = block;
-        tmp.len = blockSize;
-        bytesToBigInt(&tmp, &base);
-    } else {
-        bytesToBigInt(input, &base);
+    BigInt all = {product, productLen};
+    if (compareBigInt(&all, mod) != 0) {
+        return FAILED_INVALID_KEY;
+    }
+    ctx->primeCount = count;
+    ctx->parallel = crt->parallel;
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Read the public exponent of the private key, it must be odd, larger than 1 and less than the modulus.
+ * The key with the CRT params must have it.
+ */
+static CryptResult loadPublicExponent(const RSAKey *key, const BigInt *mod, RSAContext *ctx) {
+    ctx->publicLen = 0;
+    if (key->key_type != PRIVATE_KEY || key->publicExponent == NULL) {
+        return key->key_type == PRIVATE_KEY && key->crt != NULL ? FAILED_INVALID_KEY : CRYPT_SUCCESS;
+    }
+    if (key->publicExponent->len > RSA_KEY_CAPACITY << 2) {
+        return FAILED_INVALID_KEY;
+    }
+    BigInt e;
+    e.value = ctx->publicExponent;
+    bytesToBigInt(key->publicExponent, &e);
+    if (e.size == 0 || (e.value[e.size - 1] & 1) == 0 || (e.size == 1 && e.value[0] == 1) ||
+        compareBigInt(&e, mod) >= 0) {
+        return FAILED_INVALID_KEY;
     }
+    ctx->publicLen = e.size;
+    return CRYPT_SUCCESS;
+}
 
-    if (compareBigInt(&base, &mod) > 0) {
-        return FAILED_INVALID_INPUT;
+/**
+ * Load the key (see loadKey) and set up its modulus, and the primes of the private key with the CRT params.
+ */
+static CryptResult loadContext(const RSAKey *key, RSAContext *ctx, RSAScratch *scratch) {
+    u32 buffer[RSA_KEY_CAPACITY];
+    BigInt exp, mod;
+    exp.value = ctx->exponent;
+    mod.value = buffer;
+    int ret = loadKey(key, &exp, &mod);
+    if (ret == CRYPT_SUCCESS) {
+        ret = loadPublicExponent(key, &mod, ctx);
+    }
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
     }
+    ctx->expLen = exp.size;
+    ctx->keyType = key->key_type;
+    ctx->primeCount = 0;
+    ctx->parallel = 0;
 
-    int ret = modPow(&base, &exp, &mod, &result);
+    scratch = cryptScratch(scratch, mod.size);
+    if (scratch == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    ret = initModulus(&ctx->modulus, &mod, scratch);
+    if (ret == CRYPT_SUCCESS && key->crt != NULL && key->key_type == PRIVATE_KEY) {
+        ret = loadCrt(key->crt, &mod, ctx, scratch);
+    }
+    return ret;
+}
+
+/**
+ * Read the block (the block size bytes) to out, the block must not be larger than the modulus.
+ */
+static CryptResult loadBlock(const uint8_t *block, const Modulus *modulus, BigInt *out) {
+    ByteArray in;
+    in.value = (uint8_t *) block;
+    in.len = modulus->size << 2;
+    bytesToBigInt(&in, out);
+    BigInt mod = {(u32 *) modulus->value, modulus->size};
+    return compareBigInt(out, &mod) > 0 ? FAILED_INVALID_INPUT : CRYPT_SUCCESS;
+}
 
-    uint8_t *p = output->value;
-    u32 *r = result.value;
+/**
+ * Write the result (modLen words) to the block.
+ */
+static void storeBlock(const BigInt *result, int modLen, uint8_t *out) {
+    uint8_t *p = out;
+    u32 *r = result->value;
     for (int i = 0; i < modLen; i++) {
         u32 x = r[i];
         p[0] = x >> 24;
@@ -1117,42 +2255,2260 @@ CryptResult rsa_crypt(const ByteArray *input,
         p[3] = x;
         p += 4;
     }
+}
 
-    if (mode == ENCRYPT) {
-        output->len = blockSize;
-    } else {
-        p = output->value;
-        // check if the first bytes is 0, and encrypt type is different to decrypt key
-        KeyType encryptType = (key->key_type == PRIVATE_KEY) ? PUBLIC_KEY : PRIVATE_KEY;
-        if (!(p[0] == 0 && p[1] == encryptType)) {
-            return FAILED_INVALID_INPUT;
-        }
-        int i = 2;
-        for (; i < blockSize && p[i] != 0; i++) {
-        }
+/**
+ * The public exponent is small (65537 mostly), it takes the path without window table.
+ */
+static int isSmallExponent(const RSAContext *ctx) {
+    u32 e = ctx->exponent[0];
+    return ctx->primeCount == 0 && ctx->expLen == 1 && (e & 1) != 0 && e != 1;
+}
 
-        int valid = 1;
-        if (i < 10 || i == blockSize) {
-            valid = 0;
-        } else {
-            if (encryptType == PRIVATE_KEY) {
-                for (int j = 2; j < i; j++) {
-                    if (p[j] != 0xFF) {
-                        valid = 0;
-                        break;
-                    }
-                }
-            }
-        }
-        if (valid != 1) {
-            return FAILED_INVALID_INPUT;
-        }
-        i++;
-        output->len = blockSize - i;
-        if (blockSize != i) {
-            memmove(output->value, p + i, output->len);
-        }
+/**
+ * Words of scratch taken by primePow with the base of baseLen words and the prime of len words:
+ * reduceWords, then modPowSecret.
+ */
+static int primePowScratchLen(int baseLen, int len) {
+    int reduceLen = reduceWordsScratchLen(baseLen);
+    int powLen = modPowScratchLen(len, 0);
+    int secretLen = modPowSecretScratchLen(len);
+    powLen = powLen > secretLen ? powLen : secretLen;
+    return reduceLen > powLen ? reduceLen : powLen;
+}
+
+/**
+ * out = (base mod prime) ^ d_i mod prime, out takes the prime size words.
+ */
+static CryptResult primePow(const BigInt *base, const CrtPrime *cp, u32 *out, RSAScratch *scratch) {
+    const Modulus *prime = &cp->prime;
+    u32 t[RSA_KEY_CAPACITY], x[RSA_KEY_CAPACITY];
+    memcpy(t, base->value, base->size << 2);
+    int ret = reduceWords(t, base->size, prime->value, prime->size, x, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    BigInt c = {x, prime->size}, e = {(u32 *) cp->exponent, cp->expLen}, r = {out, 0};
+    return modPowSecret(&c, &e, prime, &r, scratch);
+}
+
+typedef struct {
+    const BigInt *base;
+    const RSAContext *ctx;
+    u32 (*results)[RSA_KEY_CAPACITY];
+    // The slice of the caller's scratch for each task, no task touches the scratch of its thread.
+    RSAScratch scratches[RSA_MAX_PRIMES];
+    CryptResult rets[RSA_MAX_PRIMES];
+} CrtJob;
+
+static void primePowTask(void *arg, int k) {
+    CrtJob *job = (CrtJob *) arg;
+    job->rets[k] = primePow(job->base, &job->ctx->primes[k], job->results[k], &job->scratches[k]);
+}
+
+/**
+ * Cut the slices of the tasks from the scratch (left taken until the caller gives them back).
+ * Returns 0 if the scratch has no room for them.
+ */
+static int sliceScratch(RSAScratch *scratch, const BigInt *base, const RSAContext *ctx, RSAScratch *slices) {
+    int words = 0;
+    for (int k = 0; k < ctx->primeCount; k++) {
+        words += primePowScratchLen(base->size, ctx->primes[k].prime.size);
+    }
+    if (scratch->used + words > scratch->capacity) {
+        return 0;
+    }
+    for (int k = 0; k < ctx->primeCount; k++) {
+        int len = primePowScratchLen(base->size, ctx->primes[k].prime.size);
+        rsa_scratch_init(&slices[k], scratchAlloc(scratch, len), len << 2);
+    }
+    return 1;
+}
+
+/**
+ * out = base ^ d mod n by the CRT params, with Garner's recombination as RFC 8017 5.1.2:
+ * m = base ^ dQ mod q, then for p, r_3 ...: h = (base ^ d_i - m) * coefficient mod prime, m = m + product * h,
+ * the product is of the primes before. Each exponentiation is on the size of one prime,
+ * so the cost is about 2/count^2 of modPow with d (3 primes are cheaper than 2).
+ *
+ * With the parallel flag of the key, the exponentiations of the primes run on the thread pool (one task per
+ * prime, the calling thread takes one of them), and the recombination runs after they join.
+ * Each task takes its own slice of the scratch (sliceScratch); if the scratch has no room for them,
+ * the primes run one by one.
+ */
+static CryptResult crtPow(const BigInt *base, const RSAContext *ctx, BigInt *out, RSAScratch *scratch) {
+    int modLen = ctx->modulus.size;
+    u32 *m = out->value;
+    u32 ys[RSA_MAX_PRIMES][RSA_KEY_CAPACITY];
+    u32 t[RSA_KEY_CAPACITY], x[RSA_KEY_CAPACITY];
+    out->size = modLen;
+
+    int ret = CRYPT_SUCCESS;
+    int sliceMark = scratch->used;
+    CrtJob job;
+    if (ctx->parallel && sliceScratch(scratch, base, ctx, job.scratches)) {
+        job.base = base;
+        job.ctx = ctx;
+        job.results = ys;
+        thread_pool_run(primePowTask, &job, ctx->primeCount);
+        scratch->used = sliceMark;
+        for (int k = 0; k < ctx->primeCount && ret == CRYPT_SUCCESS; k++) {
+            ret = job.rets[k];
+        }
+    } else {
+        for (int k = 0; k < ctx->primeCount && ret == CRYPT_SUCCESS; k++) {
+            ret = primePow(base, &ctx->primes[k], ys[k], scratch);
+        }
+    }
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+
+    memset(m, 0, modLen << 2);
+    for (int k = 0; k < ctx->primeCount; k++) {
+        const CrtPrime *cp = &ctx->primes[k];
+        const Modulus *prime = &cp->prime;
+        int len = prime->size;
+        u32 *y = ys[k];
+        if (k == 0) {
+            memcpy(m + (modLen - len), y, len << 2);
+            continue;
+        }
+
+        // y = (y - m mod prime) mod prime
+        memcpy(t, m, modLen << 2);
+        ret = reduceWords(t, modLen, prime->value, len, x, scratch);
+        if (ret != CRYPT_SUCCESS) {
+            return ret;
+        }
+        if (subN(y, x, len)) {
+            addInto(y, len, prime->value, len);
+        }
+
+        // h = y * coefficient mod prime
+        int mark = scratch->used;
+        u32 *h = scratchAlloc(scratch, len << 1);
+        u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(len));
+        // m = m + product * h, which is less than n, so the words above modLen are zeros.
+        u32 *p = scratchAlloc(scratch, cp->productLen + len);
+        if (k_scratch == NULL || p == NULL) {
+            scratch->used = mark;
+            return FAILED_OUT_OF_MEMORY;
+        }
+        montgomeryMultiply(y, (u32 *) cp->coefficient, prime->value, len, prime->inv, h, k_scratch);
+        multiplyToLen(cp->product, cp->productLen, h, len, p);
+        int pLen = cp->productLen + len;
+        if (pLen > modLen) {
+            p += pLen - modLen;
+            pLen = modLen;
+        }
+        addInto(m, modLen, p, pLen);
+        scratch->used = mark;
+    }
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Record the scratch taken since used (with the peak of the scratch before, see rawCrypt).
+ */
+static void recordCrypt(RSAScratch *scratch, int modLen, int used, int peak) {
+    recordPeak(modLen, scratch->peak - used);
+    if (scratch->peak < peak) {
+        scratch->peak = peak;
+    }
+}
+
+/**
+ * out = base ^ e mod n with the public exponent of the private key.
+ */
+static CryptResult publicPow(const BigInt *base, const RSAContext *ctx, BigInt *out, RSAScratch *scratch) {
+    if (ctx->publicLen == 1) {
+        return modPowSmall(base, ctx->publicExponent[0], &ctx->modulus, out, scratch);
+    }
+    BigInt e = {(u32 *) ctx->publicExponent, ctx->publicLen};
+    return modPow(base, &e, &ctx->modulus, out, scratch);
+}
+
+/**
+ * Check the result of the private exponentiation with the public exponent, out^e mod n must be the base.
+ * A fault in one prime of the CRT (a glitch, a bit flip) gives a result which is right mod the other primes,
+ * and the gcd of its difference with the right one and n tells the prime (the Bellcore attack),
+ * so the result must not leave the library unchecked. It costs about one public-key operation.
+ * Returns FAILED_INVALID_KEY on the mismatch: the fault, or the key whose exponents do not match.
+ */
+static CryptResult checkPrivatePow(const BigInt *base, const RSAContext *ctx, const BigInt *out,
+                                   RSAScratch *scratch) {
+    u32 buffer[RSA_KEY_CAPACITY];
+    BigInt check = {buffer, 0};
+    BigInt x = trimmed(out->value, out->size);
+    int ret = publicPow(&x, ctx, &check, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    BigInt expected = trimmed(base->value, base->size), actual = trimmed(check.value, check.size);
+    return compareBigInt(&expected, &actual) == 0 ? CRYPT_SUCCESS : FAILED_INVALID_KEY;
+}
+
+/**
+ * The private exponentiation of the key: the CRT with the primes, or modPow with the exponent,
+ * with the result checked by the public exponent if the key has it (always with the CRT).
+ */
+static CryptResult privatePow(const BigInt *base, const RSAContext *ctx, BigInt *out, RSAScratch *scratch) {
+    int ret;
+    if (ctx->primeCount > 0) {
+        ret = crtPow(base, ctx, out, scratch);
+    } else {
+        BigInt exp = {(u32 *) ctx->exponent, ctx->expLen};
+        ret = modPowSecret(base, &exp, &ctx->modulus, out, scratch);
+    }
+    if (ret == CRYPT_SUCCESS && ctx->publicLen > 0) {
+        ret = checkPrivatePow(base, ctx, out, scratch);
+        if (ret != CRYPT_SUCCESS) {
+            memset(out->value, 0, out->size << 2);
+        }
+    }
+    return ret;
+}
+
+/**
+ * a = a / 2 mod n, for a < n and n odd.
+ */
+static void halveMod(u32 *a, const u32 *mod, int len) {
+    u32 carry = 0;
+    if (a[len - 1] & 1) {
+        u64 sum = 0;
+        for (int i = len - 1; i >= 0; i--) {
+            sum = ((u64) a[i]) + ((u64) mod[i]) + (sum >> 32);
+            a[i] = (u32) sum;
+        }
+        carry = (u32) (sum >> 32);
+    }
+    for (int i = len - 1; i > 0; i--) {
+        a[i] = (a[i] >> 1) | (a[i - 1] << 31);
+    }
+    a[0] = (a[0] >> 1) | (carry << 31);
+}
+
+static int isOne(const u32 *a, int len) {
+    for (int i = 0; i < len - 1; i++) {
+        if (a[i] != 0) {
+            return 0;
+        }
+    }
+    return a[len - 1] == 1;
+}
+
+/**
+ * out = a^-1 mod n (len words, n odd, 0 < a < n), with the binary extended Euclid.
+ * It takes the time of the value, so only for the random values, not for the secrets.
+ * Returns FAILED_UNKNOWN if a is not coprime with n.
+ */
+static CryptResult modInverse(const u32 *a, const u32 *mod, int len, u32 *out) {
+    u32 u[RSA_KEY_CAPACITY], v[RSA_KEY_CAPACITY], x[RSA_KEY_CAPACITY];
+    u32 *y = out;
+    memcpy(u, a, len << 2);
+    memcpy(v, mod, len << 2);
+    memset(x, 0, len << 2);
+    memset(y, 0, len << 2);
+    x[len - 1] = 1;
+
+    // u = x * a, v = y * a (mod n)
+    while (!isOne(u, len) && !isOne(v, len)) {
+        if (trimmed(u, len).size == 0) {
+            return FAILED_UNKNOWN;
+        }
+        while ((u[len - 1] & 1) == 0) {
+            primitiveRightShift(u, len, 1);
+            halveMod(x, mod, len);
+        }
+        while ((v[len - 1] & 1) == 0) {
+            primitiveRightShift(v, len, 1);
+            halveMod(y, mod, len);
+        }
+        if (compareArray(u, v, len) >= 0) {
+            subN(u, v, len);
+            if (subN(x, y, len)) {
+                addInto(x, len, mod, len);
+            }
+        } else {
+            subN(v, u, len);
+            if (subN(y, x, len)) {
+                addInto(y, len, mod, len);
+            }
+        }
+    }
+    if (isOne(u, len)) {
+        memcpy(out, x, len << 2);
+    }
+    return CRYPT_SUCCESS;
+}
+
+// Private-key operations of the recent keys keep their blinding pairs here.
+#define BLINDING_CACHE_SIZE 8
+// Uses of a blinding pair before it is seeded again with the new random.
+#define BLINDING_REFRESH 64
+
+/**
+ * The blinding pair of a key, in Montgomery form: blind = r^e * R, unblind = r^-1 * R (mod n).
+ * The private exponentiation of c * r^e is m * r, so m = (c * r^e)^d * r^-1.
+ * The key without e takes blind = r * R, unblind = r^-d * R, (c * r)^d * r^-d is m as well.
+ * After each use both are squared, (r^2e, r^-2) is a pair as well.
+ */
+typedef struct {
+    u32 modulus[RSA_KEY_CAPACITY];
+    int modLen;
+    u32 blind[RSA_KEY_CAPACITY];
+    u32 unblind[RSA_KEY_CAPACITY];
+    // Uses left before the seed, 0 for the empty entry (or the pair taken by a crypt).
+    int uses;
+    u64 lastUse;
+} Blinding;
+
+static Blinding blinding_cache[BLINDING_CACHE_SIZE];
+static u64 blinding_clock = 0;
+// Guards the cache only, the multiplications on the pairs run outside of it.
+static pthread_mutex_t blinding_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Take the blinding pair of the key out of the cache, the entry is empty until the pair is put back
+ * (squared) by putBlinding, so the other threads with the key seed their own pairs meanwhile.
+ * Returns the uses left of the pair, 0 if the key has no pair.
+ */
+static int takeBlinding(const Modulus *modulus, u32 *blind, u32 *unblind) {
+    int modLen = modulus->size;
+    int uses = 0;
+    pthread_mutex_lock(&blinding_lock);
+    for (int i = 0; i < BLINDING_CACHE_SIZE; i++) {
+        Blinding *b = &blinding_cache[i];
+        if (b->uses == 0 || b->modLen != modLen || memcmp(b->modulus, modulus->value, modLen << 2) != 0) {
+            continue;
+        }
+        memcpy(blind, b->blind, modLen << 2);
+        memcpy(unblind, b->unblind, modLen << 2);
+        uses = b->uses;
+        b->uses = 0;
+        b->lastUse = ++blinding_clock;
+        break;
+    }
+    pthread_mutex_unlock(&blinding_lock);
+    return uses;
+}
+
+/**
+ * Keep the pair for the next uses of the key, in the entry of the key, or the least recently used one.
+ */
+static void putBlinding(const Modulus *modulus, const u32 *blind, const u32 *unblind, int uses) {
+    int modLen = modulus->size;
+    pthread_mutex_lock(&blinding_lock);
+    Blinding *entry = &blinding_cache[0];
+    for (int i = 0; i < BLINDING_CACHE_SIZE; i++) {
+        Blinding *b = &blinding_cache[i];
+        if (b->modLen == modLen && memcmp(b->modulus, modulus->value, modLen << 2) == 0) {
+            entry = b;
+            break;
+        }
+        if (b->lastUse < entry->lastUse) {
+            entry = b;
+        }
+    }
+    memcpy(entry->modulus, modulus->value, modLen << 2);
+    entry->modLen = modLen;
+    memcpy(entry->blind, blind, modLen << 2);
+    memcpy(entry->unblind, unblind, modLen << 2);
+    entry->uses = uses;
+    entry->lastUse = ++blinding_clock;
+    pthread_mutex_unlock(&blinding_lock);
+}
+
+/**
+ * Seed the blinding pair of the key with a new random r: blind = r^e * R, unblind = r^-1 * R,
+ * one public exponentiation and one inversion, once per BLINDING_REFRESH uses.
+ * The key without e takes blind = r * R, unblind = (r^d)^-1 * R, with one private exponentiation.
+ */
+static CryptResult seedBlinding(const RSAContext *ctx, u32 *blind, u32 *unblind, RSAScratch *scratch) {
+    const Modulus *modulus = &ctx->modulus;
+    int modLen = modulus->size;
+    u32 r[RSA_KEY_CAPACITY], rx[RSA_KEY_CAPACITY], x[RSA_KEY_CAPACITY];
+    int mark = scratch->used;
+    u32 *product = scratchAlloc(scratch, modLen << 1);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    if (k_scratch == NULL) {
+        scratch->used = mark;
+        return FAILED_OUT_OF_MEMORY;
+    }
+
+    int ret;
+    do {
+        u32 a[RSA_KEY_CAPACITY];
+        getRandom((uint8_t *) a, modLen << 2);
+        ret = reduceWords(a, modLen, modulus->value, modLen, r, scratch);
+        if (ret != CRYPT_SUCCESS) {
+            break;
+        }
+        BigInt base = trimmed(r, modLen), out = {rx, 0};
+        if (base.size == 0) {
+            ret = FAILED_UNKNOWN;
+            continue;
+        }
+        // rx = r^e (and x = r^-1), or rx = r^d (and x = r^-d)
+        ret = ctx->publicLen > 0 ? publicPow(&base, ctx, &out, scratch) : privatePow(&base, ctx, &out, scratch);
+        if (ret != CRYPT_SUCCESS) {
+            break;
+        }
+        ret = modInverse(ctx->publicLen > 0 ? r : rx, modulus->value, modLen, x);
+    } while (ret == FAILED_UNKNOWN);
+
+    if (ret == CRYPT_SUCCESS) {
+        BigInt bBig = {ctx->publicLen > 0 ? rx : r, modLen}, xBig = {x, modLen};
+        toMontgomery(&bBig, modulus, blind, r, product, k_scratch);
+        toMontgomery(&xBig, modulus, unblind, r, product, k_scratch);
+    }
+    memset(r, 0, sizeof(r));
+    memset(rx, 0, sizeof(rx));
+    memset(x, 0, sizeof(x));
+    scratch->used = mark;
+    return ret;
+}
+
+/**
+ * The private exponentiation with the blinding, m = (c * r^e)^d * r^-1, so the time and the power taken by
+ * the exponentiation are not related to the input. Two multiplications (and two squares for the next pair)
+ * are added to each exponentiation, the cache is locked only to copy the pair in and out.
+ */
+static CryptResult blindedPow(const BigInt *base, const RSAContext *ctx, BigInt *out, RSAScratch *scratch) {
+    const Modulus *modulus = &ctx->modulus;
+    int modLen = modulus->size;
+    u32 blind[RSA_KEY_CAPACITY], unblind[RSA_KEY_CAPACITY], x[RSA_KEY_CAPACITY], y[RSA_KEY_CAPACITY];
+    int mark = scratch->used;
+    u32 *product = scratchAlloc(scratch, modLen << 1);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(modLen));
+    if (k_scratch == NULL) {
+        scratch->used = mark;
+        return FAILED_OUT_OF_MEMORY;
+    }
+
+    int ret = CRYPT_SUCCESS;
+    int uses = takeBlinding(modulus, blind, unblind);
+    if (uses == 0) {
+        ret = seedBlinding(ctx, blind, unblind, scratch);
+        uses = BLINDING_REFRESH;
+    }
+    if (ret == CRYPT_SUCCESS) {
+        // x = c * r^e, c * (r^e * R) / R
+        memset(x, 0, (modLen - base->size) << 2);
+        memcpy(x + (modLen - base->size), base->value, base->size << 2);
+        montgomeryMultiply(x, blind, modulus->value, modLen, modulus->inv, product, k_scratch);
+        memcpy(x, product, modLen << 2);
+
+        BigInt blinded = {x, modLen}, result = {y, 0};
+        ret = privatePow(&blinded, ctx, &result, scratch);
+        if (ret == CRYPT_SUCCESS) {
+            memset(x, 0, (modLen - result.size) << 2);
+            memcpy(x + (modLen - result.size), result.value, result.size << 2);
+            montgomeryMultiply(x, unblind, modulus->value, modLen, modulus->inv, product, k_scratch);
+            memcpy(out->value, product, modLen << 2);
+            out->size = modLen;
+        }
+
+        // The squares of the pair for the next uses.
+        if (uses > 1) {
+            montgomeryMultiply(blind, blind, modulus->value, modLen, modulus->inv, product, k_scratch);
+            memcpy(blind, product, modLen << 2);
+            montgomeryMultiply(unblind, unblind, modulus->value, modLen, modulus->inv, product, k_scratch);
+            putBlinding(modulus, blind, product, uses - 1);
+        }
+    }
+    memset(blind, 0, sizeof(blind));
+    memset(unblind, 0, sizeof(unblind));
+    scratch->used = mark;
+    return ret;
+}
+
+/**
+ * out = block ^ exp mod n, the block and out take the block size (4 * modulus size) bytes.
+ * out could be the block.
+ */
+static CryptResult rawCrypt(const uint8_t *block, const RSAContext *ctx, uint8_t *out, RSAScratch *scratch) {
+    const Modulus *modulus = &ctx->modulus;
+    int modLen = modulus->size;
+    u32 buffer[2][RSA_KEY_CAPACITY];
+    BigInt base, result;
+    base.value = buffer[0];
+    result.value = buffer[1];
+    if (loadBlock(block, modulus, &base) != CRYPT_SUCCESS) {
+        return FAILED_INVALID_INPUT;
+    }
+
+    scratch = cryptScratch(scratch, modLen);
+    if (scratch == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    int used = scratch->used;
+    int peak = scratch->peak;
+    scratch->peak = used;
+    BigInt exp = {(u32 *) ctx->exponent, ctx->expLen};
+    int ret;
+    if (ctx->keyType == PRIVATE_KEY) {
+        ret = blindedPow(&base, ctx, &result, scratch);
+    } else if (isSmallExponent(ctx)) {
+        ret = modPowSmall(&base, exp.value[0], modulus, &result, scratch);
+    } else {
+        ret = modPow(&base, &exp, modulus, &result, scratch);
+    }
+    recordCrypt(scratch, modLen, used, peak);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    storeBlock(&result, modLen, out);
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * rawCrypt of two blocks, results gets the result of each one.
+ * With the small exponent the two run in lockstep by modPowSmallPair.
+ */
+static void rawCryptPair(const uint8_t *blocks[2], const RSAContext *ctx, uint8_t *outs[2], CryptResult results[2],
+                         RSAScratch *scratch) {
+    const Modulus *modulus = &ctx->modulus;
+    int modLen = modulus->size;
+    u32 buffer[4][RSA_KEY_CAPACITY];
+    BigInt base[2], result[2];
+    int paired = isSmallExponent(ctx);
+    for (int i = 0; i < 2; i++) {
+        base[i].value = buffer[i];
+        result[i].value = buffer[2 + i];
+        paired = paired && loadBlock(blocks[i], modulus, &base[i]) == CRYPT_SUCCESS;
+    }
+    if (!paired) {
+        for (int i = 0; i < 2; i++) {
+            results[i] = rawCrypt(blocks[i], ctx, outs[i], scratch);
+        }
+        return;
+    }
+
+    scratch = cryptScratch(scratch, modLen);
+    if (scratch == NULL) {
+        results[0] = results[1] = FAILED_OUT_OF_MEMORY;
+        return;
+    }
+    int used = scratch->used;
+    int peak = scratch->peak;
+    scratch->peak = used;
+    const BigInt *bases[2] = {&base[0], &base[1]};
+    BigInt *outputs[2] = {&result[0], &result[1]};
+    int ret = modPowSmallPair(bases, ctx->exponent[0], modulus, outputs, scratch);
+    recordCrypt(scratch, modLen, used, peak);
+    for (int i = 0; i < 2; i++) {
+        results[i] = ret;
+        if (ret == CRYPT_SUCCESS) {
+            storeBlock(&result[i], modLen, outs[i]);
+        }
+    }
+}
+
+/**
+ * mask ^= MGF1-SHA256(seed), with maskLen bytes.
+ * The seed is hashed once, each counter block clones the context (the midstate) and hashes the counter only.
+ */
+static void mgf1Xor(const uint8_t *seed, int seedLen, uint8_t *mask, int maskLen) {
+    SHA256_CTX prefix;
+    sha256_init(&prefix);
+    sha256_update(&prefix, seed, seedLen);
+
+    uint8_t digest[SHA256_DIGEST_LEN];
+    u32 counter = 0;
+    for (int done = 0; done < maskLen; done += SHA256_DIGEST_LEN, counter++) {
+        SHA256_CTX ctx = prefix;
+        uint8_t c[4] = {counter >> 24, counter >> 16, counter >> 8, counter};
+        sha256_update(&ctx, c, 4);
+        sha256_final(&ctx, digest);
+        int n = maskLen - done < SHA256_DIGEST_LEN ? maskLen - done : SHA256_DIGEST_LEN;
+        for (int i = 0; i < n; i++) {
+            mask[done + i] ^= digest[i];
+        }
+    }
+}
+
+// SHA-256 of the empty label
+static const uint8_t OAEP_LABEL_HASH[SHA256_DIGEST_LEN] = {
+        0xe3, 0xb0, 0xc4, 0x42, 0x98, 0xfc, 0x1c, 0x14, 0x9a, 0xfb, 0xf4, 0xc8, 0x99, 0x6f, 0xb9, 0x24,
+        0x27, 0xae, 0x41, 0xe4, 0x64, 0x9b, 0x93, 0x4c, 0xa4, 0x95, 0x99, 0x1b, 0x78, 0x52, 0xb8, 0x55
+};
+
+// The max input of OAEP is (blockSize - OAEP_OVERHEAD) bytes.
+#define OAEP_OVERHEAD ((SHA256_DIGEST_LEN << 1) + 2)
+
+/**
+ * EME-OAEP encoding with SHA-256, MGF1-SHA256 and the empty label:
+ * 00 || maskedSeed || maskedDB, DB = lHash || 00 ... 00 || 01 || M
+ */
+static void oaepEncode(uint8_t *block, int blockSize, const uint8_t *input, int inputLen) {
+    uint8_t *seed = block + 1;
+    uint8_t *db = block + 1 + SHA256_DIGEST_LEN;
+    int dbLen = blockSize - SHA256_DIGEST_LEN - 1;
+
+    block[0] = 0;
+    memcpy(db, OAEP_LABEL_HASH, SHA256_DIGEST_LEN);
+    memset(db + SHA256_DIGEST_LEN, 0, dbLen - SHA256_DIGEST_LEN - inputLen - 1);
+    db[dbLen - inputLen - 1] = 0x01;
+    memcpy(db + dbLen - inputLen, input, inputLen);
+
+    getRandom(seed, SHA256_DIGEST_LEN);
+    mgf1Xor(seed, SHA256_DIGEST_LEN, db, dbLen);
+    mgf1Xor(db, dbLen, seed, SHA256_DIGEST_LEN);
+}
+
+/**
+ * EME-OAEP decoding, the block is unmasked in place, the message is moved to the front of the block.
+ * The checks do not branch on the decoded bytes until all of them are done,
+ * and all the failures return the same FAILED_INVALID_INPUT.
+ */
+static CryptResult oaepDecode(uint8_t *block, int blockSize, int *outLen) {
+    uint8_t *seed = block + 1;
+    uint8_t *db = block + 1 + SHA256_DIGEST_LEN;
+    int dbLen = blockSize - SHA256_DIGEST_LEN - 1;
+
+    mgf1Xor(db, dbLen, seed, SHA256_DIGEST_LEN);
+    mgf1Xor(seed, SHA256_DIGEST_LEN, db, dbLen);
+
+    u32 bad = block[0];
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        bad |= db[i] ^ OAEP_LABEL_HASH[i];
+    }
+    // Find the 01 after the zeros: found becomes all ones at the first nonzero byte.
+    u32 found = 0;
+    u32 index = 0;
+    for (int i = SHA256_DIGEST_LEN; i < dbLen; i++) {
+        u32 b = db[i];
+        u32 isZero = ((b | (0 - b)) >> 31) - 1;  // all ones if b == 0
+        u32 first = ~found & ~isZero;
+        index |= first & (u32) i;
+        bad |= first & (b ^ 0x01);
+        found |= first;
+    }
+    bad |= ~found;
+    if (bad != 0) {
+        return FAILED_INVALID_INPUT;
+    }
+    int from = (int) index + 1;
+    *outLen = dbLen - from;
+    memmove(block, db + from, *outLen);
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Check the mode against the key type, and the input length against the block size.
+ */
+static CryptResult checkCrypt(const RSAContext *ctx, CipherMode mode, int inputLen) {
+    int blockSize = ctx->modulus.size << 2;
+    int oaep = mode == OAEP_ENCRYPT || mode == OAEP_DECRYPT;
+    // OAEP encrypts with the public key and decrypts with the private key only.
+    if (oaep && ctx->keyType != (mode == OAEP_ENCRYPT ? PUBLIC_KEY : PRIVATE_KEY)) {
+        return FAILED_INVALID_KEY;
+    }
+    if (mode == ENCRYPT || mode == OAEP_ENCRYPT) {
+        if (inputLen > (blockSize - (oaep ? OAEP_OVERHEAD : 11))) {
+            return FAILED_INPUT_TOO_LARGE;
+        }
+    } else {
+        if (inputLen != blockSize) {
+            return FAILED_INVALID_INPUT;
+        }
+    }
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Pad the input (checked by checkCrypt) to the block to encrypt.
+ */
+static void encodeBlock(const uint8_t *input, int inputLen, const RSAContext *ctx, CipherMode mode,
+                        uint8_t *block) {
+    int blockSize = ctx->modulus.size << 2;
+    if (mode == OAEP_ENCRYPT) {
+        oaepEncode(block, blockSize, input, inputLen);
+    } else {
+        paddingInput(block, blockSize, inputLen, ctx->keyType);
+        memcpy(block + (blockSize - inputLen), input, inputLen);
+    }
+}
+
+/**
+ * Unpad the decrypted block in place, the message is moved to the front of the block.
+ */
+static CryptResult decodeBlock(const RSAContext *ctx, CipherMode mode, uint8_t *output, int *outputLen) {
+    int blockSize = ctx->modulus.size << 2;
+    if (mode == OAEP_DECRYPT) {
+        return oaepDecode(output, blockSize, outputLen);
+    }
+
+    uint8_t *p = output;
+    // check if the first bytes is 0, and encrypt type is different to decrypt key
+    KeyType encryptType = (ctx->keyType == PRIVATE_KEY) ? PUBLIC_KEY : PRIVATE_KEY;
+    if (!(p[0] == 0 && p[1] == encryptType)) {
+        return FAILED_INVALID_INPUT;
+    }
+    int i = 2;
+    for (; i < blockSize && p[i] != 0; i++) {
+    }
+
+    int valid = 1;
+    if (i < 10 || i == blockSize) {
+        valid = 0;
+    } else {
+        if (encryptType == PRIVATE_KEY) {
+            for (int j = 2; j < i; j++) {
+                if (p[j] != 0xFF) {
+                    valid = 0;
+                    break;
+                }
+            }
+        }
+    }
+    if (valid != 1) {
+        return FAILED_INVALID_INPUT;
+    }
+    i++;
+    *outputLen = blockSize - i;
+    if (blockSize != i) {
+        memmove(output, p + i, *outputLen);
+    }
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Crypt one block with the context, the input is checked by checkCrypt.
+ * The output takes the block size bytes, outputLen gets the bytes of the result.
+ */
+static CryptResult cryptBlock(const uint8_t *input, int inputLen, const RSAContext *ctx, CipherMode mode,
+                              uint8_t *output, int *outputLen, RSAScratch *scratch) {
+    int ret;
+    if (mode == ENCRYPT || mode == OAEP_ENCRYPT) {
+        uint8_t block[RSA_MAX_BLOCK_SIZE];
+        encodeBlock(input, inputLen, ctx, mode, block);
+        ret = rawCrypt(block, ctx, output, scratch);
+        *outputLen = ctx->modulus.size << 2;
+    } else {
+        ret = rawCrypt(input, ctx, output, scratch);
+        if (ret == CRYPT_SUCCESS) {
+            ret = decodeBlock(ctx, mode, output, outputLen);
+        }
+    }
+    return ret;
+}
+
+/**
+ * Crypt one block of the input with the loaded key, see rsa_crypt.
+ */
+static CryptResult cryptContext(const ByteArray *input, const RSAContext *ctx, CipherMode mode, ByteArray *output,
+                                RSAScratch *scratch) {
+    int ret = checkCrypt(ctx, mode, input->len);
+    if (ret == CRYPT_SUCCESS) {
+        ret = cryptBlock(input->value, input->len, ctx, mode, output->value, &output->len, scratch);
+    }
+    return ret;
+}
+
+CryptResult rsa_crypt_with_scratch(const ByteArray *input,
+                                   const RSAKey *key,
+                                   const CipherMode mode,
+                                   ByteArray *output,
+                                   RSAScratch *scratch) {
+    const int sizeLimit = RSA_KEY_CAPACITY << 2;
+    if (input == NULL || input->len > sizeLimit || output == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+
+    RSAContext ctx;
+    int ret = loadContext(key, &ctx, scratch);
+    if (ret == CRYPT_SUCCESS) {
+        ret = cryptContext(input, &ctx, mode, output, scratch);
+    }
+    return ret;
+}
+
+/**
+ * The blocks of rsa_crypt_blocks, each one is crypted by a task of the thread pool.
+ */
+typedef struct {
+    const RSAContext *ctx;
+    CipherMode mode;
+    const uint8_t *input;
+    int inputLen;
+    // Input bytes of each block
+    int chunk;
+    uint8_t *output;
+    // Status and output length of each block
+    CryptResult *results;
+    int *outputLens;
+    // Set by the first failure, the later tasks skip their blocks.
+    int failed;
+} BlockJob;
+
+static void cryptBlockTask(void *arg, int index) {
+    BlockJob *job = (BlockJob *) arg;
+    if (__atomic_load_n(&job->failed, __ATOMIC_RELAXED)) {
+        job->results[index] = FAILED_UNKNOWN;
+        return;
+    }
+    int blockSize = job->ctx->modulus.size << 2;
+    int offset = index * job->chunk;
+    int len = job->inputLen - offset < job->chunk ? job->inputLen - offset : job->chunk;
+    // Each task takes the scratch of its thread.
+    CryptResult ret = cryptBlock(job->input + offset, len, job->ctx, job->mode,
+                                 job->output + index * blockSize, &job->outputLens[index], NULL);
+    job->results[index] = ret;
+    if (ret != CRYPT_SUCCESS) {
+        __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Input bytes of each block, 0 for the invalid mode.
+ */
+static int blockChunk(int blockSize, CipherMode mode) {
+    switch (mode) {
+        case ENCRYPT:
+            return blockSize - 11;
+        case OAEP_ENCRYPT:
+            return blockSize - OAEP_OVERHEAD;
+        case DECRYPT:
+        case OAEP_DECRYPT:
+            return blockSize;
+        default:
+            return 0;
+    }
+}
+
+int rsa_crypt_blocks_size(int inputLen, const RSAKey *key, CipherMode mode) {
+    u32 buffer[2][RSA_KEY_CAPACITY];
+    BigInt exp, mod;
+    exp.value = buffer[0];
+    mod.value = buffer[1];
+    if (inputLen < 0 || loadKey(key, &exp, &mod) != CRYPT_SUCCESS) {
+        return 0;
+    }
+    int blockSize = mod.size << 2;
+    int chunk = blockChunk(blockSize, mode);
+    if (chunk == 0) {
+        return 0;
+    }
+    if (chunk == blockSize) {
+        return inputLen;
+    }
+    int count = inputLen == 0 ? 1 : (inputLen + chunk - 1) / chunk;
+    return count * blockSize;
+}
+
+CryptResult rsa_crypt_blocks(const ByteArray *input, const RSAKey *key, CipherMode mode, ByteArray *output) {
+    if (input == NULL || input->len < 0 || output == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAContext ctx;
+    int ret = loadContext(key, &ctx, NULL);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    int blockSize = ctx.modulus.size << 2;
+    int chunk = blockChunk(blockSize, mode);
+    if (chunk == 0) {
+        return FAILED_INVALID_INPUT;
+    }
+    int decrypt = chunk == blockSize;
+    int inputLen = input->len;
+    // The empty input is encrypted to one block (of the empty message), and decrypted to nothing.
+    int count = decrypt ? inputLen / blockSize : (inputLen == 0 ? 1 : (inputLen + chunk - 1) / chunk);
+    if (decrypt && inputLen % blockSize != 0) {
+        return FAILED_INVALID_INPUT;
+    }
+    ret = checkCrypt(&ctx, mode, decrypt ? blockSize : 0);
+    if (ret != CRYPT_SUCCESS || count == 0) {
+        output->len = 0;
+        return ret;
+    }
+
+    BlockJob job;
+    job.ctx = &ctx;
+    job.mode = mode;
+    job.input = input->value;
+    job.inputLen = inputLen;
+    job.chunk = chunk;
+    job.output = output->value;
+    job.failed = 0;
+    job.results = malloc(count * (sizeof(CryptResult) + sizeof(int)));
+    if (job.results == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    job.outputLens = (int *) (job.results + count);
+
+    thread_pool_run(cryptBlockTask, &job, count);
+
+    // The first failed block, or join the plaintexts (each one is at the front of its block).
+    int outputLen = 0;
+    for (int i = 0; i < count && ret == CRYPT_SUCCESS; i++) {
+        ret = job.results[i];
+        if (ret == CRYPT_SUCCESS) {
+            if (outputLen != i * blockSize) {
+                memmove(output->value + outputLen, output->value + i * blockSize, job.outputLens[i]);
+            }
+            outputLen += job.outputLens[i];
+        }
+    }
+    free(job.results);
+    output->len = ret == CRYPT_SUCCESS ? outputLen : 0;
+    return ret;
+}
+
+// DER of DigestInfo with SHA-256, the digest follows it.
+static const uint8_t SHA256_DIGEST_INFO[] = {
+        0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01,
+        0x65, 0x03, 0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20
+};
+
+// Salt length of PSS, the same as the digest.
+#define PSS_SALT_LEN SHA256_DIGEST_LEN
+
+/**
+ * EMSA-PKCS1-v1_5 with SHA-256: 00 01 FF ... FF 00 || DigestInfo || H
+ */
+static void emsaPkcs1Encode(const uint8_t hash[SHA256_DIGEST_LEN], uint8_t *em, int emLen) {
+    int tLen = sizeof(SHA256_DIGEST_INFO) + SHA256_DIGEST_LEN;
+    int psLen = emLen - tLen - 3;
+    em[0] = 0;
+    em[1] = PRIVATE_KEY;
+    memset(em + 2, 0xFF, psLen);
+    em[2 + psLen] = 0;
+    memcpy(em + 3 + psLen, SHA256_DIGEST_INFO, sizeof(SHA256_DIGEST_INFO));
+    memcpy(em + emLen - SHA256_DIGEST_LEN, hash, SHA256_DIGEST_LEN);
+}
+
+/**
+ * H = SHA-256(00 * 8 || mHash || salt)
+ */
+static void pssHash(const uint8_t mHash[SHA256_DIGEST_LEN], const uint8_t *salt, uint8_t h[SHA256_DIGEST_LEN]) {
+    static const uint8_t zeros[8] = {0};
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, zeros, sizeof(zeros));
+    sha256_update(&ctx, mHash, SHA256_DIGEST_LEN);
+    sha256_update(&ctx, salt, PSS_SALT_LEN);
+    sha256_final(&ctx, h);
+}
+
+/**
+ * EMSA-PSS with SHA-256, MGF1-SHA256 and 32 bytes salt, the em is the whole block.
+ * emBits = modBits - 1, so the leading byte of the block is zero when modBits = 1 (mod 8).
+ * maskedDB || H || 0xbc, DB = 00 ... 00 01 || salt
+ */
+static void emsaPssEncode(const uint8_t mHash[SHA256_DIGEST_LEN], int modBits, uint8_t *block, int blockSize) {
+    int emBits = modBits - 1;
+    int emLen = (emBits + 7) >> 3;
+    uint8_t *em = block + (blockSize - emLen);
+    memset(block, 0, blockSize - emLen);
+
+    int dbLen = emLen - SHA256_DIGEST_LEN - 1;
+    uint8_t *db = em;
+    uint8_t *h = em + dbLen;
+    memset(db, 0, dbLen - PSS_SALT_LEN - 1);
+    db[dbLen - PSS_SALT_LEN - 1] = 0x01;
+    uint8_t *salt = db + dbLen - PSS_SALT_LEN;
+    getRandom(salt, PSS_SALT_LEN);
+
+    pssHash(mHash, salt, h);
+    mgf1Xor(h, SHA256_DIGEST_LEN, db, dbLen);
+    db[0] &= 0xFF >> ((emLen << 3) - emBits);
+    em[emLen - 1] = 0xbc;
+}
+
+/**
+ * Check the block by EMSA-PSS-VERIFY, the block is changed (the DB is unmasked in place).
+ * @return 1 if consistent.
+ */
+static int emsaPssVerify(const uint8_t mHash[SHA256_DIGEST_LEN], int modBits, uint8_t *block, int blockSize) {
+    int emBits = modBits - 1;
+    int emLen = (emBits + 7) >> 3;
+    uint8_t *em = block + (blockSize - emLen);
+    for (int i = 0; i < blockSize - emLen; i++) {
+        if (block[i] != 0) {
+            return 0;
+        }
+    }
+    if (em[emLen - 1] != 0xbc) {
+        return 0;
+    }
+    int dbLen = emLen - SHA256_DIGEST_LEN - 1;
+    uint8_t *db = em;
+    const uint8_t *h = em + dbLen;
+    uint8_t topMask = 0xFF >> ((emLen << 3) - emBits);
+    if ((db[0] & ~topMask) != 0) {
+        return 0;
+    }
+    mgf1Xor(h, SHA256_DIGEST_LEN, db, dbLen);
+    db[0] &= topMask;
+
+    int psLen = dbLen - PSS_SALT_LEN - 1;
+    for (int i = 0; i < psLen; i++) {
+        if (db[i] != 0) {
+            return 0;
+        }
+    }
+    if (db[psLen] != 0x01) {
+        return 0;
+    }
+    uint8_t expected[SHA256_DIGEST_LEN];
+    pssHash(mHash, db + dbLen - PSS_SALT_LEN, expected);
+    uint8_t diff = 0;
+    for (int i = 0; i < SHA256_DIGEST_LEN; i++) {
+        diff |= expected[i] ^ h[i];
+    }
+    return diff == 0;
+}
+
+/**
+ * Sign the message with the loaded key, see rsa_sign.
+ */
+static CryptResult signContext(const ByteArray *message, const RSAContext *rsa, SignPadding padding,
+                               ByteArray *signature) {
+    BigInt mod = {(u32 *) rsa->modulus.value, rsa->modulus.size};
+
+    uint8_t hash[SHA256_DIGEST_LEN];
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, message->value, message->len);
+    sha256_final(&ctx, hash);
+
+    int blockSize = mod.size << 2;
+    uint8_t block[RSA_MAX_BLOCK_SIZE];
+    if (padding == SIGN_PKCS1) {
+        emsaPkcs1Encode(hash, block, blockSize);
+    } else {
+        emsaPssEncode(hash, bitLength(&mod), block, blockSize);
+    }
+    int ret = rawCrypt(block, rsa, signature->value, NULL);
+    if (ret == CRYPT_SUCCESS) {
+        signature->len = blockSize;
+    }
+    return ret;
+}
+
+CryptResult rsa_sign(const ByteArray *message, const RSAKey *key, SignPadding padding, ByteArray *signature) {
+    if (message == NULL || signature == NULL || (padding != SIGN_PKCS1 && padding != SIGN_PSS)) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAContext rsa;
+    int ret = loadContext(key, &rsa, NULL);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return signContext(message, &rsa, padding, signature);
+}
+
+/**
+ * Check the opened signature (the block) against the encoding of the message, the block is changed.
+ */
+static CryptResult checkSignature(const ByteArray *message, SignPadding padding, const RSAContext *rsa,
+                                  uint8_t *block) {
+    BigInt mod = {(u32 *) rsa->modulus.value, rsa->modulus.size};
+    int blockSize = mod.size << 2;
+
+    uint8_t hash[SHA256_DIGEST_LEN];
+    SHA256_CTX ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, message->value, message->len);
+    sha256_final(&ctx, hash);
+
+    int valid;
+    if (padding == SIGN_PKCS1) {
+        uint8_t expected[RSA_MAX_BLOCK_SIZE];
+        emsaPkcs1Encode(hash, expected, blockSize);
+        uint8_t diff = 0;
+        for (int i = 0; i < blockSize; i++) {
+            diff |= expected[i] ^ block[i];
+        }
+        valid = diff == 0;
+    } else {
+        valid = emsaPssVerify(hash, bitLength(&mod), block, blockSize);
+    }
+    return valid ? CRYPT_SUCCESS : FAILED_INVALID_SIGNATURE;
+}
+
+/**
+ * Verify the signature with the loaded key, see rsa_verify.
+ */
+static CryptResult verifyContext(const ByteArray *message, const ByteArray *signature, const RSAContext *rsa,
+                                 SignPadding padding) {
+    int blockSize = rsa->modulus.size << 2;
+    if (signature->len != blockSize) {
+        return FAILED_INVALID_SIGNATURE;
+    }
+
+    // The signature is opened into the block, then checked against the encoding in place.
+    uint8_t block[RSA_MAX_BLOCK_SIZE];
+    int ret = rawCrypt(signature->value, rsa, block, NULL);
+    if (ret == FAILED_INVALID_INPUT) {
+        return FAILED_INVALID_SIGNATURE;
+    } else if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return checkSignature(message, padding, rsa, block);
+}
+
+CryptResult rsa_verify(const ByteArray *message, const ByteArray *signature, const RSAKey *key,
+                       SignPadding padding) {
+    if (message == NULL || signature == NULL || (padding != SIGN_PKCS1 && padding != SIGN_PSS)) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAContext rsa;
+    int ret = loadContext(key, &rsa, NULL);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return verifyContext(message, signature, &rsa, padding);
+}
+
+/**
+ * The items of rsa_crypt_batch and rsa_verify_batch, each task takes two items (see rawCryptPair).
+ */
+typedef struct {
+    const RSAContext *ctx;
+    int count;
+    // The inputs to crypt, or the signatures to verify.
+    const ByteArray *inputs;
+    CipherMode mode;
+    ByteArray *outputs;
+    // The messages of the signatures, NULL to crypt.
+    const ByteArray *messages;
+    SignPadding padding;
+    CryptResult *results;
+} BatchJob;
+
+static void batchTask(void *arg, int pair) {
+    BatchJob *job = (BatchJob *) arg;
+    const RSAContext *ctx = job->ctx;
+    int blockSize = ctx->modulus.size << 2;
+    int verify = job->messages != NULL;
+    int encrypt = job->mode == ENCRYPT || job->mode == OAEP_ENCRYPT;
+
+    uint8_t blocks[2][RSA_MAX_BLOCK_SIZE];
+    const uint8_t *in[2];
+    uint8_t *out[2];
+    int index[2];
+    int ready = 0;
+    for (int i = pair << 1; i < job->count && i < (pair << 1) + 2; i++) {
+        const ByteArray *input = &job->inputs[i];
+        CryptResult ret;
+        if (verify) {
+            ret = input->len == blockSize ? CRYPT_SUCCESS : FAILED_INVALID_SIGNATURE;
+        } else {
+            ret = checkCrypt(ctx, job->mode, input->len);
+        }
+        job->results[i] = ret;
+        if (ret != CRYPT_SUCCESS) {
+            continue;
+        }
+        // The signature is opened into the block, the output is crypted in place.
+        out[ready] = verify ? blocks[ready] : job->outputs[i].value;
+        if (encrypt && !verify) {
+            encodeBlock(input->value, input->len, ctx, job->mode, blocks[ready]);
+            in[ready] = blocks[ready];
+        } else {
+            in[ready] = input->value;
+        }
+        index[ready++] = i;
+    }
+
+    CryptResult results[2];
+    if (ready == 2) {
+        rawCryptPair(in, ctx, out, results, NULL);
+    } else if (ready == 1) {
+        results[0] = rawCrypt(in[0], ctx, out[0], NULL);
+    }
+
+    for (int k = 0; k < ready; k++) {
+        int i = index[k];
+        CryptResult ret = results[k];
+        if (verify) {
+            if (ret == FAILED_INVALID_INPUT) {
+                ret = FAILED_INVALID_SIGNATURE;
+            } else if (ret == CRYPT_SUCCESS) {
+                ret = checkSignature(&job->messages[i], job->padding, ctx, out[k]);
+            }
+        } else if (ret == CRYPT_SUCCESS) {
+            if (encrypt) {
+                job->outputs[i].len = blockSize;
+            } else {
+                ret = decodeBlock(ctx, job->mode, out[k], &job->outputs[i].len);
+            }
+        }
+        job->results[i] = ret;
+    }
+}
+
+static CryptResult runBatch(BatchJob *job, const RSAKey *key, int parallel) {
+    RSAContext ctx;
+    int ret = loadContext(key, &ctx, NULL);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    job->ctx = &ctx;
+    int pairs = (job->count + 1) >> 1;
+    if (parallel) {
+        thread_pool_run(batchTask, job, pairs);
+    } else {
+        for (int i = 0; i < pairs; i++) {
+            batchTask(job, i);
+        }
+    }
+    return CRYPT_SUCCESS;
+}
+
+CryptResult rsa_crypt_batch(const ByteArray *inputs, int count, const RSAKey *key, CipherMode mode, int parallel,
+                            ByteArray *outputs, CryptResult *results) {
+    if (count < 0 || (count > 0 && (inputs == NULL || outputs == NULL || results == NULL)) ||
+        mode < ENCRYPT || mode > OAEP_DECRYPT) {
+        return FAILED_INVALID_INPUT;
+    }
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.count = count;
+    job.inputs = inputs;
+    job.mode = mode;
+    job.outputs = outputs;
+    job.results = results;
+    return runBatch(&job, key, parallel);
+}
+
+CryptResult rsa_verify_batch(const ByteArray *messages, const ByteArray *signatures, int count, const RSAKey *key,
+                             SignPadding padding, int parallel, CryptResult *results) {
+    if (count < 0 || (count > 0 && (messages == NULL || signatures == NULL || results == NULL)) ||
+        (padding != SIGN_PKCS1 && padding != SIGN_PSS)) {
+        return FAILED_INVALID_INPUT;
+    }
+    BatchJob job;
+    memset(&job, 0, sizeof(job));
+    job.count = count;
+    job.inputs = signatures;
+    job.messages = messages;
+    job.padding = padding;
+    job.results = results;
+    return runBatch(&job, key, parallel);
+}
+
+/*
+ * Key handles.
+ *
+ * The key is parsed from the DER (or PEM) in native and loaded once to the RSAContext of the handle,
+ * the integers are read in place from the DER, so the key material does not go through the Java arrays,
+ * and the crypt takes no loadContext.
+ */
+
+struct RSAKeyHandle {
+    RSAContext ctx;
+    int bits;
+};
+
+// 1.2.840.113549.1.1.1
+static const uint8_t RSA_ENCRYPTION_OID[] = {0x2a, 0x86, 0x48, 0x86, 0xf7, 0x0d, 0x01, 0x01, 0x01};
+
+/**
+ * The integers of the parsed key, pointing into the DER.
+ */
+typedef struct {
+    ByteArray modulus;
+    ByteArray exponent;
+    ByteArray publicExponent;
+    ByteArray items[RSA_MAX_PRIMES * 3];
+    RSACrtParams crt;
+    RSAKey key;
+} ParsedKey;
+
+/**
+ * Read the AlgorithmIdentifier of rsaEncryption, the parameters NULL or absent.
+ */
+static int readRsaAlgorithm(ByteArray *in) {
+    ByteArray algorithm, oid, params;
+    if (!der_read(in, DER_SEQUENCE, &algorithm) || !der_read(&algorithm, DER_OID, &oid) ||
+        oid.len != sizeof(RSA_ENCRYPTION_OID) || memcmp(oid.value, RSA_ENCRYPTION_OID, oid.len) != 0) {
+        return 0;
+    }
+    if (algorithm.len == 0) {
+        return 1;
+    }
+    return der_read(&algorithm, DER_NULL, &params) && params.len == 0 && algorithm.len == 0;
+}
+
+/**
+ * Read the rest of RSAPrivateKey after the version: n, e, d, p, q, dP, dQ, qInv and the OtherPrimeInfos.
+ * The key with more than RSA_MAX_PRIMES primes crypts with d.
+ */
+static CryptResult readPrivateKey(ByteArray *in, int multiPrime, ParsedKey *parsed) {
+    ByteArray *items = parsed->items;
+    RSACrtParams *crt = &parsed->crt;
+    // primes, exponents, coefficients of p and q
+    ByteArray *order[] = {&items[0], &items[1], &items[RSA_MAX_PRIMES], &items[RSA_MAX_PRIMES + 1],
+                          &items[RSA_MAX_PRIMES * 2]};
+    if (!der_read(in, DER_INTEGER, &parsed->modulus) || !der_read(in, DER_INTEGER, &parsed->publicExponent) ||
+        !der_read(in, DER_INTEGER, &parsed->exponent)) {
+        return FAILED_INVALID_KEY;
+    }
+    for (int i = 0; i < 5; i++) {
+        if (!der_read(in, DER_INTEGER, order[i])) {
+            return FAILED_INVALID_KEY;
+        }
+    }
+
+    int count = 2;
+    ByteArray others;
+    if (multiPrime && der_read(in, DER_SEQUENCE, &others)) {
+        while (others.len > 0) {
+            ByteArray info, r, d, t;
+            if (!der_read(&others, DER_SEQUENCE, &info) || !der_read(&info, DER_INTEGER, &r) ||
+                !der_read(&info, DER_INTEGER, &d) || !der_read(&info, DER_INTEGER, &t)) {
+                return FAILED_INVALID_KEY;
+            }
+            if (count < RSA_MAX_PRIMES) {
+                items[count] = r;
+                items[RSA_MAX_PRIMES + count] = d;
+                items[RSA_MAX_PRIMES * 2 + count] = t;
+            }
+            count++;
+        }
+    }
+    if (in->len != 0) {
+        return FAILED_INVALID_KEY;
+    }
+
+    parsed->key.key_type = PRIVATE_KEY;
+    parsed->key.publicExponent = &parsed->publicExponent;
+    if (count > RSA_MAX_PRIMES) {
+        parsed->key.crt = NULL;
+        return CRYPT_SUCCESS;
+    }
+    crt->count = count;
+    for (int i = 0; i < count; i++) {
+        crt->primes[i] = &items[i];
+        crt->exponents[i] = &items[RSA_MAX_PRIMES + i];
+        crt->coefficients[i] = i == 1 ? NULL : &items[RSA_MAX_PRIMES * 2 + i];
+    }
+    parsed->key.crt = crt;
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * Parse the DER of RSAPublicKey, RSAPrivateKey (PKCS#1), PrivateKeyInfo (PKCS#8) or SubjectPublicKeyInfo,
+ * the key is told by the structure.
+ */
+static CryptResult parseKeyDer(ByteArray der, ParsedKey *parsed) {
+    ByteArray body, first;
+    memset(parsed, 0, sizeof(ParsedKey));
+    parsed->key.exponent = &parsed->exponent;
+    parsed->key.modulus = &parsed->modulus;
+    if (!der_read(&der, DER_SEQUENCE, &body) || der.len != 0) {
+        return FAILED_INVALID_KEY;
+    }
+
+    if (der_peek(&body) == DER_SEQUENCE) {
+        // SubjectPublicKeyInfo: the algorithm, then RSAPublicKey in the BIT STRING (no unused bits).
+        ByteArray bits;
+        if (!readRsaAlgorithm(&body) || !der_read(&body, DER_BIT_STRING, &bits) || body.len != 0 ||
+            bits.len < 1 || bits.value[0] != 0) {
+            return FAILED_INVALID_KEY;
+        }
+        bits.value++;
+        bits.len--;
+        if (!der_read(&bits, DER_SEQUENCE, &body) || bits.len != 0) {
+            return FAILED_INVALID_KEY;
+        }
+    }
+
+    // The modulus of RSAPublicKey, or the version of the private key.
+    if (!der_read(&body, DER_INTEGER, &first)) {
+        return FAILED_INVALID_KEY;
+    }
+    if (der_peek(&body) == DER_SEQUENCE) {
+        // PrivateKeyInfo: version 0, the algorithm, then RSAPrivateKey in the OCTET STRING, the attributes ignored.
+        ByteArray octets;
+        if (first.len != 1 || first.value[0] != 0 || !readRsaAlgorithm(&body) ||
+            !der_read(&body, DER_OCTET_STRING, &octets) || !der_read(&octets, DER_SEQUENCE, &body) ||
+            octets.len != 0 || !der_read(&body, DER_INTEGER, &first)) {
+            return FAILED_INVALID_KEY;
+        }
+    }
+
+    ByteArray second = body;
+    if (der_read(&second, DER_INTEGER, &parsed->exponent) && second.len == 0) {
+        // RSAPublicKey: n, e
+        parsed->modulus = first;
+        parsed->key.key_type = PUBLIC_KEY;
+        return CRYPT_SUCCESS;
+    }
+    // RSAPrivateKey, version 0 (two primes) or 1 (multi-prime)
+    if (first.len != 1 || first.value[0] > 1) {
+        return FAILED_INVALID_KEY;
+    }
+    return readPrivateKey(&body, first.value[0] == 1, parsed);
+}
+
+CryptResult rsa_parse_key(const ByteArray *input, int parallel, RSAKeyHandle **handle) {
+    if (input == NULL || input->value == NULL || input->len <= 0 || handle == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    *handle = NULL;
+
+    // The PEM is decoded to a buffer, wiped with the key items read from it.
+    ByteArray der = *input;
+    uint8_t *buffer = NULL;
+    if (pem_is(input)) {
+        buffer = malloc(input->len * 3 / 4 + 3);
+        if (buffer == NULL) {
+            return FAILED_OUT_OF_MEMORY;
+        }
+        ByteArray label;
+        der.value = buffer;
+        der.len = 0;
+        if (!pem_decode(input, &label, &der)) {
+            secure_wipe(buffer, input->len * 3 / 4 + 3);
+            free(buffer);
+            return FAILED_INVALID_KEY;
+        }
+    }
+
+    ParsedKey parsed;
+    RSAKeyHandle *key = NULL;
+    int ret = parseKeyDer(der, &parsed);
+    if (ret == CRYPT_SUCCESS) {
+        parsed.crt.parallel = parallel ? 1 : 0;
+        key = malloc(sizeof(RSAKeyHandle));
+        ret = key != NULL ? loadContext(&parsed.key, &key->ctx, NULL) : FAILED_OUT_OF_MEMORY;
+    }
+    if (ret == CRYPT_SUCCESS) {
+        BigInt mod = {key->ctx.modulus.value, key->ctx.modulus.size};
+        key->bits = bitLength(&mod);
+        *handle = key;
+    } else if (key != NULL) {
+        rsa_free_key(key);
+    }
+    memset(&parsed, 0, sizeof(parsed));
+    if (buffer != NULL) {
+        secure_wipe(buffer, der.len);
+        free(buffer);
+    }
+    return ret;
+}
+
+void rsa_free_key(RSAKeyHandle *handle) {
+    if (handle != NULL) {
+        secure_wipe(handle, sizeof(RSAKeyHandle));
+        free(handle);
+    }
+}
+
+KeyType rsa_key_type(const RSAKeyHandle *handle) {
+    return handle->ctx.keyType;
+}
+
+int rsa_key_bits(const RSAKeyHandle *handle) {
+    return handle->bits;
+}
+
+CryptResult rsa_crypt_handle(const ByteArray *input, const RSAKeyHandle *handle, CipherMode mode,
+                             ByteArray *output) {
+    const int sizeLimit = RSA_KEY_CAPACITY << 2;
+    if (input == NULL || input->len > sizeLimit || output == NULL || handle == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    return cryptContext(input, &handle->ctx, mode, output, NULL);
+}
+
+CryptResult rsa_sign_handle(const ByteArray *message, const RSAKeyHandle *handle, SignPadding padding,
+                            ByteArray *signature) {
+    if (message == NULL || signature == NULL || handle == NULL || (padding != SIGN_PKCS1 && padding != SIGN_PSS)) {
+        return FAILED_INVALID_INPUT;
+    }
+    if (handle->ctx.keyType != PRIVATE_KEY) {
+        return FAILED_INVALID_KEY;
+    }
+    return signContext(message, &handle->ctx, padding, signature);
+}
+
+CryptResult rsa_verify_handle(const ByteArray *message, const ByteArray *signature, const RSAKeyHandle *handle,
+                              SignPadding padding) {
+    if (message == NULL || signature == NULL || handle == NULL || (padding != SIGN_PKCS1 && padding != SIGN_PSS)) {
+        return FAILED_INVALID_INPUT;
+    }
+    if (handle->ctx.keyType != PUBLIC_KEY) {
+        return FAILED_INVALID_KEY;
+    }
+    return verifyContext(message, signature, &handle->ctx, padding);
+}
+
+/*
+ * Modular arithmetic on the numbers kept in native, with the Montgomery code of the RSA.
+ */
+
+struct RSABigNum {
+    // Big-endian words without the leading zeros, size 0 for zero.
+    u32 value[RSA_KEY_CAPACITY];
+    int size;
+    // The Montgomery setup, made by the first call taking the number as the modulus.
+    Modulus *modulus;
+};
+
+static CryptResult newBigNum(const u32 *value, int len, RSABigNum **out) {
+    RSABigNum *n = malloc(sizeof(RSABigNum));
+    if (n == NULL) {
+        return FAILED_OUT_OF_MEMORY;
+    }
+    BigInt t = trimmed((u32 *) value, len);
+    memcpy(n->value, t.value, t.size << 2);
+    n->size = t.size;
+    n->modulus = NULL;
+    *out = n;
+    return CRYPT_SUCCESS;
+}
+
+/**
+ * The Montgomery setup of the modulus (odd, 2 words at least), made once; NULL with ret set if it is not a modulus.
+ * scratch gets the scratch of the thread, words at least.
+ */
+static const Modulus *bigNumModulus(const RSABigNum *m, int words, RSAScratch **scratch, CryptResult *ret) {
+    *scratch = NULL;
+    if (m->size < 2 || (m->value[m->size - 1] & 1) == 0) {
+        *ret = FAILED_INVALID_INPUT;
+        return NULL;
+    }
+    int cryptWords = cryptScratchLen(m->size);
+    *scratch = threadScratch(words > cryptWords ? words : cryptWords);
+    if (*scratch == NULL) {
+        *ret = FAILED_OUT_OF_MEMORY;
+        return NULL;
+    }
+    RSABigNum *owner = (RSABigNum *) m;
+    Modulus *modulus = __atomic_load_n(&owner->modulus, __ATOMIC_ACQUIRE);
+    if (modulus != NULL) {
+        return modulus;
+    }
+    modulus = malloc(sizeof(Modulus));
+    if (modulus == NULL) {
+        *ret = FAILED_OUT_OF_MEMORY;
+        return NULL;
+    }
+    BigInt mod = {(u32 *) m->value, m->size};
+    *ret = initModulus(modulus, &mod, *scratch);
+    if (*ret != CRYPT_SUCCESS) {
+        free(modulus);
+        return NULL;
+    }
+    Modulus *expected = NULL;
+    if (!__atomic_compare_exchange_n(&owner->modulus, &expected, modulus, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(modulus);
+        modulus = expected;
+    }
+    return modulus;
+}
+
+/**
+ * out = a mod n, out takes the modulus size words.
+ */
+static CryptResult reduceBigNum(const RSABigNum *a, const Modulus *modulus, u32 *out, RSAScratch *scratch) {
+    int len = modulus->size;
+    if (a->size < len || (a->size == len && compareArray(a->value, modulus->value, len) < 0)) {
+        memset(out, 0, (len - a->size) << 2);
+        memcpy(out + (len - a->size), a->value, a->size << 2);
+        return CRYPT_SUCCESS;
+    }
+    u32 t[RSA_KEY_CAPACITY];
+    memcpy(t, a->value, a->size << 2);
+    return reduceWords(t, a->size, modulus->value, len, out, scratch);
+}
+
+/**
+ * x = x * y mod n, x and y take the modulus size words.
+ */
+static CryptResult modMultiplyWords(u32 *x, u32 *y, const Modulus *modulus, RSAScratch *scratch) {
+    int len = modulus->size;
+    int mark = scratch->used;
+    u32 *product = scratchAlloc(scratch, len << 1);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(len));
+    if (k_scratch == NULL) {
+        scratch->used = mark;
+        return FAILED_OUT_OF_MEMORY;
+    }
+    // x * y / R, then * R^2 / R
+    montgomeryMultiply(x, y, modulus->value, len, modulus->inv, product, k_scratch);
+    memcpy(x, product, len << 2);
+    montgomeryMultiply(x, (u32 *) modulus->rr, modulus->value, len, modulus->inv, product, k_scratch);
+    memcpy(x, product, len << 2);
+    scratch->used = mark;
+    return CRYPT_SUCCESS;
+}
+
+CryptResult rsa_bignum_new(const ByteArray *magnitude, RSABigNum **out) {
+    if (magnitude == NULL || magnitude->len < 0 || out == NULL || (magnitude->len > 0 && magnitude->value == NULL)) {
+        return FAILED_INVALID_INPUT;
+    }
+    // Only the magnitude counts, the leading zeros (the sign byte of Java) are skipped.
+    ByteArray bytes = *magnitude;
+    while (bytes.len > 0 && bytes.value[0] == 0) {
+        bytes.value++;
+        bytes.len--;
+    }
+    if (bytes.len > RSA_BIGNUM_MAX_BYTES) {
+        return FAILED_INPUT_TOO_LARGE;
+    }
+    u32 buffer[RSA_KEY_CAPACITY];
+    BigInt n;
+    n.value = buffer;
+    bytesToBigInt(&bytes, &n);
+    return newBigNum(buffer, n.size, out);
+}
+
+void rsa_bignum_free(RSABigNum *n) {
+    if (n != NULL) {
+        if (n->modulus != NULL) {
+            secure_wipe(n->modulus, sizeof(Modulus));
+            free(n->modulus);
+        }
+        secure_wipe(n, sizeof(RSABigNum));
+        free(n);
+    }
+}
+
+int rsa_bignum_bits(const RSABigNum *n) {
+    BigInt t = {(u32 *) n->value, n->size};
+    return bitLength(&t);
+}
+
+int rsa_bignum_to_bytes(const RSABigNum *n, uint8_t *out) {
+    int len = (rsa_bignum_bits(n) + 7) >> 3;
+    for (int i = 0; i < len; i++) {
+        int k = len - 1 - i;
+        out[i] = (uint8_t) (n->value[n->size - 1 - (k >> 2)] >> ((k & 3) << 3));
+    }
+    return len;
+}
+
+CryptResult rsa_bignum_mod_pow(const RSABigNum *base, const RSABigNum *exponent, const RSABigNum *modulus,
+                               RSABigNum **out) {
+    if (base == NULL || exponent == NULL || modulus == NULL || out == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAScratch *scratch;
+    CryptResult ret;
+    // The exponent could be longer than the modulus, take the window of the longest one.
+    int words = modPowScratchLen(modulus->size, windowBits(RSA_BIGNUM_MAX_BYTES << 3));
+    const Modulus *m = bigNumModulus(modulus, words, &scratch, &ret);
+    if (m == NULL) {
+        return ret;
+    }
+    int len = m->size;
+    u32 x[RSA_KEY_CAPACITY], y[RSA_KEY_CAPACITY];
+    ret = reduceBigNum(base, m, x, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    BigInt b = trimmed(x, len);
+    if (exponent->size == 0 || b.size == 0) {
+        // x^0 = 1, 0^e = 0
+        memset(y, 0, len << 2);
+        y[len - 1] = exponent->size == 0 ? 1 : 0;
+        return newBigNum(y, len, out);
+    }
+    BigInt e = {(u32 *) exponent->value, exponent->size}, r = {y, 0};
+    ret = modPow(&b, &e, m, &r, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return newBigNum(r.value, r.size, out);
+}
+
+CryptResult rsa_bignum_mod_multi_pow(const RSABigNum *const *bases, const RSABigNum *const *exponents, int count,
+                                     const RSABigNum *modulus, RSABigNum **out) {
+    if (bases == NULL || exponents == NULL || count < 1 || count > RSA_BIGNUM_MAX_MULTI_POW || modulus == NULL ||
+        out == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    for (int i = 0; i < count; i++) {
+        if (bases[i] == NULL || exponents[i] == NULL) {
+            return FAILED_INVALID_INPUT;
+        }
+    }
+    if (count == 1) {
+        return rsa_bignum_mod_pow(bases[0], exponents[0], modulus, out);
+    }
+    RSAScratch *scratch;
+    CryptResult ret;
+    int words = multiPowScratchLen(modulus->size, count, RSA_BIGNUM_MAX_BYTES << 3);
+    int powWords = modPowScratchLen(modulus->size, windowBits(RSA_BIGNUM_MAX_BYTES << 3));
+    const Modulus *m = bigNumModulus(modulus, words > powWords ? words : powWords, &scratch, &ret);
+    if (m == NULL) {
+        return ret;
+    }
+    int len = m->size;
+    u32 x[RSA_BIGNUM_MAX_MULTI_POW][RSA_KEY_CAPACITY], y[RSA_KEY_CAPACITY];
+    BigInt b[RSA_BIGNUM_MAX_MULTI_POW], e[RSA_BIGNUM_MAX_MULTI_POW];
+    for (int i = 0; i < count; i++) {
+        ret = reduceBigNum(bases[i], m, x[i], scratch);
+        if (ret != CRYPT_SUCCESS) {
+            return ret;
+        }
+        b[i].value = x[i];
+        b[i].size = len;
+        e[i].value = (u32 *) exponents[i]->value;
+        e[i].size = exponents[i]->size;
+    }
+    BigInt r = {y, 0};
+#if RSA_AVX
+    if (m->engine != AVX_NONE) {
+        // The vector engine runs one exponentiation several times faster than the scalar interleaving
+        // (2 to 4 times with 2 bases), so exponentiate each base on it and multiply.
+        u32 z[RSA_KEY_CAPACITY];
+        memset(y, 0, len << 2);
+        y[len - 1] = 1;
+        for (int i = 0; i < count && ret == CRYPT_SUCCESS; i++) {
+            BigInt base = trimmed(x[i], len);
+            if (e[i].size == 0) {
+                continue;
+            }
+            if (base.size == 0) {
+                memset(y, 0, len << 2);
+                break;
+            }
+            BigInt power = {z, 0};
+            ret = modPow(&base, &e[i], m, &power, scratch);
+            if (ret == CRYPT_SUCCESS && power.size < len) {
+                // x^1 is the base trimmed.
+                memmove(z + (len - power.size), z, power.size << 2);
+                memset(z, 0, (len - power.size) << 2);
+            }
+            if (ret == CRYPT_SUCCESS) {
+                ret = modMultiplyWords(y, z, m, scratch);
+            }
+        }
+        r.size = len;
+    } else {
+        ret = multiPow(b, e, count, m, &r, scratch);
+    }
+#else
+    ret = multiPow(b, e, count, m, &r, scratch);
+#endif
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return newBigNum(r.value, r.size, out);
+}
+
+CryptResult rsa_bignum_mod_mul(const RSABigNum *a, const RSABigNum *b, const RSABigNum *modulus,
+                               RSABigNum **out) {
+    if (a == NULL || b == NULL || modulus == NULL || out == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAScratch *scratch;
+    CryptResult ret;
+    const Modulus *m = bigNumModulus(modulus, 0, &scratch, &ret);
+    if (m == NULL) {
+        return ret;
+    }
+    int len = m->size;
+    u32 x[RSA_KEY_CAPACITY], y[RSA_KEY_CAPACITY];
+    ret = reduceBigNum(a, m, x, scratch);
+    if (ret == CRYPT_SUCCESS) {
+        ret = reduceBigNum(b, m, y, scratch);
+    }
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+
+    ret = modMultiplyWords(x, y, m, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    return newBigNum(x, len, out);
+}
+
+CryptResult rsa_bignum_mod_inverse(const RSABigNum *a, const RSABigNum *modulus, RSABigNum **out) {
+    if (a == NULL || modulus == NULL || out == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+    RSAScratch *scratch;
+    CryptResult ret;
+    const Modulus *m = bigNumModulus(modulus, 0, &scratch, &ret);
+    if (m == NULL) {
+        return ret;
+    }
+    int len = m->size;
+    u32 x[RSA_KEY_CAPACITY], y[RSA_KEY_CAPACITY];
+    ret = reduceBigNum(a, m, x, scratch);
+    if (ret != CRYPT_SUCCESS) {
+        return ret;
+    }
+    if (modInverse(x, m->value, len, y) != CRYPT_SUCCESS) {
+        // Not coprime with the modulus.
+        return FAILED_INVALID_INPUT;
+    }
+    return newBigNum(y, len, out);
+}
+
+/*
+ * Key generation.
+ *
+ * Each prime is searched in windows of KEYGEN_SIEVE_WINDOW odd numbers from a random odd start.
+ * The window is sieved by the small primes first (the remainders of the start are computed once per window),
+ * the survivors with gcd(e, w - 1) = 1 are tested by Miller-Rabin, which runs on modPow.
+ */
+
+// Odd small primes for the sieve, 3 ... 17891
+#define KEYGEN_SIEVE_PRIMES 2048
+#define KEYGEN_SIEVE_LIMIT 17900
+#define KEYGEN_SIEVE_WINDOW 4096
+// Words of one prime, 2048 bits at most.
+#define KEYGEN_PRIME_CAPACITY 64
+
+static u32 sieve_primes[KEYGEN_SIEVE_PRIMES];
+static pthread_once_t sieve_primes_once = PTHREAD_ONCE_INIT;
+
+static void initSievePrimes() {
+    uint8_t composite[KEYGEN_SIEVE_LIMIT];
+    memset(composite, 0, sizeof(composite));
+    int count = 0;
+    for (u32 i = 3; i < KEYGEN_SIEVE_LIMIT && count < KEYGEN_SIEVE_PRIMES; i += 2) {
+        if (composite[i]) {
+            continue;
+        }
+        sieve_primes[count++] = i;
+        for (u32 j = i * i; j < KEYGEN_SIEVE_LIMIT; j += i << 1) {
+            composite[j] = 1;
+        }
+    }
+}
+
+typedef struct {
+    int bits;      // bits of the modulus
+    int primeLen;  // words of each prime
+    u32 e;
+    int rounds;    // Miller-Rabin rounds
+    pthread_mutex_t lock;
+    int found;
+    int done;
+    int failed;
+    u32 primes[2][KEYGEN_PRIME_CAPACITY];
+} KeyGenState;
+
+static u32 modWord(const u32 *a, int len, u32 m) {
+    u64 r = 0;
+    for (int i = 0; i < len; i++) {
+        r = ((r << 32) | a[i]) % m;
+    }
+    return (u32) r;
+}
+
+static u32 gcdWord(u32 a, u32 b) {
+    while (b != 0) {
+        u32 t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * a^-1 mod m, a and m are coprime.
+ */
+static u32 inverseWord(u32 a, u32 m) {
+    i64 t = 0, newT = 1;
+    i64 r = m, newR = a;
+    while (newR != 0) {
+        i64 q = r / newR;
+        i64 tmp = t - q * newT;
+        t = newT;
+        newT = tmp;
+        tmp = r - q * newR;
+        r = newR;
+        newR = tmp;
+    }
+    return (u32) (t < 0 ? t + m : t);
+}
+
+/**
+ * out = e^-1 mod m (len words, even, e coprime with m), with the trick for the small e:
+ * e * d = 1 + k * m, k = -(m^-1) mod e, so d = (1 + k * m) / e, and d < m for k < e.
+ * out takes len words.
+ */
+static void inverseOfSmallExponent(const u32 *m, int len, u32 e, u32 *out) {
+    u32 k = e - inverseWord(modWord(m, len, e), e);
+    u32 t[RSA_KEY_CAPACITY + 1];
+    memset(t, 0, (len + 1) << 2);
+    t[0] = mulAdd(t, len + 1, m, 0, len, k);
+    // k * m is even
+    t[len] |= 1;
+
+    u64 rem = 0;
+    for (int i = 0; i <= len; i++) {
+        u64 cur = (rem << 32) | t[i];
+        t[i] = (u32) (cur / e);
+        rem = cur % e;
+    }
+    memcpy(out, t + 1, len << 2);
+}
+
+static int isDone(KeyGenState *state) {
+    return __atomic_load_n(&state->done, __ATOMIC_RELAXED);
+}
+
+/**
+ * Miller-Rabin test of w (odd, len words without leading zeros), the first witness is 2, the others are random.
+ * x = a^d by modPow, then the squares of x stay in Montgomery form, compared with R and -R mod w (1 and w - 1).
+ * Returns 0 if w is composite or the search is done by other thread.
+ */
+static int millerRabin(u32 *w, int len, KeyGenState *state, RSAScratch *scratch) {
+    u32 wm1[KEYGEN_PRIME_CAPACITY], d[KEYGEN_PRIME_CAPACITY], a[KEYGEN_PRIME_CAPACITY], x[KEYGEN_PRIME_CAPACITY];
+    u32 one[KEYGEN_PRIME_CAPACITY], minusOne[KEYGEN_PRIME_CAPACITY];
+    memcpy(wm1, w, len << 2);
+    wm1[len - 1] &= ~1u;
+
+    // w - 1 = 2^s * d
+    int s = 0;
+    while (wm1[len - 1 - (s >> 5)] == 0) {
+        s += 32;
+    }
+    s += numberOfTrailingZeros(wm1[len - 1 - (s >> 5)]);
+    memcpy(d, wm1, len << 2);
+    int words = s >> 5;
+    memmove(d + words, d, (len - words) << 2);
+    memset(d, 0, words << 2);
+    primitiveRightShift(d, len, s & 31);
+
+    // The setup of the modulus is shared by all the rounds.
+    Modulus mod;
+    BigInt prime = {w, len};
+    if (initModulus(&mod, &prime, scratch) != CRYPT_SUCCESS) {
+        return 0;
+    }
+    BigInt exp = trimmed(d, len);
+    BigInt out = {x, 0};
+
+    int mark = scratch->used;
+    if (scratch->used + (len << 1) + KARATSUBA_SCRATCH_LEN(len) > scratch->capacity) {
+        return 0;
+    }
+    u32 *product = scratchAlloc(scratch, len << 1);
+    u32 *k_scratch = scratchAlloc(scratch, KARATSUBA_SCRATCH_LEN(len));
+
+    // one = R mod w, minusOne = w - R mod w
+    BigInt unit = {a, 1};
+    a[0] = 1;
+    toMontgomery(&unit, &mod, one, minusOne, product, k_scratch);
+    memcpy(minusOne, w, len << 2);
+    subN(minusOne, one, len);
+
+    int probablePrime = 1;
+    for (int round = 0; probablePrime && round < state->rounds; round++) {
+        if (isDone(state)) {
+            probablePrime = 0;
+            break;
+        }
+        // The witness a in [2, w - 2]
+        memset(a, 0, len << 2);
+        if (round == 0) {
+            a[len - 1] = 2;
+        } else {
+            do {
+                getRandom((uint8_t *) a, len << 2);
+                a[0] %= w[0];
+            } while ((trimmed(a, len).size <= 1 && a[len - 1] < 2) || compareArray(a, wm1, len) == 0);
+        }
+
+        BigInt base = trimmed(a, len);
+        if (modPow(&base, &exp, &mod, &out, scratch) != CRYPT_SUCCESS) {
+            probablePrime = 0;
+            break;
+        }
+        BigInt result = trimmed(x, len);
+        if ((result.size == 1 && result.value[0] == 1) || compareArray(x, wm1, len) == 0) {
+            continue;
+        }
+        BigInt current = {x, len};
+        toMontgomery(&current, &mod, x, a, product, k_scratch);
+        probablePrime = 0;
+        for (int j = 1; j < s; j++) {
+            montgomerySquare(x, mod.value, len, mod.inv, product, k_scratch);
+            memcpy(x, product, len << 2);
+            if (compareArray(x, minusOne, len) == 0) {
+                probablePrime = 1;
+                break;
+            }
+            if (compareArray(x, one, len) == 0) {
+                break;
+            }
+        }
+    }
+
+    scratch->used = mark;
+    return probablePrime;
+}
+
+/**
+ * Search one probable prime of primeLen words, with the top 2 bits set (so n = p * q takes all the bits),
+ * and gcd(e, p - 1) = 1. Returns 0 if the search is done by other thread.
+ */
+static int searchPrime(KeyGenState *state, u32 *prime, RSAScratch *scratch) {
+    pthread_once(&sieve_primes_once, initSievePrimes);
+    int len = state->primeLen;
+    u32 e = state->e;
+    u32 start[KEYGEN_PRIME_CAPACITY];
+    uint8_t sieve[KEYGEN_SIEVE_WINDOW];
+
+    while (!isDone(state)) {
+        getRandom((uint8_t *) start, len << 2);
+        start[0] |= 0xC0000000;
+        start[len - 1] |= 1;
+        // The window must not carry out of the top word.
+        if (start[0] > 0xFFFFFFFF - KEYGEN_SIEVE_WINDOW * 2) {
+            continue;
+        }
+
+        // sieve[k] = 1 if start + 2k has a small factor
+        memset(sieve, 0, sizeof(sieve));
+        for (int i = 0; i < KEYGEN_SIEVE_PRIMES; i++) {
+            u32 p = sieve_primes[i];
+            u32 r = modWord(start, len, p);
+            // start + 2k = 0 (mod p), k = -r / 2 (mod p)
+            u32 k = (u32) (((u64) (r == 0 ? 0 : p - r) * ((p + 1) >> 1)) % p);
+            for (; k < KEYGEN_SIEVE_WINDOW; k += p) {
+                sieve[k] = 1;
+            }
+        }
+
+        u32 rE = modWord(start, len, e);
+        for (int k = 0; k < KEYGEN_SIEVE_WINDOW; k++) {
+            if (sieve[k]) {
+                continue;
+            }
+            // gcd(e, w - 1) = 1
+            u32 rm1 = (u32) (((u64) rE + (u64) (k << 1) + e - 1) % e);
+            if (gcdWord(e, rm1) != 1) {
+                continue;
+            }
+            u32 offset = k << 1;
+            memcpy(prime, start, len << 2);
+            addInto(prime, len, &offset, 1);
+            if (millerRabin(prime, len, state, scratch)) {
+                return 1;
+            }
+            if (isDone(state)) {
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * |p - q| > 2^(bits / 2 - 100), as FIPS 186-4 B.3.3.
+ */
+static int farEnough(const u32 *p, const u32 *q, int len) {
+    u32 diff[KEYGEN_PRIME_CAPACITY];
+    if (compareArray(p, q, len) >= 0) {
+        memcpy(diff, p, len << 2);
+        subN(diff, q, len);
+    } else {
+        memcpy(diff, q, len << 2);
+        subN(diff, p, len);
+    }
+    BigInt d = trimmed(diff, len);
+    return bitLength(&d) > (len << 5) - 100;
+}
+
+static void *keyGenWorker(void *arg) {
+    KeyGenState *state = (KeyGenState *) arg;
+    int len = state->primeLen;
+    RSAScratch *scratch = threadScratch(cryptScratchLen(len));
+    if (scratch == NULL) {
+        pthread_mutex_lock(&state->lock);
+        state->failed = 1;
+        __atomic_store_n(&state->done, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&state->lock);
+        return NULL;
+    }
+
+    u32 prime[KEYGEN_PRIME_CAPACITY];
+    while (searchPrime(state, prime, scratch)) {
+        pthread_mutex_lock(&state->lock);
+        if (state->found < 2 && (state->found == 0 || farEnough(state->primes[0], prime, len))) {
+            memcpy(state->primes[state->found++], prime, len << 2);
+            if (state->found == 2) {
+                __atomic_store_n(&state->done, 1, __ATOMIC_RELAXED);
+            }
+        }
+        pthread_mutex_unlock(&state->lock);
+    }
+    memset(prime, 0, sizeof(prime));
+    return NULL;
+}
+
+/**
+ * Write the DER length at out, returns the bytes written.
+ */
+static int derLength(uint8_t *out, int len) {
+    if (len < 0x80) {
+        out[0] = len;
+        return 1;
+    } else if (len < 0x100) {
+        out[0] = 0x81;
+        out[1] = len;
+        return 2;
+    }
+    out[0] = 0x82;
+    out[1] = len >> 8;
+    out[2] = len;
+    return 3;
+}
+
+/**
+ * Write the DER INTEGER of a (len words, non-negative), returns the bytes written.
+ */
+static int derInteger(uint8_t *out, const u32 *a, int len) {
+    uint8_t bytes[RSA_MAX_BLOCK_SIZE + 1];
+    bytes[0] = 0;
+    for (int i = 0; i < len; i++) {
+        u32 x = a[i];
+        bytes[(i << 2) + 1] = x >> 24;
+        bytes[(i << 2) + 2] = x >> 16;
+        bytes[(i << 2) + 3] = x >> 8;
+        bytes[(i << 2) + 4] = x;
+    }
+    int total = (len << 2) + 1;
+    // Keep one leading zero if the high bit is set, and one byte for zero.
+    int from = 0;
+    while (from < total - 1 && bytes[from] == 0 && (bytes[from + 1] & 0x80) == 0) {
+        from++;
+    }
+    int n = total - from;
+    out[0] = 0x02;
+    int offset = 1 + derLength(out + 1, n);
+    memcpy(out + offset, bytes + from, n);
+    memset(bytes, 0, sizeof(bytes));
+    return offset + n;
+}
+
+/**
+ * Write the DER SEQUENCE of the integers, returns the bytes written.
+ */
+static int derSequence(uint8_t *out, const u32 **integers, const int *lens, int count) {
+    // The content is written after the largest header (4 bytes), then moved to the header.
+    uint8_t *content = out + 4;
+    int contentLen = 0;
+    for (int i = 0; i < count; i++) {
+        contentLen += derInteger(content + contentLen, integers[i], lens[i]);
+    }
+    out[0] = 0x30;
+    int offset = 1 + derLength(out + 1, contentLen);
+    memmove(out + offset, content, contentLen);
+    return offset + contentLen;
+}
+
+CryptResult rsa_generate_key(int bits, uint32_t e, int threads, ByteArray *privateKey, ByteArray *publicKey) {
+    if (bits != 1024 && bits != 2048 && bits != 3072 && bits != 4096) {
+        return FAILED_INVALID_INPUT;
+    }
+    if ((e & 1) == 0 || e < 3 || threads < 1 || privateKey == NULL || publicKey == NULL) {
+        return FAILED_INVALID_INPUT;
+    }
+
+    KeyGenState state;
+    memset(&state, 0, sizeof(state));
+    state.bits = bits;
+    state.primeLen = bits >> 6;
+    state.e = e;
+    // Rounds for the error probability 2^-100, FIPS 186-4 table C.3
+    state.rounds = bits == 1024 ? 7 : (bits == 2048 ? 5 : 4);
+    pthread_mutex_init(&state.lock, NULL);
+
+    // More threads than the CPUs only slow the search down.
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus >= 1 && threads > cpus) {
+        threads = (int) cpus;
+    }
+    if (threads > RSA_MAX_KEYGEN_THREADS) {
+        threads = RSA_MAX_KEYGEN_THREADS;
+    }
+    pthread_t workers[RSA_MAX_KEYGEN_THREADS];
+    int started = 0;
+    for (int i = 1; i < threads; i++) {
+        if (pthread_create(&workers[started], NULL, keyGenWorker, &state) == 0) {
+            started++;
+        }
+    }
+    keyGenWorker(&state);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&state.lock);
+    if (state.failed || state.found != 2) {
+        memset(&state, 0, sizeof(state));
+        return FAILED_OUT_OF_MEMORY;
+    }
+
+    int len = state.primeLen;
+    int nLen = len << 1;
+    // p > q, so the coefficient is q^-1 mod p
+    u32 *p = state.primes[0];
+    u32 *q = state.primes[1];
+    if (compareArray(p, q, len) < 0) {
+        p = state.primes[1];
+        q = state.primes[0];
+    }
+
+    u32 n[RSA_KEY_CAPACITY], phi[RSA_KEY_CAPACITY], d[RSA_KEY_CAPACITY];
+    u32 pm1[KEYGEN_PRIME_CAPACITY], qm1[KEYGEN_PRIME_CAPACITY];
+    u32 dp[KEYGEN_PRIME_CAPACITY], dq[KEYGEN_PRIME_CAPACITY], qInv[KEYGEN_PRIME_CAPACITY];
+    multiplyToLen(p, len, q, len, n);
+    memcpy(pm1, p, len << 2);
+    memcpy(qm1, q, len << 2);
+    pm1[len - 1] &= ~1u;
+    qm1[len - 1] &= ~1u;
+    multiplyToLen(pm1, len, qm1, len, phi);
+
+    inverseOfSmallExponent(phi, nLen, e, d);
+    inverseOfSmallExponent(pm1, len, e, dp);
+    inverseOfSmallExponent(qm1, len, e, dq);
+
+    // qInv = q^(p - 2) mod p
+    u32 pm2[KEYGEN_PRIME_CAPACITY];
+    memcpy(pm2, p, len << 2);
+    pm2[len - 1] -= 2;
+    if (p[len - 1] < 2) {
+        for (int i = len - 2; i >= 0 && pm2[i]-- == 0; i--) {
+        }
+    }
+    RSAScratch *scratch = threadScratch(cryptScratchLen(len));
+    int ret = FAILED_OUT_OF_MEMORY;
+    if (scratch != NULL) {
+        BigInt base = trimmed(q, len), exp = trimmed(pm2, len), prime = {p, len}, out = {qInv, 0};
+        Modulus mod;
+        ret = initModulus(&mod, &prime, scratch);
+        if (ret == CRYPT_SUCCESS) {
+            ret = modPowSecret(&base, &exp, &mod, &out, scratch);
+        }
+    }
+
+    if (ret == CRYPT_SUCCESS) {
+        u32 version = 0;
+        const u32 *privateInts[] = {&version, n, &e, d, p, q, dp, dq, qInv};
+        const int privateLens[] = {1, nLen, 1, nLen, len, len, len, len, len};
+        privateKey->len = derSequence(privateKey->value, privateInts, privateLens, 9);
+        const u32 *publicInts[] = {n, &e};
+        const int publicLens[] = {nLen, 1};
+        publicKey->len = derSequence(publicKey->value, publicInts, publicLens, 2);
     }
 
+    memset(&state, 0, sizeof(state));
+    memset(phi, 0, sizeof(phi));
+    memset(d, 0, sizeof(d));
+    memset(pm1, 0, sizeof(pm1));
+    memset(qm1, 0, sizeof(qm1));
+    memset(pm2, 0, sizeof(pm2));
+    memset(dp, 0, sizeof(dp));
+    memset(dq, 0, sizeof(dq));
+    memset(qInv, 0, sizeof(qInv));
     return ret;
 }
@@ -5,6 +5,15 @@
 #include <stdint.h>
 #include "array.h"
 
+// The block size of 4096 bits key, the largest key we support.
+#define RSA_MAX_BLOCK_SIZE 512
+
+// PKCS#1 DER of the 4096 bits key pair made by rsa_generate_key.
+#define RSA_MAX_PRIVATE_KEY_DER_SIZE 2400
+#define RSA_MAX_PUBLIC_KEY_DER_SIZE 540
+// Threads taken by rsa_generate_key at most.
+#define RSA_MAX_KEYGEN_THREADS 16
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -16,24 +25,74 @@ typedef enum {
     FAILED_INVALID_KEY,
     FAILED_INPUT_TOO_LARGE,
     FAILED_INVALID_INPUT,
+    FAILED_INVALID_SIGNATURE,
 } CryptResult;
 
 typedef enum {
+    // PKCS#1 v1.5 padding, type 1 with the private key, type 2 with the public key.
     ENCRYPT,
-    DECRYPT
+    DECRYPT,
+    // RSAES-OAEP with SHA-256, MGF1-SHA256 and the empty label,
+    // encrypt with the public key and decrypt with the private key only.
+    OAEP_ENCRYPT,
+    OAEP_DECRYPT
 } CipherMode;
 
+// Signature schemes with SHA-256.
+typedef enum {
+    // RSASSA-PKCS1-v1_5
+    SIGN_PKCS1 = 1,
+    // RSASSA-PSS, MGF1 with SHA-256, 32 bytes salt.
+    SIGN_PSS = 2
+} SignPadding;
+
 typedef enum {
     PRIVATE_KEY = 1,
     PUBLIC_KEY = 2
 } KeyType;
 
+// Primes of the multi-prime key, PKCS#1 v2.2 allows more, we take 4 at most.
+#define RSA_MAX_PRIMES 4
+
+/**
+ * The CRT params of the private key (RSAPrivateKey of PKCS#1 v2.2, with the OtherPrimeInfos):
+ * primes: p, q, then the other primes r_i.
+ * exponents: d mod (prime - 1) of each prime.
+ * coefficients: [0] is qInv = q^-1 mod p, [1] is not used (q starts the recombination),
+ *               [i] = (p * q * ... * r_i-1)^-1 mod r_i for the other primes.
+ */
+typedef struct {
+    int count; // 2 to RSA_MAX_PRIMES
+    ByteArray *primes[RSA_MAX_PRIMES];
+    ByteArray *exponents[RSA_MAX_PRIMES];
+    ByteArray *coefficients[RSA_MAX_PRIMES];
+    // Non-zero to run the exponentiations of the primes concurrently on the thread pool (see thread_pool.h),
+    // for the latency of one private-key operation rather than the throughput.
+    int parallel;
+} RSACrtParams;
+
 typedef struct {
     ByteArray *exponent;
     ByteArray *modulus;
     KeyType key_type;
+    // The CRT params of the private key, NULL to crypt with the private exponent.
+    RSACrtParams *crt;
+    // The public exponent e of the private key, required with the CRT params, NULL if unknown.
+    // The result of each private-key operation is checked with it (result^e == input mod n).
+    ByteArray *publicExponent;
 } RSAKey;
 
+/**
+ * Memory for the temporaries of rsa_crypt (the window table of modPow, products, etc).
+ * The buffer is owned by the caller, rsa_crypt takes memory from it and gives back before return.
+ */
+typedef struct {
+    uint32_t *buffer;
+    int capacity; // in words
+    int used;     // in words
+    int peak;     // the most words ever used, in words
+} RSAScratch;
+
 
 /**
  * @param input : bytes to encrypt/decrypt.
@@ -45,6 +104,207 @@ typedef struct {
  */
 CryptResult rsa_crypt(const ByteArray *input,const RSAKey *key, const CipherMode mode, ByteArray *output);
 
+/**
+ * Same as rsa_crypt, but takes the temporaries from the scratch,
+ * rsa_crypt uses a scratch kept by the calling thread instead.
+ *
+ * @param scratch : Should have rsa_scratch_size() bytes at least,
+ *        return FAILED_OUT_OF_MEMORY if the scratch is not enough.
+ */
+CryptResult rsa_crypt_with_scratch(const ByteArray *input, const RSAKey *key, const CipherMode mode,
+                                   ByteArray *output, RSAScratch *scratch);
+
+/**
+ * Crypt the input of any length block by block (ECB) with one key, the key is set up once for all the blocks,
+ * and the blocks are crypted on the threads of the pool (see thread_pool.h).
+ *
+ * Encryption splits the input into chunks of (block size - 11) bytes, or (block size - 66) for OAEP,
+ * the output is the joined ciphertext blocks, the empty input takes one block.
+ * Decryption takes the joined blocks, the output is the joined plaintexts.
+ *
+ * @param output : be sure it's 'value' point to rsa_crypt_blocks_size() bytes at least.
+ * @return The result of the first failed block, CRYPT_SUCCESS if all blocks done.
+ */
+CryptResult rsa_crypt_blocks(const ByteArray *input, const RSAKey *key, CipherMode mode, ByteArray *output);
+
+/**
+ * @return Bytes of the output taken by rsa_crypt_blocks, 0 if the key or mode is invalid.
+ */
+int rsa_crypt_blocks_size(int inputLen, const RSAKey *key, CipherMode mode);
+
+/**
+ * Crypt count inputs with one key, each input is one block as rsa_crypt.
+ * The key is set up once for all the inputs, and with the small public exponent (verify/encrypt with
+ * the public key), two inputs run in lockstep, their Montgomery reductions are interleaved.
+ *
+ * @param parallel : Nonzero to spread the inputs on the threads of the pool, 0 to crypt on the calling thread.
+ * @param outputs : count outputs, be sure each 'value' point the a space equal or large the modulus.
+ * @param results : count results, the result of each input.
+ * @return CRYPT_SUCCESS if the items are crypted (the result of each one is in results),
+ *         or the failure of the key and params.
+ */
+CryptResult rsa_crypt_batch(const ByteArray *inputs, int count, const RSAKey *key, CipherMode mode, int parallel,
+                            ByteArray *outputs, CryptResult *results);
+
+/**
+ * Verify count signatures of the messages with one public key, as rsa_verify and rsa_crypt_batch.
+ *
+ * @param results : count results, CRYPT_SUCCESS for the valid signature, FAILED_INVALID_SIGNATURE if not.
+ */
+CryptResult rsa_verify_batch(const ByteArray *messages, const ByteArray *signatures, int count, const RSAKey *key,
+                             SignPadding padding, int parallel, CryptResult *results);
+
+/**
+ * @param buffer : The memory to take, should be aligned to 4 bytes.
+ * @param size : Bytes of buffer.
+ */
+void rsa_scratch_init(RSAScratch *scratch, void *buffer, int size);
+
+/**
+ * @return Bytes of scratch needed by the crypt with the key of modulusBits (in the worst case).
+ */
+int rsa_scratch_size(int modulusBits);
+
+/**
+ * @return The peak bytes of scratch taken by one crypt with the key of modulusBits (1024/2048/3072/4096),
+ *         0 if no crypt with the key size yet.
+ */
+int rsa_scratch_peak(int modulusBits);
+
+/**
+ * Hash the message with SHA-256, encode it with the padding, and sign it with the private key.
+ *
+ * @param signature : The result will place this param,
+ *        be sure it's 'value' point the a space equal or large the modulus.
+ */
+CryptResult rsa_sign(const ByteArray *message, const RSAKey *key, SignPadding padding, ByteArray *signature);
+
+/**
+ * Verify the signature of the message with the public key.
+ *
+ * @return CRYPT_SUCCESS if the signature is valid, FAILED_INVALID_SIGNATURE if not.
+ */
+CryptResult rsa_verify(const ByteArray *message, const ByteArray *signature, const RSAKey *key,
+                       SignPadding padding);
+
+/**
+ * A key parsed and loaded in native: the words of the exponent and the modulus, the Montgomery constants,
+ * and the CRT params of the private key. Made by rsa_parse_key, read only after that,
+ * so it could be shared by the threads until rsa_free_key.
+ */
+typedef struct RSAKeyHandle RSAKeyHandle;
+
+/**
+ * Parse the key and load it to a handle.
+ *
+ * @param input : PKCS#1 RSAPrivateKey or RSAPublicKey, PKCS#8 PrivateKeyInfo (unencrypted),
+ *        or X.509 SubjectPublicKeyInfo, in DER or PEM. The type of the key is told by the structure.
+ *        The private key crypts with the CRT params (up to RSA_MAX_PRIMES primes, more primes crypt with d).
+ * @param parallel : Non-zero to run the primes concurrently, see RSACrtParams.
+ * @param handle : Gets the key, free it by rsa_free_key.
+ * @return The result, FAILED_INVALID_KEY for the malformed or unsupported key.
+ */
+CryptResult rsa_parse_key(const ByteArray *input, int parallel, RSAKeyHandle **handle);
+
+/**
+ * Wipe and free the key, NULL is ignored.
+ */
+void rsa_free_key(RSAKeyHandle *handle);
+
+KeyType rsa_key_type(const RSAKeyHandle *handle);
+
+int rsa_key_bits(const RSAKeyHandle *handle);
+
+/**
+ * rsa_crypt, rsa_sign and rsa_verify with the key handle.
+ */
+CryptResult rsa_crypt_handle(const ByteArray *input, const RSAKeyHandle *handle, CipherMode mode,
+                             ByteArray *output);
+
+CryptResult rsa_sign_handle(const ByteArray *message, const RSAKeyHandle *handle, SignPadding padding,
+                            ByteArray *signature);
+
+CryptResult rsa_verify_handle(const ByteArray *message, const ByteArray *signature, const RSAKeyHandle *handle,
+                              SignPadding padding);
+
+/**
+ * A non-negative number of up to RSA_BIGNUM_MAX_BYTES bytes kept in native, for the modular arithmetic
+ * with the Montgomery code of the RSA (Diffie-Hellman of the MODP groups, SRP, etc).
+ * Read only after made, the numbers could be shared by the threads until rsa_bignum_free.
+ *
+ * The modulus is odd and 33 bits at least. Its Montgomery constants are set up by the first operation
+ * and kept by the number, so the later operations with the same modulus take no division.
+ */
+typedef struct RSABigNum RSABigNum;
+
+#define RSA_BIGNUM_MAX_BYTES 512
+
+/**
+ * @param magnitude : The big-endian unsigned bytes, the leading zeros are skipped.
+ * @return The result, FAILED_INPUT_TOO_LARGE if the number takes more than RSA_BIGNUM_MAX_BYTES bytes.
+ */
+CryptResult rsa_bignum_new(const ByteArray *magnitude, RSABigNum **out);
+
+/**
+ * Wipe and free the number, NULL is ignored.
+ */
+void rsa_bignum_free(RSABigNum *n);
+
+int rsa_bignum_bits(const RSABigNum *n);
+
+/**
+ * @param out : Gets the big-endian bytes without the leading zeros, (rsa_bignum_bits() + 7) / 8 bytes.
+ * @return Bytes written, 0 for zero.
+ */
+int rsa_bignum_to_bytes(const RSABigNum *n, uint8_t *out);
+
+/**
+ * out = base^exponent mod modulus, as rsa_crypt, with the sliding window (or the AVX engine).
+ * The time depends on the exponent, it must not be secret (the private keys take rsa_crypt, which blinds).
+ * The operations return FAILED_INVALID_INPUT if the modulus is even or less than 33 bits,
+ * the operands larger than the modulus are reduced first.
+ */
+CryptResult rsa_bignum_mod_pow(const RSABigNum *base, const RSABigNum *exponent, const RSABigNum *modulus,
+                               RSABigNum **out);
+
+// The bases taken by rsa_bignum_mod_multi_pow at most.
+#define RSA_BIGNUM_MAX_MULTI_POW 4
+
+/**
+ * out = bases[0]^exponents[0] * bases[1]^exponents[1] * ... mod modulus, for count (1 to RSA_BIGNUM_MAX_MULTI_POW)
+ * bases, with the interleaved windows: the squares are shared by the bases, so a^x * b^y costs about one
+ * exponentiation and the windows of y, rather than two exponentiations and a multiply.
+ * The time depends on the exponents, as rsa_bignum_mod_pow.
+ */
+CryptResult rsa_bignum_mod_multi_pow(const RSABigNum *const *bases, const RSABigNum *const *exponents, int count,
+                                     const RSABigNum *modulus, RSABigNum **out);
+
+/**
+ * out = a * b mod modulus.
+ */
+CryptResult rsa_bignum_mod_mul(const RSABigNum *a, const RSABigNum *b, const RSABigNum *modulus,
+                               RSABigNum **out);
+
+/**
+ * out = a^-1 mod modulus, FAILED_INVALID_INPUT if a is not coprime with the modulus.
+ * It takes the time of the value (the binary extended Euclid), so not for the secrets.
+ */
+CryptResult rsa_bignum_mod_inverse(const RSABigNum *a, const RSABigNum *modulus, RSABigNum **out);
+
+/**
+ * Generate a RSA key pair.
+ *
+ * @param bits : 1024/2048/3072/4096.
+ * @param e : The public exponent, odd and larger than 1, 65537 mostly.
+ * @param threads : Threads to search the primes, 1 to search on the calling thread only.
+ *        Clamped to the online CPUs and RSA_MAX_KEYGEN_THREADS.
+ * @param privateKey : PKCS#1 RSAPrivateKey (with the CRT params) in DER,
+ *        be sure it's 'value' point to RSA_MAX_PRIVATE_KEY_DER_SIZE bytes.
+ * @param publicKey : PKCS#1 RSAPublicKey in DER, be sure it's 'value' point to RSA_MAX_PUBLIC_KEY_DER_SIZE bytes.
+ * @return The result, FAILED_INVALID_INPUT for the illegal params.
+ */
+CryptResult rsa_generate_key(int bits, uint32_t e, int threads, ByteArray *privateKey, ByteArray *publicKey);
+
 #ifdef __cplusplus
 }
 #endif
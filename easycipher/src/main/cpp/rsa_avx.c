@@ -0,0 +1,442 @@
+/**
+ * Montgomery exponentiation with AVX2 and AVX-512 IFMA, for the x86_64 devices.
+ *
+ * The numbers are converted once per exponentiation into a redundant representation:
+ * little-endian limbs of r bits (r = 29 for AVX2, 52 for IFMA), one limb in each 64 bits lane,
+ * so the products and the sums of one Montgomery multiplication (AMM, the almost Montgomery multiplication)
+ * are accumulated in the lanes without carry propagation.
+ *
+ * AMM(a, b) = a * b / R' mod n, R' = 2^(r * L) > 4n, for a, b < 2n the result is less than 2n,
+ * so the values are kept in [0, 2n) during the exponentiation, and reduced only at the end.
+ *
+ * For each limb b[i] of b, the accumulator takes a * b[i] + n * y, y is chosen to clear the lowest limb,
+ * then the accumulator shifts right by one lane. With AVX2 (32 x 32 bits products), a lane takes 2^59 at most
+ * for each limb, so the lanes are normalized every AVX2_NORMALIZE_INTERVAL limbs to avoid overflow.
+ * With IFMA the low and high 52 bits of the products are added to the lanes separately,
+ * a lane takes 2^54 at most for each limb, no overflow for the moduli up to 4096 bits.
+ */
+
+#include "rsa_avx.h"
+
+#if RSA_AVX
+
+#include <immintrin.h>
+#include <string.h>
+
+#define AVX2_RADIX 29
+#define AVX2_MASK ((1ULL << AVX2_RADIX) - 1)
+#define AVX2_NORMALIZE_INTERVAL 16
+#define IFMA_RADIX 52
+#define IFMA_MASK ((1ULL << IFMA_RADIX) - 1)
+
+// Fixed window, the table takes 2^AVX_WINDOW_BITS numbers.
+#define AVX_WINDOW_BITS 5
+#define AVX_TABLE_SIZE (1 << AVX_WINDOW_BITS)
+
+// Lanes for the 4096 bits modulus: 142 limbs for AVX2, 79 limbs for IFMA.
+#define AVX2_MAX_REGS 36
+#define IFMA_MAX_REGS 10
+
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+typedef void (*AmmFunc)(u64 *out, const u64 *a, const u64 *b, const u64 *n, u64 k0, int limbs, int regs);
+
+AvxEngine avx_engine() {
+    static int engine = -1;
+    int e = __atomic_load_n(&engine, __ATOMIC_RELAXED);
+    if (e < 0) {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma")) {
+            e = AVX_512_IFMA;
+        } else if (__builtin_cpu_supports("avx2")) {
+            e = AVX_2;
+        } else {
+            e = AVX_NONE;
+        }
+        __atomic_store_n(&engine, e, __ATOMIC_RELAXED);
+    }
+    return (AvxEngine) e;
+}
+
+static int radixBits(AvxEngine engine) {
+    return engine == AVX_512_IFMA ? IFMA_RADIX : AVX2_RADIX;
+}
+
+static int lanesPerReg(AvxEngine engine) {
+    return engine == AVX_512_IFMA ? 8 : 4;
+}
+
+/**
+ * Limbs for the modulus of modLen words, R' = 2^(r * limbs) should be larger than 4n.
+ */
+static int limbCount(AvxEngine engine, int modLen) {
+    int r = radixBits(engine);
+    return ((modLen << 5) + 2 + r - 1) / r;
+}
+
+static int regCount(AvxEngine engine, int modLen) {
+    int lanes = lanesPerReg(engine);
+    return (limbCount(engine, modLen) + lanes - 1) / lanes;
+}
+
+int avx_montgomery_bits(AvxEngine engine, int modLen) {
+    return radixBits(engine) * limbCount(engine, modLen);
+}
+
+/**
+ * N, one, x, the table, and 64 bytes for the alignment.
+ */
+int avx_scratch_len(AvxEngine engine, int modLen) {
+    int lanes = regCount(engine, modLen) * lanesPerReg(engine);
+    return ((AVX_TABLE_SIZE + 3) * lanes << 1) + 16;
+}
+
+/**
+ * Big-endian 32 bits words to the little-endian limbs of r bits, the lanes above the limbs are zero.
+ */
+static void toLimbs(const u32 *in, int len, int r, u64 *out, int lanes) {
+    u64 mask = (1ULL << r) - 1;
+    memset(out, 0, lanes << 3);
+    unsigned __int128 acc = 0;
+    int accBits = 0;
+    int j = 0;
+    for (int i = len - 1; i >= 0; i--) {
+        acc |= ((unsigned __int128) in[i]) << accBits;
+        accBits += 32;
+        while (accBits >= r) {
+            out[j++] = (u64) acc & mask;
+            acc >>= r;
+            accBits -= r;
+        }
+    }
+    if (accBits > 0) {
+        out[j] = (u64) acc;
+    }
+}
+
+/**
+ * Little-endian normalized limbs of r bits to big-endian 32 bits words.
+ */
+static void fromLimbs(const u64 *in, int limbs, int r, u32 *out, int len) {
+    unsigned __int128 acc = 0;
+    int accBits = 0;
+    int j = 0;
+    for (int i = len - 1; i >= 0; i--) {
+        while (accBits < 32 && j < limbs) {
+            acc |= ((unsigned __int128) in[j++]) << accBits;
+            accBits += r;
+        }
+        out[i] = (u32) acc;
+        acc >>= 32;
+        accBits = accBits > 32 ? accBits - 32 : 0;
+    }
+}
+
+static void carryLimbs(u64 *a, int limbs, int r) {
+    u64 mask = (1ULL << r) - 1;
+    u64 carry = 0;
+    for (int i = 0; i < limbs; i++) {
+        u64 v = a[i] + carry;
+        a[i] = v & mask;
+        carry = v >> r;
+    }
+}
+
+/**
+ * -n^-1 mod 2^r, n is the lowest limb (odd).
+ */
+static u64 montgomeryK0(u64 n, int r) {
+    // Newton's iteration, each step doubles the correct bits: 3 -> 6 -> 12 -> 24 -> 48 -> 96
+    u64 inv = n;
+    for (int i = 0; i < 5; i++) {
+        inv *= 2 - n * inv;
+    }
+    return (0 - inv) & ((1ULL << r) - 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i shiftLanesIn(__m256i low, __m256i high) {
+    // [low1, low2, low3, high0]
+    __m256i l = _mm256_permute4x64_epi64(low, 0x39);
+    __m256i h = _mm256_permute4x64_epi64(high, 0x39);
+    return _mm256_blend_epi32(l, h, 0xC0);
+}
+
+/**
+ * Carry the bits above r of each lane into the next lane, in parallel.
+ * The lanes are less than 2^r + 2^(64 - r) after it. The carry out of the top lane is always zero,
+ * because the accumulated value is less than R' after the shift.
+ */
+__attribute__((target("avx2")))
+static inline void avx2Normalize(__m256i *acc, int regs) {
+    const __m256i mask = _mm256_set1_epi64x(AVX2_MASK);
+    __m256i prevCarry = _mm256_setzero_si256();
+    for (int t = 0; t < regs; t++) {
+        __m256i c = _mm256_srli_epi64(acc[t], AVX2_RADIX);
+        __m256i v = _mm256_and_si256(acc[t], mask);
+        // [prev3, c0, c1, c2]
+        __m256i up = _mm256_blend_epi32(_mm256_permute4x64_epi64(c, 0x93),
+                                        _mm256_permute4x64_epi64(prevCarry, 0x93), 0x03);
+        acc[t] = _mm256_add_epi64(v, up);
+        prevCarry = c;
+    }
+}
+
+__attribute__((target("avx2")))
+static inline __attribute__((always_inline))
+void avx2AmmRegs(u64 *out, const u64 *a, const u64 *b, const u64 *n, u64 k0, int limbs, const int regs) {
+    __m256i acc[AVX2_MAX_REGS], A[AVX2_MAX_REGS], N[AVX2_MAX_REGS];
+    for (int t = 0; t < regs; t++) {
+        A[t] = _mm256_loadu_si256((const __m256i *) (a + (t << 2)));
+        N[t] = _mm256_loadu_si256((const __m256i *) (n + (t << 2)));
+        acc[t] = _mm256_setzero_si256();
+    }
+    u64 n0 = n[0];
+    for (int i = 0; i < limbs; i++) {
+        __m256i bi = _mm256_set1_epi64x((long long) b[i]);
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm256_add_epi64(acc[t], _mm256_mul_epu32(A[t], bi));
+        }
+        u64 acc0 = (u64) _mm_cvtsi128_si64(_mm256_castsi256_si128(acc[0]));
+        u64 y = (acc0 * k0) & AVX2_MASK;
+        __m256i yv = _mm256_set1_epi64x((long long) y);
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm256_add_epi64(acc[t], _mm256_mul_epu32(N[t], yv));
+        }
+        // The lowest limb is zero now (mod 2^r), drop it and carry the bits above r.
+        u64 carry = (acc0 + n0 * y) >> AVX2_RADIX;
+        for (int t = 0; t < regs - 1; t++) {
+            acc[t] = shiftLanesIn(acc[t], acc[t + 1]);
+        }
+        acc[regs - 1] = shiftLanesIn(acc[regs - 1], _mm256_setzero_si256());
+        acc[0] = _mm256_add_epi64(acc[0], _mm256_set_epi64x(0, 0, 0, (long long) carry));
+
+        if ((i & (AVX2_NORMALIZE_INTERVAL - 1)) == AVX2_NORMALIZE_INTERVAL - 1) {
+            avx2Normalize(acc, regs);
+        }
+    }
+    for (int t = 0; t < regs; t++) {
+        _mm256_storeu_si256((__m256i *) (out + (t << 2)), acc[t]);
+    }
+    carryLimbs(out, limbs, AVX2_RADIX);
+}
+
+__attribute__((target("avx2")))
+static void avx2Amm(u64 *out, const u64 *a, const u64 *b, const u64 *n, u64 k0, int limbs, int regs) {
+    // Unrolled for the key sizes we support, 1024/2048/3072/4096 bits.
+    switch (regs) {
+        case 9:
+            avx2AmmRegs(out, a, b, n, k0, limbs, 9);
+            break;
+        case 18:
+            avx2AmmRegs(out, a, b, n, k0, limbs, 18);
+            break;
+        case 27:
+            avx2AmmRegs(out, a, b, n, k0, limbs, 27);
+            break;
+        default:
+            avx2AmmRegs(out, a, b, n, k0, limbs, regs);
+            break;
+    }
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+static inline __attribute__((always_inline))
+void ifmaAmmRegs(u64 *out, const u64 *a, const u64 *b, const u64 *n, u64 k0, int limbs, const int regs) {
+    __m512i acc[IFMA_MAX_REGS], A[IFMA_MAX_REGS], N[IFMA_MAX_REGS];
+    for (int t = 0; t < regs; t++) {
+        A[t] = _mm512_loadu_si512((const void *) (a + (t << 3)));
+        N[t] = _mm512_loadu_si512((const void *) (n + (t << 3)));
+        acc[t] = _mm512_setzero_si512();
+    }
+    const __m512i zero = _mm512_setzero_si512();
+    u64 n0 = n[0];
+    for (int i = 0; i < limbs; i++) {
+        __m512i bi = _mm512_set1_epi64((long long) b[i]);
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm512_madd52lo_epu64(acc[t], A[t], bi);
+        }
+        u64 acc0 = (u64) _mm_cvtsi128_si64(_mm512_castsi512_si128(acc[0]));
+        u64 y = (acc0 * k0) & IFMA_MASK;
+        __m512i yv = _mm512_set1_epi64((long long) y);
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm512_madd52lo_epu64(acc[t], N[t], yv);
+        }
+        u64 carry = (acc0 + ((n0 * y) & IFMA_MASK)) >> IFMA_RADIX;
+        for (int t = 0; t < regs - 1; t++) {
+            acc[t] = _mm512_alignr_epi64(acc[t + 1], acc[t], 1);
+        }
+        acc[regs - 1] = _mm512_alignr_epi64(zero, acc[regs - 1], 1);
+        acc[0] = _mm512_mask_add_epi64(acc[0], 1, acc[0], _mm512_set1_epi64((long long) carry));
+        // The high halves of the products belong to the next limb, which is the current limb after the shift.
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm512_madd52hi_epu64(acc[t], A[t], bi);
+        }
+        for (int t = 0; t < regs; t++) {
+            acc[t] = _mm512_madd52hi_epu64(acc[t], N[t], yv);
+        }
+    }
+    for (int t = 0; t < regs; t++) {
+        _mm512_storeu_si512((void *) (out + (t << 3)), acc[t]);
+    }
+    carryLimbs(out, limbs, IFMA_RADIX);
+}
+
+__attribute__((target("avx512f,avx512ifma")))
+static void ifmaAmm(u64 *out, const u64 *a, const u64 *b, const u64 *n, u64 k0, int limbs, int regs) {
+    // Unrolled for the 1024/2048/3072 bits keys, and the primes of the CRT (2 regs for 683 bits, 4 for 1366 bits).
+    switch (regs) {
+        case 2:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, 2);
+            break;
+        case 3:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, 3);
+            break;
+        case 4:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, 4);
+            break;
+        case 5:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, 5);
+            break;
+        case 8:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, 8);
+            break;
+        default:
+            ifmaAmmRegs(out, a, b, n, k0, limbs, regs);
+            break;
+    }
+}
+
+/**
+ * The window of bits [bit, bit + bits) of the exponent, the bits above the exponent are zero.
+ */
+static u32 exponentWindow(const u32 *exp, int expLen, int bit, int bits) {
+    u32 w = 0;
+    for (int i = bit + bits - 1; i >= bit; i--) {
+        int word = i >> 5;
+        u32 b = word < expLen ? (exp[expLen - 1 - word] >> (i & 31)) & 1 : 0;
+        w = (w << 1) | b;
+    }
+    return w;
+}
+
+/**
+ * out = table[index], reading all the entries of the table, so the cache lines touched do not
+ * depend on the (secret) index.
+ */
+static void selectEntry(const u64 *table, int lanes, u32 index, u64 *out) {
+    memset(out, 0, lanes << 3);
+    for (u32 i = 0; i < AVX_TABLE_SIZE; i++) {
+        u32 d = i ^ index;
+        // All ones if d == 0, else zero.
+        u64 mask = (u64) 0 - (u64) (((d | (0 - d)) >> 31) ^ 1);
+        const u64 *entry = table + i * lanes;
+        for (int j = 0; j < lanes; j++) {
+            out[j] |= entry[j] & mask;
+        }
+    }
+}
+
+void avx_mod_pow(AvxEngine engine,
+                 const u32 *base,
+                 const u32 *rr,
+                 const u32 *exp,
+                 int expLen,
+                 const u32 *mod,
+                 int modLen,
+                 u32 *out,
+                 int secret,
+                 u32 *scratch) {
+    AmmFunc amm = engine == AVX_512_IFMA ? ifmaAmm : avx2Amm;
+    int r = radixBits(engine);
+    int limbs = limbCount(engine, modLen);
+    int regs = regCount(engine, modLen);
+    int lanes = regs * lanesPerReg(engine);
+
+    u64 *p = (u64 *) (((uintptr_t) scratch + 63) & ~((uintptr_t) 63));
+    u64 *n = p;
+    u64 *one = n + lanes;
+    u64 *x = one + lanes;
+    u64 *table = x + lanes;
+
+    toLimbs(mod, modLen, r, n, lanes);
+    u64 k0 = montgomeryK0(n[0], r);
+
+    // table[0] = R' mod n, table[1] = base * R' mod n, table[i] = table[i - 1] * table[1]
+    toLimbs(rr, modLen, r, x, lanes);
+    memset(one, 0, lanes << 3);
+    one[0] = 1;
+    amm(table, x, one, n, k0, limbs, regs);
+    toLimbs(base, modLen, r, one, lanes);
+    amm(table + lanes, one, x, n, k0, limbs, regs);
+    for (int i = 2; i < AVX_TABLE_SIZE; i++) {
+        amm(table + i * lanes, table + (i - 1) * lanes, table + lanes, n, k0, limbs, regs);
+    }
+
+    int ebits;
+    if (secret) {
+        // The windows cover the modulus size (or the exponent words, if longer) whatever the exponent is,
+        // so the count of the multiplications does not tell the bit length of the exponent.
+        ebits = (expLen > modLen ? expLen : modLen) << 5;
+    } else {
+        // The windows cover the bits of the exponent only (at least one bit, the exponent 0 gives 1).
+        int top = 0;
+        while (top < expLen - 1 && exp[top] == 0) {
+            top++;
+        }
+        u32 w = exp[top];
+        ebits = (expLen - 1 - top) << 5;
+        while (w != 0) {
+            ebits++;
+            w >>= 1;
+        }
+        if (ebits == 0) {
+            ebits = 1;
+        }
+    }
+    u64 *entry = one;
+
+    // Fixed window from the top, the top window takes the remainder bits.
+    int bit = ebits - (ebits % AVX_WINDOW_BITS == 0 ? AVX_WINDOW_BITS : ebits % AVX_WINDOW_BITS);
+    u32 w = exponentWindow(exp, expLen, bit, ebits - bit);
+    if (secret) {
+        selectEntry(table, lanes, w, x);
+    } else {
+        memcpy(x, table + w * lanes, lanes << 3);
+    }
+    while (bit > 0) {
+        bit -= AVX_WINDOW_BITS;
+        for (int i = 0; i < AVX_WINDOW_BITS; i++) {
+            amm(x, x, x, n, k0, limbs, regs);
+        }
+        w = exponentWindow(exp, expLen, bit, AVX_WINDOW_BITS);
+        if (secret) {
+            selectEntry(table, lanes, w, entry);
+            amm(x, x, entry, n, k0, limbs, regs);
+        } else if (w != 0) {
+            amm(x, x, table + w * lanes, n, k0, limbs, regs);
+        }
+    }
+
+    // Out of Montgomery form, x / R' mod n is not larger than n.
+    memset(one, 0, lanes << 3);
+    one[0] = 1;
+    amm(x, x, one, n, k0, limbs, regs);
+    fromLimbs(x, limbs, r, out, modLen);
+
+    // out - mod is taken if it does not borrow (out >= mod), selected by the mask rather than a branch.
+    u32 *diff = (u32 *) table;
+    u64 borrow = 0;
+    for (int j = modLen - 1; j >= 0; j--) {
+        u64 d = (u64) out[j] - mod[j] - borrow;
+        diff[j] = (u32) d;
+        borrow = (d >> 32) & 1;
+    }
+    u32 mask = (u32) borrow - 1;
+    for (int j = 0; j < modLen; j++) {
+        out[j] = (diff[j] & mask) | (out[j] & ~mask);
+    }
+}
+
+#endif
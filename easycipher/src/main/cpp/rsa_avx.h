@@ -0,0 +1,70 @@
+
+#ifndef EASY_CIPHER_RSA_AVX_H
+#define EASY_CIPHER_RSA_AVX_H
+
+#include <stdint.h>
+
+// The vectorized Montgomery multiplication is for x86_64 only (Android x86_64 ABI, emulator, Chromebook).
+// Build with -DRSA_NO_AVX to take the scalar path everywhere.
+#if defined(__x86_64__) && !defined(RSA_NO_AVX)
+#define RSA_AVX 1
+#else
+#define RSA_AVX 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    AVX_NONE = 0,
+    // 4 lanes of radix 2^29 limbs, multiply with vpmuludq.
+    AVX_2 = 1,
+    // 8 lanes of radix 2^52 limbs, multiply with vpmadd52luq/vpmadd52huq.
+    AVX_512_IFMA = 2
+} AvxEngine;
+
+/**
+ * @return The best engine supported by the CPU (and the OS), checked by cpuid.
+ */
+AvxEngine avx_engine();
+
+/**
+ * @return Bits of R' = 2^(radix bits * limbs), the Montgomery radix of the engine for the modulus of modLen words.
+ */
+int avx_montgomery_bits(AvxEngine engine, int modLen);
+
+/**
+ * @return Words (32 bits) of scratch taken by avx_mod_pow.
+ */
+int avx_scratch_len(AvxEngine engine, int modLen);
+
+/**
+ * out = base ^ exp mod mod.
+ * For the secret exponent, it takes the same windows for all the exponents up to the modulus size, and reads
+ * the whole table for each window, so neither the time nor the cache lines touched depend on the exponent.
+ * The public one takes the windows of its bits only, and skips the zero windows.
+ *
+ * All numbers are big-endian 32 bits words (the same as BigInt in rsa.c),
+ * base, rr, mod and out take modLen words. mod must be odd.
+ *
+ * @param rr : R'^2 mod mod, R' = 2^avx_montgomery_bits(engine, modLen).
+ * @param secret : Nonzero for the secret exponent (private key), zero for the public one.
+ * @param scratch : avx_scratch_len(engine, modLen) words.
+ */
+void avx_mod_pow(AvxEngine engine,
+                 const uint32_t *base,
+                 const uint32_t *rr,
+                 const uint32_t *exp,
+                 int expLen,
+                 const uint32_t *mod,
+                 int modLen,
+                 uint32_t *out,
+                 int secret,
+                 uint32_t *scratch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EASY_CIPHER_RSA_AVX_H
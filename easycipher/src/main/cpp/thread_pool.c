@@ -0,0 +1,157 @@
+#include "thread_pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#define POOL_MAX_WORKERS 7
+
+typedef struct PoolJob {
+    PoolTask task;
+    void *arg;
+    int count;
+    // The next index to run, claimed by the atomic add, so the tasks take no lock.
+    int next;
+    // Tasks done, and the workers holding the job, under the pool lock.
+    int finished;
+    int users;
+    int queued;
+    struct PoolJob *prev;
+    struct PoolJob *nextJob;
+    pthread_cond_t done;
+} PoolJob;
+
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+// The jobs with indices left, the workers take the head first.
+static PoolJob *pool_head = NULL;
+static PoolJob *pool_tail = NULL;
+static int pool_workers = 0;
+
+/**
+ * Run the tasks of the job until no index left, returns the tasks run.
+ */
+static int runTasks(PoolJob *job) {
+    int done = 0;
+    for (;;) {
+        int index = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (index >= job->count) {
+            return done;
+        }
+        job->task(job->arg, index);
+        done++;
+    }
+}
+
+// Under the pool lock.
+static void dequeue(PoolJob *job) {
+    if (!job->queued) {
+        return;
+    }
+    if (job->prev != NULL) {
+        job->prev->nextJob = job->nextJob;
+    } else {
+        pool_head = job->nextJob;
+    }
+    if (job->nextJob != NULL) {
+        job->nextJob->prev = job->prev;
+    } else {
+        pool_tail = job->prev;
+    }
+    job->queued = 0;
+}
+
+static void *poolWorker(void *unused) {
+    (void) unused;
+    pthread_mutex_lock(&pool_lock);
+    for (;;) {
+        while (pool_head == NULL) {
+            pthread_cond_wait(&pool_wake, &pool_lock);
+        }
+        PoolJob *job = pool_head;
+        job->users++;
+        pthread_mutex_unlock(&pool_lock);
+
+        int done = runTasks(job);
+
+        pthread_mutex_lock(&pool_lock);
+        // No index left, the job leaves the queue, the caller waits for the tasks still running.
+        dequeue(job);
+        job->finished += done;
+        job->users--;
+        if (job->finished == job->count && job->users == 0) {
+            pthread_cond_signal(&job->done);
+        }
+    }
+    return NULL;
+}
+
+static void startWorkers() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int workers = cpus > 1 ? (int) cpus - 1 : 0;
+    if (workers > POOL_MAX_WORKERS) {
+        workers = POOL_MAX_WORKERS;
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < workers; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, &attr, poolWorker, NULL) == 0) {
+            pool_workers++;
+        }
+    }
+    pthread_attr_destroy(&attr);
+}
+
+int thread_pool_size() {
+    pthread_once(&pool_once, startWorkers);
+    return pool_workers + 1;
+}
+
+void thread_pool_run(PoolTask task, void *arg, int count) {
+    if (count <= 0) {
+        return;
+    }
+    pthread_once(&pool_once, startWorkers);
+    if (count == 1 || pool_workers == 0) {
+        for (int i = 0; i < count; i++) {
+            task(arg, i);
+        }
+        return;
+    }
+
+    PoolJob job;
+    job.task = task;
+    job.arg = arg;
+    job.count = count;
+    job.next = 0;
+    job.finished = 0;
+    job.users = 0;
+    job.queued = 1;
+    job.nextJob = NULL;
+    pthread_cond_init(&job.done, NULL);
+
+    pthread_mutex_lock(&pool_lock);
+    job.prev = pool_tail;
+    if (pool_tail != NULL) {
+        pool_tail->nextJob = &job;
+    } else {
+        pool_head = &job;
+    }
+    pool_tail = &job;
+    pthread_cond_broadcast(&pool_wake);
+    pthread_mutex_unlock(&pool_lock);
+
+    int done = runTasks(&job);
+
+    pthread_mutex_lock(&pool_lock);
+    dequeue(&job);
+    job.finished += done;
+    // The job is on the stack, wait until no worker holds it.
+    while (job.finished < job.count || job.users > 0) {
+        pthread_cond_wait(&job.done, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+    pthread_cond_destroy(&job.done);
+}
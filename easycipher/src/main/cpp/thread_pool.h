@@ -0,0 +1,30 @@
+
+#ifndef EASY_CIPHER_THREAD_POOL_H
+#define EASY_CIPHER_THREAD_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*PoolTask)(void *arg, int index);
+
+/**
+ * Run task(arg, index) for each index in [0, count), on the workers of the pool and the calling thread,
+ * returns when all of them are done.
+ *
+ * The workers are started by the first call (one less than the CPUs, 7 at most) and kept for the process,
+ * so a call takes no thread creation. The calling thread runs the tasks too, so the call could be nested
+ * (a task may call it again) without a deadlock.
+ */
+void thread_pool_run(PoolTask task, void *arg, int count);
+
+/**
+ * @return Threads running the tasks of one call: the workers and the calling thread.
+ */
+int thread_pool_size();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EASY_CIPHER_THREAD_POOL_H
@@ -0,0 +1,10 @@
+#include "wipe.h"
+
+#include <stdint.h>
+
+void secure_wipe(void *buffer, size_t len) {
+    volatile uint8_t *p = (volatile uint8_t *) buffer;
+    while (len-- > 0) {
+        *p++ = 0;
+    }
+}
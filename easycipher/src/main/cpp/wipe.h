@@ -0,0 +1,22 @@
+
+#ifndef EASY_CIPHER_WIPE_H
+#define EASY_CIPHER_WIPE_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Zero the buffer before it is freed (the keys, the secret numbers).
+ * The stores are volatile, so the compiler keeps them, unlike a memset of the memory freed next
+ * (explicit_bzero is not in the API 21 of Android).
+ */
+void secure_wipe(void *buffer, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //EASY_CIPHER_WIPE_H
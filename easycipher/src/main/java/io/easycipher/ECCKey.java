@@ -1,10 +1,19 @@
 package io.easycipher;
 
 public class ECCKey {
+    /**
+     * The curve of the key, one of {@link EasyECC#SECP128R1} etc.
+     */
+    public final int curve;
     public final byte[] publicKey;
     public final byte[] privateKey;
 
     public ECCKey(byte[] pubKey, byte[] priKey) {
+        this(EasyECC.SECP256R1, pubKey, priKey);
+    }
+
+    public ECCKey(int curve, byte[] pubKey, byte[] priKey) {
+        this.curve = curve;
         publicKey = pubKey;
         privateKey = priKey;
     }
@@ -0,0 +1,54 @@
+package io.easycipher;
+
+import java.io.Closeable;
+
+/**
+ * The ECC public key set up in native (decompressed and checked on the curve, and the precomputed multiples
+ * for the verification), for the keys used again and again, such as the keys of the servers.
+ * See {@link EasyECC#verify(ECCKeyHandle, byte[], byte[])} and {@link EasyECC#getSecret(ECCKeyHandle, byte[])}.
+ * <p>
+ * The handle could be used by the threads at the same time, close it after the last use.
+ */
+public final class ECCKeyHandle extends Cipher implements Closeable {
+    final NativeRef ref;
+
+    public final int curve;
+
+    private ECCKeyHandle(long handle, int curve) {
+        this.ref = new NativeRef(this, handle, ECCKeyHandle::freeKey, "key is closed");
+        this.curve = curve;
+    }
+
+    /**
+     * Set up the public key in native.
+     *
+     * @param curve      The curve of the key, {@link EasyECC#SECP256R1} etc.
+     * @param publicKey  The compressed public key, {@link EasyECC#publicKeyLength} bytes.
+     * @param precompute True to precompute the multiples of the key for the verification,
+     *                   false if it is only for ECDH.
+     * @return The key handle, close it after use.
+     * @throws IllegalArgumentException If the curve is not supported, or the key is not on the curve.
+     */
+    public static ECCKeyHandle create(int curve, byte[] publicKey, boolean precompute) {
+        if (publicKey == null || publicKey.length != EasyECC.publicKeyLength(curve)) {
+            throw new IllegalArgumentException("Invalid key");
+        }
+        return new ECCKeyHandle(createKey(curve, publicKey, precompute), curve);
+    }
+
+    public static ECCKeyHandle create(int curve, byte[] publicKey) {
+        return create(curve, publicKey, true);
+    }
+
+    /**
+     * Free the native key, after the calls running with it. The key unreachable is freed as well.
+     */
+    @Override
+    public void close() {
+        ref.close();
+    }
+
+    private native static long createKey(int curve, byte[] publicKey, boolean precompute);
+
+    private native static void freeKey(long handle);
+}
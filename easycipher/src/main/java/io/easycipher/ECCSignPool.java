@@ -0,0 +1,112 @@
+package io.easycipher;
+
+import java.io.Closeable;
+
+/**
+ * The ECDSA nonces made ahead for {@link EasyECC#sign(ECCSignPool, byte[], byte[])}: a native thread at the
+ * background priority keeps up to {@link #capacity} of (r, 1 / k) ready, the part of the signature independent
+ * of the message, so the signing only takes two multiplications mod n. Each nonce is used by one signature
+ * and wiped. When the pool is empty, the signature makes its own nonce as {@link EasyECC#sign(int, byte[], byte[])}.
+ * <p>
+ * The pool could be used by the threads at the same time, close it after the last use to stop its thread.
+ * It must not be used across fork(): the child has no thread, and the nonces copied into both processes
+ * would each sign twice, which gives away the private key.
+ */
+public final class ECCSignPool extends Cipher implements Closeable {
+    /**
+     * The capacity taken by {@link #create} at most.
+     */
+    public static final int MAX_CAPACITY = 1024;
+
+    final NativeRef ref;
+
+    public final int curve;
+    public final int capacity;
+
+    /**
+     * The counters of the pool at the same moment.
+     */
+    public static final class Stats {
+        public final int capacity;
+        /**
+         * The nonces ready in the pool.
+         */
+        public final int available;
+        /**
+         * The nonces made by the thread of the pool.
+         */
+        public final long produced;
+        /**
+         * The signatures with a nonce from the pool.
+         */
+        public final long consumed;
+        /**
+         * The signatures finding the pool empty, made their own nonces.
+         */
+        public final long misses;
+        /**
+         * The nonces the thread failed to make (no system random), retried with a growing wait.
+         */
+        public final long failures;
+
+        Stats(long[] values) {
+            capacity = (int) values[0];
+            available = (int) values[1];
+            produced = values[2];
+            consumed = values[3];
+            misses = values[4];
+            failures = values[5];
+        }
+
+        @Override
+        public String toString() {
+            return "capacity=" + capacity + ", available=" + available + ", produced=" + produced
+                    + ", consumed=" + consumed + ", misses=" + misses + ", failures=" + failures;
+        }
+    }
+
+    private ECCSignPool(long handle, int curve, int capacity) {
+        this.ref = new NativeRef(this, handle, ECCSignPool::freePool, "pool is closed");
+        this.curve = curve;
+        this.capacity = capacity;
+    }
+
+    /**
+     * Start the pool, its thread fills the pool at once.
+     *
+     * @param curve    The curve of the private keys, {@link EasyECC#SECP256R1} etc.
+     * @param capacity The nonces kept at most, 1 to {@link #MAX_CAPACITY}.
+     * @return The pool, close it after use.
+     * @throws IllegalArgumentException If the curve is not supported, or the capacity is out of range.
+     */
+    public static ECCSignPool create(int curve, int capacity) {
+        if (capacity < 1 || capacity > MAX_CAPACITY) {
+            throw new IllegalArgumentException("Invalid capacity");
+        }
+        return new ECCSignPool(createPool(curve, capacity), curve, capacity);
+    }
+
+    public Stats getStats() {
+        long handle = ref.acquire();
+        try {
+            return new Stats(getStats(handle));
+        } finally {
+            ref.release(this);
+        }
+    }
+
+    /**
+     * Stop the thread, wipe the nonces left and free the pool, after the signatures running with it.
+     * The pool unreachable is freed as well.
+     */
+    @Override
+    public void close() {
+        ref.close();
+    }
+
+    private native static long createPool(int curve, int capacity);
+
+    private native static void freePool(long handle);
+
+    private native static long[] getStats(long handle);
+}
@@ -1,30 +1,82 @@
 package io.easycipher;
 
+import java.util.BitSet;
+
 /**
  * Implement of ECDH and ECDSA.
+ * <p>
+ * The curve is selected by its ID, the value is the size of the private key in bytes.
+ * The methods without the curve take {@link #SECP256R1}.
  */
 public class EasyECC  extends Cipher {
-    private static final int ECC_BYTES = 32;
+    public static final int SECP128R1 = 16;
+    public static final int SECP192R1 = 24;
+    public static final int SECP256R1 = 32;
+    public static final int SECP384R1 = 48;
+
+    private static final int ECC_BYTES = SECP256R1;
     public static final int ECC_PUBLIC_KEY_LEN = ECC_BYTES + 1;
     public static final int ECC_PRIVATE_KEY_LEN = ECC_BYTES;
     public static final int ECC_SIGNATURE_LEN = ECC_BYTES * 2;
     public static final int ECC_HASH_LEN = ECC_BYTES;
 
+    /**
+     * @throws IllegalArgumentException If the curve is not supported.
+     */
+    public static int publicKeyLength(int curve) {
+        return checkCurve(curve) + 1;
+    }
+
+    public static int privateKeyLength(int curve) {
+        return checkCurve(curve);
+    }
+
+    public static int signatureLength(int curve) {
+        return checkCurve(curve) * 2;
+    }
+
+    /**
+     * The hash is the same size as the private key, 48 bytes (SHA-384) for {@link #SECP384R1}.
+     */
+    public static int hashLength(int curve) {
+        return checkCurve(curve);
+    }
+
+    private static int checkCurve(int curve) {
+        if (curve != SECP128R1 && curve != SECP192R1 && curve != SECP256R1 && curve != SECP384R1) {
+            throw new IllegalArgumentException("Invalid curve");
+        }
+        return curve;
+    }
+
     /**
      * Generate key pair.
      *
      * @return ecc public key and private key, return null if error occurred.
      */
     public static ECCKey generateKey() {
-        byte[] keys = makeKey();
+        return generateKey(SECP256R1);
+    }
+
+    /**
+     * Generate key pair on the curve.
+     *
+     * @param curve {@link #SECP128R1}, {@link #SECP192R1}, {@link #SECP256R1} or {@link #SECP384R1}.
+     * @return ecc public key and private key, return null if error occurred.
+     * @throws IllegalArgumentException If the curve is not supported.
+     */
+    public static ECCKey generateKey(int curve) {
+        int publicKeyLen = publicKeyLength(curve);
+        int privateKeyLen = privateKeyLength(curve);
+        byte[] keys = makeKey(curve);
         if (keys == null) {
             return null;
         }
-        byte[] publicKey = new byte[ECC_PUBLIC_KEY_LEN];
-        byte[] privateKey = new byte[ECC_PRIVATE_KEY_LEN];
-        System.arraycopy(keys, 0, publicKey, 0, ECC_PUBLIC_KEY_LEN);
-        System.arraycopy(keys, ECC_PUBLIC_KEY_LEN, privateKey, 0, ECC_PRIVATE_KEY_LEN);
-        return new ECCKey(publicKey, privateKey);
+        byte[] publicKey = new byte[publicKeyLen];
+        byte[] privateKey = new byte[privateKeyLen];
+        System.arraycopy(keys, 0, publicKey, 0, publicKeyLen);
+        System.arraycopy(keys, publicKeyLen, privateKey, 0, privateKeyLen);
+        return new ECCKey(curve, publicKey, privateKey);
     }
 
     /**
@@ -34,21 +86,31 @@ public class EasyECC  extends Cipher {
      *
      * @param publicKey The public key of remote.
      * @param privateKey Your private key.
-     * @return The share secret, should be 32 bytes. Return null if error occurred.
+     * @return The share secret, should be 32 bytes. Return null if error occurred, or the public key is not
+     * a point on the curve.
      * @throws IllegalArgumentException If the key is null or not match the length.
      */
     public static byte[] getSecret(byte[] publicKey, byte[] privateKey) {
+        return getSecret(SECP256R1, publicKey, privateKey);
+    }
+
+    /**
+     * Get ECDH secret on the curve, see {@link #getSecret(byte[], byte[])}.
+     *
+     * @return The share secret, the size of the private key. Return null if error occurred.
+     */
+    public static byte[] getSecret(int curve, byte[] publicKey, byte[] privateKey) {
         if (publicKey == null || privateKey == null) {
             throw new IllegalArgumentException("Keys can't be null");
         }
-        if (publicKey.length != ECC_PUBLIC_KEY_LEN || privateKey.length != ECC_PRIVATE_KEY_LEN) {
+        if (publicKey.length != publicKeyLength(curve) || privateKey.length != privateKeyLength(curve)) {
             throw new IllegalArgumentException("Invalid key length");
         }
-        return ecdhSecret(publicKey, privateKey);
+        return ecdhSecret(curve, publicKey, privateKey);
     }
 
     /**
-     * Sigh the hash with ECDSA.
+     * Sign the hash with ECDSA.
      *
      * @param privateKey Your private key.
      * @param hash The message hash to sign, must be length of 32 bytes.
@@ -56,13 +118,38 @@ public class EasyECC  extends Cipher {
      * @throws IllegalArgumentException If the params is illegal.
      */
     public static byte[] sign(byte[] privateKey, byte[] hash) {
-        if (privateKey == null || privateKey.length != ECC_PRIVATE_KEY_LEN) {
+        return sign(SECP256R1, privateKey, hash);
+    }
+
+    /**
+     * Sign the hash with ECDSA on the curve, see {@link #sign(byte[], byte[])}.
+     *
+     * @param hash The message hash to sign, must be length of {@link #hashLength}.
+     * @return The signature of hash, {@link #signatureLength} bytes, return null if error occurred.
+     */
+    public static byte[] sign(int curve, byte[] privateKey, byte[] hash) {
+        if (privateKey == null || privateKey.length != privateKeyLength(curve)) {
             throw new IllegalArgumentException("Invalid key");
         }
-        if (hash == null || hash.length != ECC_HASH_LEN) {
+        if (hash == null || hash.length != hashLength(curve)) {
             throw new IllegalArgumentException("Invalid hash");
         }
-        return ecdsaSign(privateKey, hash);
+        return ecdsaSign(curve, privateKey, hash);
+    }
+
+    /**
+     * Sign the hash with ECDSA, the nonce derived from the key and the hash (RFC 6979 with HMAC-SHA-256),
+     * see {@link #sign(int, byte[], byte[])}. It reads no system random, and the same key and hash
+     * always give the same signature.
+     */
+    public static byte[] signDeterministic(int curve, byte[] privateKey, byte[] hash) {
+        if (privateKey == null || privateKey.length != privateKeyLength(curve)) {
+            throw new IllegalArgumentException("Invalid key");
+        }
+        if (hash == null || hash.length != hashLength(curve)) {
+            throw new IllegalArgumentException("Invalid hash");
+        }
+        return ecdsaSignDeterministic(curve, privateKey, hash);
     }
 
     /**
@@ -74,23 +161,131 @@ public class EasyECC  extends Cipher {
      * @return True if the signature match.
      */
     public static boolean verify(byte[] publicKey, byte[] hash, byte[] signature) {
-        if (publicKey == null || publicKey.length != ECC_PUBLIC_KEY_LEN) {
+        return verify(SECP256R1, publicKey, hash, signature);
+    }
+
+    /**
+     * Verify the signature with ECDSA on the curve, see {@link #verify(byte[], byte[], byte[])}.
+     */
+    public static boolean verify(int curve, byte[] publicKey, byte[] hash, byte[] signature) {
+        if (publicKey == null || publicKey.length != publicKeyLength(curve)) {
             throw new IllegalArgumentException("Invalid key");
         }
-        if (hash == null || hash.length != ECC_HASH_LEN) {
+        if (hash == null || hash.length != hashLength(curve)) {
             throw new IllegalArgumentException("Invalid hash");
         }
-        if (signature == null || signature.length != ECC_SIGNATURE_LEN) {
+        if (signature == null || signature.length != signatureLength(curve)) {
             throw new IllegalArgumentException("Invalid signature");
         }
-        return ecdsaVerify(publicKey, hash, signature);
+        return ecdsaVerify(curve, publicKey, hash, signature);
     }
 
-    private static native byte[] makeKey();
+    /**
+     * Get ECDH secret with the public key set up in native, see {@link #getSecret(byte[], byte[])}.
+     *
+     * @param privateKey Your private key, on the curve of the key.
+     */
+    public static byte[] getSecret(ECCKeyHandle publicKey, byte[] privateKey) {
+        if (publicKey == null || privateKey == null) {
+            throw new IllegalArgumentException("Keys can't be null");
+        }
+        if (privateKey.length != privateKeyLength(publicKey.curve)) {
+            throw new IllegalArgumentException("Invalid key length");
+        }
+        long handle = publicKey.ref.acquire();
+        try {
+            return ecdhSecretHandle(handle, privateKey);
+        } finally {
+            publicKey.ref.release(publicKey);
+        }
+    }
+
+    /**
+     * Verify the signature with the public key set up in native, see {@link #verify(byte[], byte[], byte[])}.
+     * It takes no decompression and precomputation of the key.
+     */
+    public static boolean verify(ECCKeyHandle publicKey, byte[] hash, byte[] signature) {
+        if (publicKey == null) {
+            throw new IllegalArgumentException("Invalid key");
+        }
+        if (hash == null || hash.length != hashLength(publicKey.curve)) {
+            throw new IllegalArgumentException("Invalid hash");
+        }
+        if (signature == null || signature.length != signatureLength(publicKey.curve)) {
+            throw new IllegalArgumentException("Invalid signature");
+        }
+        long handle = publicKey.ref.acquire();
+        try {
+            return ecdsaVerifyHandle(handle, hash, signature);
+        } finally {
+            publicKey.ref.release(publicKey);
+        }
+    }
+
+    /**
+     * Sign the hash with the next nonce of the pool, see {@link #sign(byte[], byte[])}.
+     * It takes no scalar multiplication of the point when the pool has a nonce.
+     *
+     * @param privateKey Your private key, on the curve of the pool.
+     */
+    public static byte[] sign(ECCSignPool pool, byte[] privateKey, byte[] hash) {
+        if (pool == null) {
+            throw new IllegalArgumentException("Invalid pool");
+        }
+        if (privateKey == null || privateKey.length != privateKeyLength(pool.curve)) {
+            throw new IllegalArgumentException("Invalid key");
+        }
+        if (hash == null || hash.length != hashLength(pool.curve)) {
+            throw new IllegalArgumentException("Invalid hash");
+        }
+        long handle = pool.ref.acquire();
+        try {
+            return ecdsaSignPool(handle, privateKey, hash);
+        } finally {
+            pool.ref.release(pool);
+        }
+    }
+
+    /**
+     * Verify the signatures, each one with its own public key, in one native call.
+     * The signatures are verified in chunks that share the modular inversions, and the chunks
+     * may run on the threads of the pool.
+     *
+     * @param publicKeys The public key of each signature, the keys not on the curve are rejected.
+     * @param hashes     The message hash of each signature, {@link #hashLength} bytes.
+     * @param signatures The signatures, {@link #signatureLength} bytes.
+     * @param parallel   True to spread the signatures on the threads of the pool.
+     * @return The bit i is set if the signature i is valid.
+     * @throws IllegalArgumentException If the params is illegal.
+     */
+    public static BitSet verifyBatch(int curve, byte[][] publicKeys, byte[][] hashes, byte[][] signatures,
+                                     boolean parallel) {
+        checkCurve(curve);
+        if (publicKeys == null || hashes == null || signatures == null) {
+            throw new IllegalArgumentException("keys, hashes and signatures can't be null");
+        }
+        if (publicKeys.length != signatures.length || hashes.length != signatures.length) {
+            throw new IllegalArgumentException("keys, hashes and signatures must have the same length");
+        }
+        return BitSet.valueOf(verifyBatch(curve, publicKeys, hashes, signatures, parallel));
+    }
+
+    private static native byte[] makeKey(int curve);
+
+    private static native byte[] ecdhSecret(int curve, byte[] publicKey, byte[] privateKey);
+
+    private static native byte[] ecdsaSign(int curve, byte[] privateKey, byte[] hash);
+
+    private static native byte[] ecdsaSignDeterministic(int curve, byte[] privateKey, byte[] hash);
+
+    private static native boolean ecdsaVerify(int curve, byte[] publicKey, byte[] hash, byte[] signature);
+
+    private static native byte[] ecdhSecretHandle(long publicKey, byte[] privateKey);
 
-    private static native byte[] ecdhSecret(byte[] publicKey, byte[] privateKey);
+    private static native boolean ecdsaVerifyHandle(long publicKey, byte[] hash, byte[] signature);
 
-    private static native byte[] ecdsaSign(byte[] privateKey, byte[] hash);
+    private static native byte[] ecdsaSignPool(long pool, byte[] privateKey, byte[] hash);
 
-    private static native boolean ecdsaVerify(byte[] publicKey, byte[] hash, byte[] signature);
+    private static native byte[] verifyBatch(int curve, byte[][] publicKeys, byte[][] hashes, byte[][] signatures,
+                                             boolean parallel);
 }
@@ -1,20 +1,41 @@
 package io.easycipher;
 
 public class EasyRSA extends Cipher {
+    /**
+     * RSASSA-PKCS1-v1_5 with SHA-256, the same as "SHA256withRSA".
+     */
+    public static final int SIGN_PKCS1 = 1;
+
+    /**
+     * RSASSA-PSS with SHA-256, MGF1 with SHA-256 and 32 bytes salt, the same as "SHA256withRSA/PSS".
+     */
+    public static final int SIGN_PSS = 2;
+
+    /**
+     * Status of the items of {@link #encryptBatch}, {@link #decryptBatch} and {@link #verifyBatch}.
+     */
+    public static final int STATUS_OK = 1;
+    public static final int STATUS_INPUT_TOO_LARGE = 5;
+    public static final int STATUS_INVALID_INPUT = 6;
+    public static final int STATUS_INVALID_SIGNATURE = 7;
+
+    // RSA_MAX_KEYGEN_THREADS of rsa.h
+    private static final int MAX_KEYGEN_THREADS = 16;
+
     /**
      * Encrypt bytes with RSA/ECB/PKCS1Padding.
      *
      * @param input The bytes to encrypt.
      *              The input length must less or equal than (blockSize - 11),
-     *              blockSize may be 128 or 256 bytes.
-     * @param key The RSA private/public key, only accept the key with 1024 or 2048 bits.
+     *              blockSize may be 128, 256, 384 or 512 bytes.
+     * @param key The RSA private/public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
      * @return The encoded bytes.
      * @throws IllegalArgumentException If the input or key is illegal.
      * @throws IllegalStateException If some error happened.
      */
     public static byte[] encrypt(byte[] input, RSAKey key) {
         checkParam(input, key);
-        return crypt(input, key.exponent, key.modulus, key.isPrivate, true);
+        return crypt(input, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(), key.isPrivate, true);
     }
 
     /**
@@ -22,15 +43,314 @@ public class EasyRSA extends Cipher {
      *
      * @param input The bytes to decrypt.
      *              The input length must less or equal than (blockSize - 11),
-     *              blockSize may be 128 or 256 bytes.
-     * @param key The RSA private/public key, only accept the key with 1024 or 2048 bits.
+     *              blockSize may be 128, 256, 384 or 512 bytes.
+     * @param key The RSA private/public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
      * @return The encoded bytes.
      * @throws IllegalArgumentException If the input or key is illegal.
      * @throws IllegalStateException If some error happened.
      */
     public static byte[] decrypt(byte[] input, RSAKey key) {
         checkParam(input, key);
-        return crypt(input, key.exponent, key.modulus, key.isPrivate, false);
+        return crypt(input, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(), key.isPrivate, false);
+    }
+
+    /**
+     * Encrypt bytes with RSA/ECB/OAEPWithSHA-256AndMGF1Padding (MGF1 with SHA-256, the empty label).
+     *
+     * @param input The bytes to encrypt.
+     *              The input length must less or equal than (blockSize - 66),
+     *              blockSize may be 128, 256, 384 or 512 bytes.
+     * @param key The RSA public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @return The encoded bytes.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[] encryptOAEP(byte[] input, RSAKey key) {
+        checkParam(input, key);
+        if (key.isPrivate) {
+            throw new IllegalArgumentException("OAEP encrypts with the public key");
+        }
+        return cryptOAEP(input, key.exponent, key.modulus, null, false, false, true);
+    }
+
+    /**
+     * Decrypt bytes with RSA/ECB/OAEPWithSHA-256AndMGF1Padding (MGF1 with SHA-256, the empty label).
+     *
+     * @param input The bytes to decrypt, the length must be the blockSize.
+     * @param key The RSA private key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @return The decoded bytes.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[] decryptOAEP(byte[] input, RSAKey key) {
+        checkParam(input, key);
+        if (!key.isPrivate) {
+            throw new IllegalArgumentException("OAEP decrypts with the private key");
+        }
+        return cryptOAEP(input, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(), true, false);
+    }
+
+    /**
+     * Encrypt the input of any length, block by block (ECB).
+     * The key is set up once for all the blocks, and the blocks are encrypted on the native worker threads.
+     *
+     * @param input The bytes to encrypt, split into chunks of (blockSize - 11) bytes,
+     *              or (blockSize - 66) bytes with OAEP.
+     * @param key The RSA private/public key (public key only with OAEP),
+     *            only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param oaep True for OAEPWithSHA-256AndMGF1Padding, false for PKCS1Padding.
+     * @return The joined encoded blocks, one block for the empty input.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[] encryptBlocks(byte[] input, RSAKey key, boolean oaep) {
+        checkParam(input, key);
+        if (oaep && key.isPrivate) {
+            throw new IllegalArgumentException("OAEP encrypts with the public key");
+        }
+        return cryptBlocks(input, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(),
+                key.isPrivate, true, oaep);
+    }
+
+    /**
+     * Decrypt the blocks made by {@link #encryptBlocks}.
+     *
+     * @param input The joined blocks, the length must be a multiple of the blockSize.
+     * @param key The RSA private/public key (private key only with OAEP),
+     *            only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param oaep True for OAEPWithSHA-256AndMGF1Padding, false for PKCS1Padding.
+     * @return The joined decoded bytes.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[] decryptBlocks(byte[] input, RSAKey key, boolean oaep) {
+        checkParam(input, key);
+        if (oaep && !key.isPrivate) {
+            throw new IllegalArgumentException("OAEP decrypts with the private key");
+        }
+        return cryptBlocks(input, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(),
+                key.isPrivate, false, oaep);
+    }
+
+    /**
+     * Encrypt the inputs with one key in one call, each input as {@link #encrypt}.
+     * The key is parsed and set up once for all the inputs, and with the public key,
+     * two exponentiations run interleaved in native.
+     *
+     * @param inputs The inputs, each one as the input of {@link #encrypt}.
+     * @param key The RSA private/public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param parallel True to spread the inputs on the native worker threads.
+     * @param outputs Gets the encoded bytes of each input, null for the failed one,
+     *                the length must be the same as inputs at least.
+     * @return The status of each input, {@link #STATUS_OK} or {@link #STATUS_INPUT_TOO_LARGE}.
+     * @throws IllegalArgumentException If the key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static int[] encryptBatch(byte[][] inputs, RSAKey key, boolean parallel, byte[][] outputs) {
+        checkBatch(inputs, key, outputs);
+        return cryptBatch(inputs, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(),
+                key.isPrivate, true, parallel, outputs);
+    }
+
+    /**
+     * Decrypt the inputs with one key in one call, each input as {@link #decrypt}, see {@link #encryptBatch}.
+     *
+     * @return The status of each input, {@link #STATUS_OK} or {@link #STATUS_INVALID_INPUT}.
+     */
+    public static int[] decryptBatch(byte[][] inputs, RSAKey key, boolean parallel, byte[][] outputs) {
+        checkBatch(inputs, key, outputs);
+        return cryptBatch(inputs, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(),
+                key.isPrivate, false, parallel, outputs);
+    }
+
+    /**
+     * Verify the signatures with one public key in one call, each one as {@link #verify}.
+     * The key is parsed and set up once for all the signatures, two of them are opened interleaved in native.
+     *
+     * @param messages The messages signed.
+     * @param signatures The signatures, the same length as messages.
+     * @param key The RSA public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param padding {@link #SIGN_PKCS1} or {@link #SIGN_PSS}.
+     * @param parallel True to spread the signatures on the native worker threads.
+     * @return The status of each signature, {@link #STATUS_OK} or {@link #STATUS_INVALID_SIGNATURE}.
+     * @throws IllegalArgumentException If the params or key is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static int[] verifyBatch(byte[][] messages, byte[][] signatures, RSAKey key, int padding,
+                                    boolean parallel) {
+        if (messages == null || signatures == null || key == null) {
+            throw new IllegalArgumentException("messages, signatures and key can't be null");
+        }
+        if (messages.length != signatures.length) {
+            throw new IllegalArgumentException("messages and signatures must have the same length");
+        }
+        if (key.isPrivate) {
+            throw new IllegalArgumentException("verify with the public key");
+        }
+        checkPadding(padding);
+        return verifyMessages(messages, signatures, key.exponent, key.modulus, padding, parallel);
+    }
+
+    /**
+     * Sign the message, the message is hashed with SHA-256 and encoded in native.
+     *
+     * @param message The message to sign.
+     * @param key The RSA private key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param padding {@link #SIGN_PKCS1} or {@link #SIGN_PSS}.
+     * @return The signature, with the block size of the key.
+     * @throws IllegalArgumentException If the message, key or padding is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[] sign(byte[] message, RSAKey key, int padding) {
+        checkParam(message, key);
+        if (!key.isPrivate) {
+            throw new IllegalArgumentException("sign with the private key");
+        }
+        checkPadding(padding);
+        return signMessage(message, key.exponent, key.modulus, key.crtParams(), key.isParallelCrt(), padding);
+    }
+
+    /**
+     * Verify the signature of the message.
+     *
+     * @param message The message signed.
+     * @param signature The signature.
+     * @param key The RSA public key, only accept the key with 1024, 2048, 3072 or 4096 bits.
+     * @param padding {@link #SIGN_PKCS1} or {@link #SIGN_PSS}.
+     * @return True if the signature is valid.
+     * @throws IllegalArgumentException If the message, key or padding is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static boolean verify(byte[] message, byte[] signature, RSAKey key, int padding) {
+        checkParam(message, key);
+        if (signature == null) {
+            throw new IllegalArgumentException("signature can't be null");
+        }
+        if (key.isPrivate) {
+            throw new IllegalArgumentException("verify with the public key");
+        }
+        checkPadding(padding);
+        return verifyMessage(message, signature, key.exponent, key.modulus, padding);
+    }
+
+    /**
+     * Encrypt bytes with RSA/ECB/PKCS1Padding, or RSA/ECB/OAEPWithSHA-256AndMGF1Padding with the public key,
+     * as {@link #encrypt} and {@link #encryptOAEP}, with the key parsed in native.
+     *
+     * @param input The bytes to encrypt.
+     * @param key The RSA private/public key handle, the public key for OAEP.
+     * @param oaep True for OAEP.
+     * @return The encoded bytes.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If the key is closed or some error happened.
+     */
+    public static byte[] encrypt(byte[] input, RSAKeyHandle key, boolean oaep) {
+        checkParam(input, key);
+        if (oaep && key.isPrivate) {
+            throw new IllegalArgumentException("OAEP encrypts with the public key");
+        }
+        long handle = key.ref.acquire();
+        try {
+            return cryptHandle(input, handle, true, oaep);
+        } finally {
+            key.ref.release(key);
+        }
+    }
+
+    /**
+     * Decrypt bytes with RSA/ECB/PKCS1Padding, or RSA/ECB/OAEPWithSHA-256AndMGF1Padding with the private key,
+     * as {@link #decrypt} and {@link #decryptOAEP}, with the key parsed in native.
+     *
+     * @param input The bytes to decrypt.
+     * @param key The RSA private/public key handle, the private key for OAEP.
+     * @param oaep True for OAEP.
+     * @return The decoded bytes.
+     * @throws IllegalArgumentException If the input or key is illegal.
+     * @throws IllegalStateException If the key is closed or some error happened.
+     */
+    public static byte[] decrypt(byte[] input, RSAKeyHandle key, boolean oaep) {
+        checkParam(input, key);
+        if (oaep && !key.isPrivate) {
+            throw new IllegalArgumentException("OAEP decrypts with the private key");
+        }
+        long handle = key.ref.acquire();
+        try {
+            return cryptHandle(input, handle, false, oaep);
+        } finally {
+            key.ref.release(key);
+        }
+    }
+
+    /**
+     * Sign the message as {@link #sign(byte[], RSAKey, int)}, with the key parsed in native.
+     *
+     * @param key The RSA private key handle.
+     */
+    public static byte[] sign(byte[] message, RSAKeyHandle key, int padding) {
+        checkParam(message, key);
+        if (!key.isPrivate) {
+            throw new IllegalArgumentException("sign with the private key");
+        }
+        checkPadding(padding);
+        long handle = key.ref.acquire();
+        try {
+            return signHandle(message, handle, padding);
+        } finally {
+            key.ref.release(key);
+        }
+    }
+
+    /**
+     * Verify the signature of the message as {@link #verify(byte[], byte[], RSAKey, int)},
+     * with the key parsed in native.
+     *
+     * @param key The RSA public key handle.
+     */
+    public static boolean verify(byte[] message, byte[] signature, RSAKeyHandle key, int padding) {
+        checkParam(message, key);
+        if (signature == null) {
+            throw new IllegalArgumentException("signature can't be null");
+        }
+        if (key.isPrivate) {
+            throw new IllegalArgumentException("verify with the public key");
+        }
+        checkPadding(padding);
+        long handle = key.ref.acquire();
+        try {
+            return verifyHandle(message, signature, handle, padding);
+        } finally {
+            key.ref.release(key);
+        }
+    }
+
+    /**
+     * Get the peak bytes of native scratch (window table and temporaries of modPow) taken by one crypt.
+     * The scratch is kept by each calling thread and reused, so the crypt itself does not allocate.
+     *
+     * @param keyBits The key size, 1024, 2048, 3072 or 4096.
+     * @return The peak bytes, 0 if no crypt with the key size yet.
+     */
+    public native static int getScratchPeak(int keyBits);
+
+    /**
+     * Generate RSA key pair with the public exponent 65537.
+     *
+     * @param bits The key size, 1024, 2048, 3072 or 4096.
+     * @param threads The threads to search the primes, 1 to search on the calling thread only.
+     *                More than the available processors (16 at most) are taken as the processors.
+     * @return The private key and the public key with PKCS#1 DER format, parse them with {@link RSAKey#parseKey}.
+     * @throws IllegalArgumentException If bits or threads is illegal.
+     * @throws IllegalStateException If some error happened.
+     */
+    public static byte[][] generateKeyPair(int bits, int threads) {
+        if (bits != 1024 && bits != 2048 && bits != 3072 && bits != 4096) {
+            throw new IllegalArgumentException("Only support the key with 1024, 2048, 3072 or 4096 bits");
+        }
+        if (threads < 1) {
+            throw new IllegalArgumentException("threads must be positive");
+        }
+        threads = Math.min(threads, Math.min(Runtime.getRuntime().availableProcessors(), MAX_KEYGEN_THREADS));
+        return generateKey(bits, threads);
     }
 
     private static void checkParam(byte[] input, RSAKey key) {
@@ -39,5 +359,53 @@ public class EasyRSA extends Cipher {
         }
     }
 
-    private native static byte[] crypt(byte[] input, byte[] exponent, byte[] modulus, boolean isPrivate, boolean isEncrypt);
+    private static void checkParam(byte[] input, RSAKeyHandle key) {
+        if (input == null || key == null) {
+            throw new IllegalArgumentException("input and key can't be null");
+        }
+    }
+
+    private static void checkBatch(byte[][] inputs, RSAKey key, byte[][] outputs) {
+        if (inputs == null || key == null || outputs == null) {
+            throw new IllegalArgumentException("inputs, key and outputs can't be null");
+        }
+        if (outputs.length < inputs.length) {
+            throw new IllegalArgumentException("outputs is too small");
+        }
+    }
+
+    private static void checkPadding(int padding) {
+        if (padding != SIGN_PKCS1 && padding != SIGN_PSS) {
+            throw new IllegalArgumentException("padding must be SIGN_PKCS1 or SIGN_PSS");
+        }
+    }
+
+    private native static byte[] signMessage(byte[] message, byte[] exponent, byte[] modulus, byte[][] crt,
+                                             boolean parallelCrt, int padding);
+
+    private native static boolean verifyMessage(byte[] message, byte[] signature, byte[] exponent, byte[] modulus, int padding);
+
+    private native static byte[][] generateKey(int bits, int threads);
+
+    private native static int[] cryptBatch(byte[][] inputs, byte[] exponent, byte[] modulus, byte[][] crt,
+                                           boolean parallelCrt, boolean isPrivate, boolean isEncrypt, boolean parallel,
+                                           byte[][] outputs);
+
+    private native static int[] verifyMessages(byte[][] messages, byte[][] signatures, byte[] exponent, byte[] modulus,
+                                               int padding, boolean parallel);
+
+    private native static byte[] crypt(byte[] input, byte[] exponent, byte[] modulus, byte[][] crt,
+                                       boolean parallelCrt, boolean isPrivate, boolean isEncrypt);
+
+    private native static byte[] cryptOAEP(byte[] input, byte[] exponent, byte[] modulus, byte[][] crt,
+                                           boolean parallelCrt, boolean isPrivate, boolean isEncrypt);
+
+    private native static byte[] cryptBlocks(byte[] input, byte[] exponent, byte[] modulus, byte[][] crt,
+                                             boolean parallelCrt, boolean isPrivate, boolean isEncrypt, boolean isOAEP);
+
+    private native static byte[] cryptHandle(byte[] input, long handle, boolean isEncrypt, boolean isOAEP);
+
+    private native static byte[] signHandle(byte[] message, long handle, int padding);
+
+    private native static boolean verifyHandle(byte[] message, byte[] signature, long handle, int padding);
 }
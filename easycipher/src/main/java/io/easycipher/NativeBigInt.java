@@ -0,0 +1,185 @@
+package io.easycipher;
+
+import java.io.Closeable;
+import java.math.BigInteger;
+import java.util.Arrays;
+
+/**
+ * The non-negative number (up to {@link #MAX_BITS} bits) kept in native, with the modular arithmetic of
+ * the RSA engine (Montgomery multiplication, the AVX code where the CPU has it), for the protocols
+ * over the large odd moduli: Diffie-Hellman of the MODP groups (RFC 3526), SRP (RFC 5054), etc.
+ * <p>
+ * The modulus is odd and larger than 2^32, any size up to {@link #MAX_BITS}. It is set up by the first operation
+ * and kept by the number, so keep the modulus object to reuse it. The numbers are immutable and could be used
+ * by the threads at the same time, close them after the last use.
+ */
+public final class NativeBigInt extends Cipher implements Closeable {
+    public static final int MAX_BITS = 4096;
+
+    /**
+     * The bases taken by {@link #multiModPow} at most.
+     */
+    public static final int MAX_MULTI_POW = 4;
+
+    private final NativeRef ref;
+
+    private NativeBigInt(long handle) {
+        this.ref = new NativeRef(this, handle, NativeBigInt::free, "number is closed");
+    }
+
+    /**
+     * @param value Non-negative, up to {@link #MAX_BITS} bits.
+     */
+    public static NativeBigInt valueOf(BigInteger value) {
+        if (value == null || value.signum() < 0) {
+            throw new IllegalArgumentException("value must be non-negative");
+        }
+        return fromBytes(value.toByteArray());
+    }
+
+    /**
+     * @param magnitude The big-endian unsigned bytes, up to {@link #MAX_BITS} bits.
+     */
+    public static NativeBigInt fromBytes(byte[] magnitude) {
+        return new NativeBigInt(create(magnitude));
+    }
+
+    /**
+     * this^exponent mod modulus, with the sliding window of the RSA exponentiation.
+     * The time depends on the exponent, it must not be secret: sign or decrypt with {@link EasyRSA} instead.
+     *
+     * @throws IllegalArgumentException If the modulus is even or not larger than 2^32.
+     */
+    public NativeBigInt modPow(NativeBigInt exponent, NativeBigInt modulus) {
+        checkParam(exponent, modulus);
+        NativeRef[] refs = {ref, exponent.ref, modulus.ref};
+        long[] handles = NativeRef.acquire(refs);
+        try {
+            return new NativeBigInt(modPow(handles[0], handles[1], handles[2]));
+        } finally {
+            NativeRef.release(refs, this, exponent, modulus);
+        }
+    }
+
+    /**
+     * bases[0]^exponents[0] * bases[1]^exponents[1] * ... mod modulus, for up to {@link #MAX_MULTI_POW} bases,
+     * such as g^s * y^r of the DSA-style verification, or the verifier of SRP.
+     * The exponentiations share the squares, it is faster than one {@link #modPow} per base and the multiplies.
+     * The time depends on the exponents, as {@link #modPow}.
+     *
+     * @throws IllegalArgumentException If the count of the bases is not 1 to {@link #MAX_MULTI_POW},
+     *                                  or not the same as the exponents, or the modulus is not valid.
+     */
+    public static NativeBigInt multiModPow(NativeBigInt[] bases, NativeBigInt[] exponents, NativeBigInt modulus) {
+        if (bases == null || exponents == null || modulus == null) {
+            throw new IllegalArgumentException("bases, exponents and modulus can't be null");
+        }
+        int count = bases.length;
+        if (count < 1 || count > MAX_MULTI_POW || exponents.length != count) {
+            throw new IllegalArgumentException("invalid count of bases");
+        }
+        // The bases, the exponents, then the modulus.
+        NativeRef[] refs = new NativeRef[count * 2 + 1];
+        for (int i = 0; i < count; i++) {
+            if (bases[i] == null || exponents[i] == null) {
+                throw new IllegalArgumentException("bases and exponents can't be null");
+            }
+            refs[i] = bases[i].ref;
+            refs[count + i] = exponents[i].ref;
+        }
+        refs[count * 2] = modulus.ref;
+        long[] handles = NativeRef.acquire(refs);
+        try {
+            long[] baseHandles = Arrays.copyOfRange(handles, 0, count);
+            long[] exponentHandles = Arrays.copyOfRange(handles, count, count * 2);
+            return new NativeBigInt(multiModPow(baseHandles, exponentHandles, handles[count * 2]));
+        } finally {
+            NativeRef.release(refs, bases, exponents, modulus);
+        }
+    }
+
+    /**
+     * this * other mod modulus.
+     */
+    public NativeBigInt modMultiply(NativeBigInt other, NativeBigInt modulus) {
+        checkParam(other, modulus);
+        NativeRef[] refs = {ref, other.ref, modulus.ref};
+        long[] handles = NativeRef.acquire(refs);
+        try {
+            return new NativeBigInt(modMultiply(handles[0], handles[1], handles[2]));
+        } finally {
+            NativeRef.release(refs, this, other, modulus);
+        }
+    }
+
+    /**
+     * this^-1 mod modulus. It takes the time of the value, so not for the secrets.
+     *
+     * @throws IllegalArgumentException If this is not coprime with the modulus.
+     */
+    public NativeBigInt modInverse(NativeBigInt modulus) {
+        checkParam(this, modulus);
+        NativeRef[] refs = {ref, modulus.ref};
+        long[] handles = NativeRef.acquire(refs);
+        try {
+            return new NativeBigInt(modInverse(handles[0], handles[1]));
+        } finally {
+            NativeRef.release(refs, this, modulus);
+        }
+    }
+
+    public int bitLength() {
+        long handle = ref.acquire();
+        try {
+            return bitLength(handle);
+        } finally {
+            ref.release(this);
+        }
+    }
+
+    /**
+     * @return The big-endian unsigned bytes without the leading zeros, empty for zero.
+     */
+    public byte[] toByteArray() {
+        long handle = ref.acquire();
+        try {
+            return toBytes(handle);
+        } finally {
+            ref.release(this);
+        }
+    }
+
+    public BigInteger toBigInteger() {
+        return new BigInteger(1, toByteArray());
+    }
+
+    private static void checkParam(NativeBigInt operand, NativeBigInt modulus) {
+        if (operand == null || modulus == null) {
+            throw new IllegalArgumentException("operand and modulus can't be null");
+        }
+    }
+
+    /**
+     * Wipe and free the native number, after the calls running with it. The number unreachable is freed as well.
+     */
+    @Override
+    public void close() {
+        ref.close();
+    }
+
+    private native static long create(byte[] magnitude);
+
+    private native static void free(long handle);
+
+    private native static int bitLength(long handle);
+
+    private native static byte[] toBytes(long handle);
+
+    private native static long modPow(long base, long exponent, long modulus);
+
+    private native static long multiModPow(long[] bases, long[] exponents, long modulus);
+
+    private native static long modMultiply(long a, long b, long modulus);
+
+    private native static long modInverse(long a, long modulus);
+}
@@ -0,0 +1,169 @@
+package io.easycipher;
+
+import java.lang.ref.PhantomReference;
+import java.lang.ref.ReferenceQueue;
+import java.util.Collections;
+import java.util.HashSet;
+import java.util.Set;
+
+/**
+ * The native object of a Java object (a key handle, a number, a pool), freed once: by {@link #close()}, or by the
+ * cleaner thread after the owner is unreachable.
+ * <p>
+ * Each native call takes the pointer by {@link #acquire()} and gives it back by {@link #release(Object)} in finally.
+ * The free waits for the calls holding the pointer (the last release frees it), so the object is not freed under
+ * a call. The release takes the owner as well, which keeps it strongly reachable across the call.
+ */
+final class NativeRef {
+    interface Free {
+        void free(long pointer);
+    }
+
+    private static final ReferenceQueue<Object> queue = new ReferenceQueue<>();
+    // The cleanups of the live owners, the cleanup must be reachable until it is enqueued.
+    private static final Set<Cleanup> cleanups = Collections.synchronizedSet(new HashSet<Cleanup>());
+
+    static {
+        Thread cleaner = new Thread(new Runnable() {
+            @Override
+            public void run() {
+                while (true) {
+                    try {
+                        Cleanup cleanup = (Cleanup) queue.remove();
+                        cleanups.remove(cleanup);
+                        cleanup.ref.close();
+                    } catch (InterruptedException ignored) {
+                    }
+                }
+            }
+        }, "EasyCipher-Cleaner");
+        cleaner.setDaemon(true);
+        cleaner.start();
+    }
+
+    private static final class Cleanup extends PhantomReference<Object> {
+        final NativeRef ref;
+
+        Cleanup(Object owner, NativeRef ref) {
+            super(owner, queue);
+            this.ref = ref;
+        }
+    }
+
+    private final long pointer;
+    private final Free free;
+    private final String closedMessage;
+    private final Cleanup cleanup;
+    private int users;
+    private boolean closed;
+
+    /**
+     * @param owner         The Java object of the native object, must not be referenced by free.
+     * @param closedMessage The message of the IllegalStateException of the calls after the close.
+     */
+    NativeRef(Object owner, long pointer, Free free, String closedMessage) {
+        this.pointer = pointer;
+        this.free = free;
+        this.closedMessage = closedMessage;
+        this.cleanup = new Cleanup(owner, this);
+        cleanups.add(cleanup);
+    }
+
+    /**
+     * @return The pointer, give it back by {@link #release(Object)} after the call.
+     * @throws IllegalStateException If it is closed.
+     */
+    synchronized long acquire() {
+        if (closed) {
+            throw new IllegalStateException(closedMessage);
+        }
+        users++;
+        return pointer;
+    }
+
+    /**
+     * Give the pointer back after the call.
+     *
+     * @param owner The owner of the ref, strongly reachable up to here (see {@link #keepAlive}).
+     */
+    void release(Object owner) {
+        keepAlive(owner);
+        release();
+    }
+
+    private void release() {
+        boolean last;
+        synchronized (this) {
+            users--;
+            last = closed && users == 0;
+        }
+        if (last) {
+            free.free(pointer);
+        }
+    }
+
+    /**
+     * Acquire all the refs, or none of them if one is closed.
+     */
+    static long[] acquire(NativeRef... refs) {
+        long[] pointers = new long[refs.length];
+        int i = 0;
+        try {
+            for (; i < refs.length; i++) {
+                pointers[i] = refs[i].acquire();
+            }
+        } finally {
+            if (i < refs.length) {
+                release(refs, i);
+            }
+        }
+        return pointers;
+    }
+
+    /**
+     * Release all the refs.
+     *
+     * @param owners The owners of the refs (or the arrays of them), strongly reachable up to here.
+     */
+    static void release(NativeRef[] refs, Object... owners) {
+        for (Object owner : owners) {
+            keepAlive(owner);
+        }
+        release(refs, refs.length);
+    }
+
+    private static void release(NativeRef[] refs, int count) {
+        for (int i = 0; i < count; i++) {
+            refs[i].release();
+        }
+    }
+
+    /**
+     * A use of the owner the compiler can not drop, so the owner is not collected (and its cleanup is not run)
+     * before this point. Reference.reachabilityFence is not in API 21, the lock of the owner does the same.
+     */
+    private static void keepAlive(Object owner) {
+        synchronized (owner) {
+            // The lock is the use.
+        }
+    }
+
+    /**
+     * Free the native object, now or after the last call holding it.
+     */
+    void close() {
+        boolean now;
+        synchronized (this) {
+            if (closed) {
+                return;
+            }
+            closed = true;
+            now = users == 0;
+        }
+        cleanups.remove(cleanup);
+        cleanup.clear();
+        if (now) {
+            free.free(pointer);
+        }
+    }
+}
@@ -3,10 +3,35 @@ package io.easycipher;
 import java.nio.ByteBuffer;
 
 public class RSAKey {
+    /**
+     * The primes of the multi-prime key taken by the CRT, the key with more primes crypts with the exponent.
+     */
+    public static final int MAX_PRIMES = 4;
+
     public final byte[] exponent;
     public final byte[] modulus;
     public final boolean isPrivate;
 
+    /**
+     * The public exponent e of the private key with the CRT params, null for the other keys.
+     * Each private-key operation with the CRT checks its result with it, see {@link #RSAKey(byte[], byte[], byte[],
+     * byte[][], byte[][], byte[][])}.
+     */
+    public final byte[] publicExponent;
+
+    /**
+     * The CRT params of the private key, null to crypt with the private exponent.
+     * primes: p, q, then the other primes of the multi-prime key.
+     * crtExponents: d mod (prime - 1) of each prime.
+     * crtCoefficients: [0] is (inverse of q) mod p, [1] is not used,
+     *                  [i] is (inverse of p * q * ... * r_(i-1)) mod r_i for the other primes.
+     */
+    public final byte[][] primes;
+    public final byte[][] crtExponents;
+    public final byte[][] crtCoefficients;
+
+    private volatile boolean parallelCrt;
+
     public RSAKey(byte[] exponent, byte[] modulus, boolean isPrivate) {
         if (exponent == null || modulus == null) {
             throw new IllegalArgumentException("exponent and modulus can't be null");
@@ -14,6 +39,84 @@ public class RSAKey {
         this.exponent = exponent;
         this.modulus = modulus;
         this.isPrivate = isPrivate;
+        this.publicExponent = null;
+        this.primes = null;
+        this.crtExponents = null;
+        this.crtCoefficients = null;
+    }
+
+    /**
+     * The private key with the CRT params, the private-key operations run one exponentiation per prime,
+     * each on the size of the prime, so the key with 3 primes is faster than 2 primes.
+     * The result of each operation is checked with the public exponent before it is returned, so a fault in the
+     * exponentiation of one prime does not give the other primes away.
+     *
+     * @param exponent The private exponent d.
+     * @param modulus The modulus n, the product of the primes.
+     * @param publicExponent The public exponent e.
+     * @param primes 2 to {@link #MAX_PRIMES} primes, p, q, then the other primes.
+     * @param crtExponents d mod (prime - 1) of each prime.
+     * @param crtCoefficients The coefficients of each prime, see {@link #crtCoefficients}, [1] could be null.
+     */
+    public RSAKey(byte[] exponent, byte[] modulus, byte[] publicExponent, byte[][] primes, byte[][] crtExponents,
+                  byte[][] crtCoefficients) {
+        if (exponent == null || modulus == null || publicExponent == null || primes == null || crtExponents == null
+                || crtCoefficients == null) {
+            throw new IllegalArgumentException("exponent, modulus and CRT params can't be null");
+        }
+        int count = primes.length;
+        if (count < 2 || count > MAX_PRIMES || crtExponents.length != count || crtCoefficients.length != count) {
+            throw new IllegalArgumentException("invalid CRT params");
+        }
+        for (int i = 0; i < count; i++) {
+            if (primes[i] == null || crtExponents[i] == null || (i != 1 && crtCoefficients[i] == null)) {
+                throw new IllegalArgumentException("invalid CRT params");
+            }
+        }
+        this.exponent = exponent;
+        this.modulus = modulus;
+        this.isPrivate = true;
+        this.publicExponent = publicExponent;
+        this.primes = primes;
+        this.crtExponents = crtExponents;
+        this.crtCoefficients = crtCoefficients;
+    }
+
+    /**
+     * The latency mode of the private key with the CRT params: the exponentiations of the primes run concurrently
+     * on the native worker threads, then join for the recombination. Measure it on the device
+     * (EfficiencyTest.compareRSALatency) before turning it on.
+     * Off by default, no effect without the CRT params or with one CPU.
+     *
+     * @param parallelCrt True to run the primes concurrently.
+     * @return This key.
+     */
+    public RSAKey setParallelCrt(boolean parallelCrt) {
+        this.parallelCrt = parallelCrt;
+        return this;
+    }
+
+    public boolean isParallelCrt() {
+        return parallelCrt;
+    }
+
+    /**
+     * The CRT params for native: the primes, the exponents, the coefficients, then the public exponent,
+     * null without them.
+     */
+    byte[][] crtParams() {
+        if (primes == null) {
+            return null;
+        }
+        int count = primes.length;
+        byte[][] params = new byte[count * 3 + 1][];
+        for (int i = 0; i < count; i++) {
+            params[i] = primes[i];
+            params[count + i] = crtExponents[i];
+            params[count * 2 + i] = crtCoefficients[i] != null ? crtCoefficients[i] : new byte[0];
+        }
+        params[count * 3] = publicExponent;
+        return params;
     }
 
     /**
@@ -21,11 +124,10 @@ public class RSAKey {
      *
      * @param pkcs1Key The key with pkcs#1 format.
      * @param isPrivate Private key or public key.
-     * @return RSA key pair.
+     * @return RSA key pair, the private key with the CRT params (the multi-prime key up to {@link #MAX_PRIMES}).
      */
     public static RSAKey parseKey(byte[] pkcs1Key, boolean isPrivate) {
-        byte[][] result = parseKey(ByteBuffer.wrap(pkcs1Key), isPrivate);
-        return new RSAKey(result[1], result[0], isPrivate);
+        return parseKey(ByteBuffer.wrap(pkcs1Key), isPrivate);
     }
 
     /*
@@ -45,24 +147,72 @@ public class RSAKey {
         prime2 INTEGER, -- q
         exponent1 INTEGER, -- d mod (p-1)
         exponent2 INTEGER, -- d mod (q-1)
-        coefficient INTEGER -- (inverse of q) mod p
+        coefficient INTEGER, -- (inverse of q) mod p
+        otherPrimeInfos OtherPrimeInfos OPTIONAL -- version 1 (multi)
+       }
+
+       OtherPrimeInfos ::= SEQUENCE SIZE(1..MAX) OF OtherPrimeInfo
+
+       OtherPrimeInfo ::= SEQUENCE {
+        prime INTEGER, -- ri
+        exponent INTEGER, -- di
+        coefficient INTEGER -- ti
        }
     */
-    private static byte[][] parseKey(ByteBuffer buffer, boolean isPrivate) {
-        byte[][] result = new byte[2][];
+    private static RSAKey parseKey(ByteBuffer buffer, boolean isPrivate) {
         buffer.position(1);
         getLen(buffer);
-        // Get modulus
-        if (isPrivate) {
-            skipItem(buffer);
-            result[0] = getItem(buffer);
-            skipItem(buffer);
-        } else {
-            result[0] = getItem(buffer);
+        if (!isPrivate) {
+            byte[] modulus = getItem(buffer);
+            byte[] exponent = getItem(buffer);
+            return new RSAKey(exponent, modulus, false);
+        }
+        byte[] version = getItem(buffer);
+        byte[] modulus = getItem(buffer);
+        byte[] publicExponent = getItem(buffer);
+        byte[] exponent = getItem(buffer);
+        if (!buffer.hasRemaining()) {
+            return new RSAKey(exponent, modulus, true);
+        }
+
+        int count = 2;
+        if (version[version.length - 1] == 1) {
+            // Count the other primes
+            ByteBuffer rest = buffer.duplicate();
+            for (int i = 0; i < 5; i++) {
+                skipItem(rest);
+            }
+            rest.position(rest.position() + 1);
+            int end = getLen(rest) + rest.position();
+            while (rest.position() < end) {
+                skipItem(rest);
+                count++;
+            }
+        }
+        if (count > MAX_PRIMES) {
+            return new RSAKey(exponent, modulus, true);
+        }
+
+        byte[][] primes = new byte[count][];
+        byte[][] exponents = new byte[count][];
+        byte[][] coefficients = new byte[count][];
+        primes[0] = getItem(buffer);
+        primes[1] = getItem(buffer);
+        exponents[0] = getItem(buffer);
+        exponents[1] = getItem(buffer);
+        coefficients[0] = getItem(buffer);
+        if (count > 2) {
+            buffer.position(buffer.position() + 1);
+            getLen(buffer);
+            for (int i = 2; i < count; i++) {
+                buffer.position(buffer.position() + 1);
+                getLen(buffer);
+                primes[i] = getItem(buffer);
+                exponents[i] = getItem(buffer);
+                coefficients[i] = getItem(buffer);
+            }
         }
-        // Get exponent
-        result[1] = getItem(buffer);
-        return result;
+        return new RSAKey(exponent, modulus, publicExponent, primes, exponents, coefficients);
     }
 
     private static int getLen(ByteBuffer buffer) {
@@ -0,0 +1,68 @@
+package io.easycipher;
+
+import java.io.Closeable;
+import java.nio.charset.StandardCharsets;
+
+/**
+ * The RSA key parsed and set up in native (the words of the exponent and the modulus, the Montgomery constants
+ * and the CRT params), so the key material does not go through the Java arrays on each call,
+ * and the crypt takes no key setup.
+ * <p>
+ * The handle could be used by the threads at the same time, close it after the last use.
+ */
+public final class RSAKeyHandle extends Cipher implements Closeable {
+    final NativeRef ref;
+
+    public final boolean isPrivate;
+    public final int bits;
+
+    private RSAKeyHandle(long handle) {
+        this.ref = new NativeRef(this, handle, RSAKeyHandle::freeKey, "key is closed");
+        this.isPrivate = isPrivateKey(handle);
+        this.bits = getKeyBits(handle);
+    }
+
+    /**
+     * Parse the key in native.
+     *
+     * @param key PKCS#1 RSAPrivateKey or RSAPublicKey, PKCS#8 PrivateKeyInfo (unencrypted),
+     *            or X.509 SubjectPublicKeyInfo, in DER or PEM. Only accept the key with 1024, 2048, 3072 or 4096 bits.
+     *            The private key takes the CRT params (up to {@link RSAKey#MAX_PRIMES} primes).
+     * @param parallelCrt True to run the primes concurrently, see {@link RSAKey#setParallelCrt}.
+     * @return The key handle, close it after use.
+     * @throws IllegalArgumentException If the key is malformed or not supported.
+     */
+    public static RSAKeyHandle parse(byte[] key, boolean parallelCrt) {
+        return new RSAKeyHandle(parseKey(key, parallelCrt));
+    }
+
+    public static RSAKeyHandle parse(byte[] key) {
+        return parse(key, false);
+    }
+
+    /**
+     * Parse the key in PEM, see {@link #parse(byte[], boolean)}.
+     */
+    public static RSAKeyHandle parse(String pem) {
+        if (pem == null) {
+            throw new IllegalArgumentException("key can't be null");
+        }
+        return parse(pem.getBytes(StandardCharsets.US_ASCII), false);
+    }
+
+    /**
+     * Wipe and free the native key, after the calls running with it. The key unreachable is freed as well.
+     */
+    @Override
+    public void close() {
+        ref.close();
+    }
+
+    private native static long parseKey(byte[] key, boolean parallelCrt);
+
+    private native static void freeKey(long handle);
+
+    private native static int getKeyBits(long handle);
+
+    private native static boolean isPrivateKey(long handle);
+}